@@ -0,0 +1,67 @@
+#include "latency_histogram.hpp"
+#include <time.h>
+
+uint64_t NowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+LatencyHistogram::LatencyHistogram()
+    : counts_((64 - kSubBucketBits + 1) * kSubBuckets, 0), total_(0), max_(0), sum_(0) {}
+
+// Values below kSubBuckets get exact buckets; above that the top
+// kSubBucketBits bits after the leading one select the linear sub-bucket.
+size_t LatencyHistogram::BucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<size_t>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+    uint64_t sub = (value >> shift) - kSubBuckets;
+    return static_cast<size_t>((shift + 1) * kSubBuckets + sub);
+}
+
+uint64_t LatencyHistogram::UpperBoundOf(size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+    uint64_t sub = bucket % kSubBuckets + kSubBuckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    counts_[BucketOf(value)] += count;
+    total_ += count;
+    sum_ += static_cast<long double>(value) * count;
+    if (value > max_) {
+        max_ = value;
+    }
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const {
+    if (total_ == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total_) + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t b = 0; b < counts_.size(); ++b) {
+        seen += counts_[b];
+        if (seen >= rank) {
+            uint64_t bound = UpperBoundOf(b);
+            return bound < max_ ? bound : max_;
+        }
+    }
+    return max_;
+}
+
+double LatencyHistogram::Mean() const {
+    return total_ ? static_cast<double>(sum_ / total_) : 0.0;
+}
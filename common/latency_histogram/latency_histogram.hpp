@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+uint64_t NowNs();
+
+// Log-linear histogram in the spirit of HdrHistogram: every power of two is
+// split into kSubBuckets linear buckets, so any recorded value is reported
+// with a relative error below 1 / kSubBuckets.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 7;
+    static constexpr uint64_t kSubBuckets = 1ull << kSubBucketBits;
+
+    LatencyHistogram();
+
+    void Record(uint64_t value, uint64_t count = 1);
+    uint64_t Percentile(double p) const;
+    uint64_t Count() const { return total_; }
+    uint64_t Max() const { return max_; }
+    double Mean() const;
+
+private:
+    static size_t BucketOf(uint64_t value);
+    static uint64_t UpperBoundOf(size_t bucket);
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_;
+    long double sum_;
+};
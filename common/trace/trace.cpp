@@ -0,0 +1,211 @@
+#include "trace.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace trace {
+namespace {
+
+constexpr uint64_t kInstant = ~0ull;  // Event::end of a TRACE_INSTANT
+constexpr uint64_t kMinCalibrationNs = 10000000;
+
+struct Event {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Written only by its thread; read by the exit handler. Never freed, so the
+// events of threads that already exited are still there at exit.
+struct Ring {
+    Event events[kTraceRingEvents];
+    std::atomic<uint64_t> written{0};
+    std::atomic<const char *> thread_name{nullptr};
+    long tid = 0;
+    Ring *next = nullptr;
+};
+
+std::atomic<Ring *> g_rings{nullptr};
+thread_local Ring *t_ring = nullptr;
+
+uint64_t g_start_ticks = 0;
+uint64_t g_start_ns = 0;
+
+uint64_t MonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void Dump();
+
+// A child that does not exec would otherwise dump its parent's events too.
+void ForgetRingsInChild() {
+    g_rings.store(nullptr, std::memory_order_relaxed);
+    t_ring = nullptr;
+}
+
+void StartOnce() {
+    static bool started = [] {
+        g_start_ns = MonotonicNs();
+        g_start_ticks = Ticks();
+        pthread_atfork(nullptr, nullptr, ForgetRingsInChild);
+        std::atexit(Dump);
+        return true;
+    }();
+    (void)started;
+}
+
+Ring *ThreadRing() {
+    if (t_ring) {
+        return t_ring;
+    }
+    StartOnce();
+    Ring *ring = new Ring;
+    ring->tid = syscall(SYS_gettid);
+    ring->next = g_rings.load(std::memory_order_relaxed);
+    while (!g_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+    t_ring = ring;
+    return ring;
+}
+
+void Append(const char *name, uint64_t begin, uint64_t end) {
+    Ring *ring = ThreadRing();
+    uint64_t n = ring->written.load(std::memory_order_relaxed);
+    ring->events[n % kTraceRingEvents] = Event{name, begin, end};
+    ring->written.store(n + 1, std::memory_order_release);
+}
+
+std::string OutputPath() {
+    const char *env = std::getenv("TRACE_FILE");
+    std::string pattern = env && *env ? env : "trace.%p.json";
+    std::string pid = std::to_string(getpid());
+    std::string path;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] == '%' && i + 1 < pattern.size() && pattern[i + 1] == 'p') {
+            path += pid;
+            ++i;
+        } else {
+            path += pattern[i];
+        }
+    }
+    return path;
+}
+
+bool WriteAll(int fd, const std::string &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Chrome's JSON array format: the closing bracket is optional, which lets
+// every process append its events to the same file.
+void Dump() {
+    Ring *rings = g_rings.load(std::memory_order_acquire);
+    if (!rings) {
+        return;
+    }
+
+    uint64_t end_ns = MonotonicNs();
+    while (end_ns - g_start_ns < kMinCalibrationNs) {
+        end_ns = MonotonicNs();
+    }
+    uint64_t end_ticks = Ticks();
+    double ns_per_tick = static_cast<double>(end_ns - g_start_ns) / static_cast<double>(end_ticks - g_start_ticks);
+    auto to_us = [ns_per_tick](uint64_t ticks) {
+        double ns = static_cast<double>(static_cast<int64_t>(ticks - g_start_ticks)) * ns_per_tick;
+        return (static_cast<double>(g_start_ns) + ns) / 1000.0;
+    };
+
+    int pid = getpid();
+    std::string out;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                  pid, program_invocation_short_name);
+    out += buf;
+    for (Ring *ring = rings; ring; ring = ring->next) {
+        const char *thread_name = ring->thread_name.load(std::memory_order_relaxed);
+        if (thread_name) {
+            std::snprintf(buf, sizeof(buf),
+                          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s\"}},\n",
+                          pid, ring->tid, thread_name);
+            out += buf;
+        }
+
+        uint64_t written = ring->written.load(std::memory_order_acquire);
+        uint64_t first = written > kTraceRingEvents ? written - kTraceRingEvents : 0;
+        if (first > 0) {
+            std::snprintf(buf, sizeof(buf),
+                          "{\"name\":\"trace_dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld,"
+                          "\"args\":{\"events\":%llu}},\n",
+                          to_us(ring->events[first % kTraceRingEvents].begin), pid, ring->tid,
+                          static_cast<unsigned long long>(first));
+            out += buf;
+        }
+        for (uint64_t i = first; i < written; ++i) {
+            const Event &e = ring->events[i % kTraceRingEvents];
+            if (e.end == kInstant) {
+                std::snprintf(buf, sizeof(buf),
+                              "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld},\n",
+                              e.name, to_us(e.begin), pid, ring->tid);
+            } else {
+                std::snprintf(buf, sizeof(buf),
+                              "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld},\n",
+                              e.name, to_us(e.begin), (e.end - e.begin) * ns_per_tick / 1000.0, pid, ring->tid);
+            }
+            out += buf;
+        }
+    }
+
+    std::string path = OutputPath();
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return;
+    }
+    flock(fd, LOCK_EX);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        out.insert(0, "[\n");
+    }
+    if (!WriteAll(fd, out)) {
+        std::perror(path.c_str());
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+}  // namespace
+
+void Record(const char *name, uint64_t begin, uint64_t end) {
+    Append(name, begin, end);
+}
+
+void Instant(const char *name) {
+    Append(name, Ticks(), kInstant);
+}
+
+void SetThreadName(const char *name) {
+    ThreadRing()->thread_name.store(name, std::memory_order_relaxed);
+}
+
+}  // namespace trace
@@ -0,0 +1,82 @@
+#pragma once
+
+// Scoped event tracer for the lab binaries.
+//
+// Configured with -DENABLE_TRACE=ON, every thread records events into its own
+// ring buffer and the process appends them to a Chrome trace file when it
+// exits (open it in ui.perfetto.dev or chrome://tracing). Otherwise the macros
+// below expand to nothing.
+//
+//   TRACE_SCOPE("name");        event covering the rest of the enclosing block
+//   TRACE_INSTANT("name");      zero-length marker
+//   TRACE_THREAD_NAME("name");  label for the calling thread
+//
+// Names must be string literals without quotes or backslashes: only the
+// pointer is stored, and it is written to the JSON as is.
+//
+// The file is $TRACE_FILE, "%p" in it replaced by the pid, default
+// trace.<pid>.json. Processes that share one file (e.g. TRACE_FILE=trace.json
+// for a parent and its children) append to it, so remove it between runs.
+// A thread keeps its last kTraceRingEvents events.
+
+#ifdef TRACE_ENABLED
+
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace trace {
+
+constexpr uint64_t kTraceRingEvents = 1 << 16;
+
+// Raw timestamp: the TSC on x86, the virtual counter on ARM64, nanoseconds of
+// CLOCK_MONOTONIC elsewhere. Converted to CLOCK_MONOTONIC time when dumped,
+// so traces of different processes line up.
+inline uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+void Record(const char *name, uint64_t begin, uint64_t end);
+void Instant(const char *name);
+void SetThreadName(const char *name);
+
+class Scope {
+public:
+    explicit Scope(const char *name) : name_(name), begin_(Ticks()) {}
+    ~Scope() { Record(name_, begin_, Ticks()); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name_;
+    uint64_t begin_;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) ::trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name) ::trace::Instant(name)
+#define TRACE_THREAD_NAME(name) ::trace::SetThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+
+#endif
@@ -0,0 +1,152 @@
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "outbox.hpp"
+
+// Group fan-out into real pipes, one per member, the way im_server writes
+// to client FIFOs. Group messages arrive in batches (one read of the group
+// FIFO holds several lines); after each batch the pipes are drained
+// untimed, like clients keeping up.
+//
+//   copy+write       a string built per member and message, one write each
+//                    (im_server before shared payloads)
+//   shared+write     one payload per message, flushed right after each push
+//   shared+writev    one payload per message, each member flushed once per
+//                    batch with writev
+//
+// Usage: fanout_bench [members] [messages] [batch]   (default 10000 160 16)
+//
+// Two fds per member; if RLIMIT_NOFILE cannot be raised that far, members
+// share pipes round-robin (each still has its own outbox).
+
+using Clock = std::chrono::steady_clock;
+
+struct Member {
+    int rd;
+    int wr;
+    Outbox out;
+};
+
+static const std::string kGroup = "bench";
+static const std::string kFrom = "sender";
+
+static std::string Text(size_t i) {
+    return "message " + std::to_string(i) + " to the whole group, about sixty bytes long";
+}
+
+static void Drain(std::vector<Member>& members, size_t pipes) {
+    char buf[65536];
+    for (size_t i = 0; i < pipes; ++i) {
+        while (read(members[i].rd, buf, sizeof(buf)) > 0) {
+        }
+    }
+}
+
+static void Report(const char* name, size_t deliveries, size_t bytes, double seconds) {
+    std::cout << "  " << name << ": " << deliveries << " deliveries in " << seconds << " s | "
+              << deliveries / seconds / 1e6 << " M deliveries/s | "
+              << bytes / seconds / (1 << 20) << " MiB/s\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t memberCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+    size_t messages = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 160;
+    size_t batch = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 16;
+    if (memberCount == 0 || messages == 0 || batch == 0) {
+        std::cerr << "usage: " << argv[0] << " [members] [messages] [batch]\n";
+        return EXIT_FAILURE;
+    }
+
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    rlim_t needed = 2 * memberCount + 16;
+    if (limit.rlim_cur < needed) {
+        rlimit raised = limit;
+        raised.rlim_cur = raised.rlim_max = std::max(needed, limit.rlim_max);
+        if (setrlimit(RLIMIT_NOFILE, &raised) == 0) {
+            limit = raised;
+        } else {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+    size_t pipes = std::min<size_t>(memberCount, (limit.rlim_cur - 16) / 2);
+
+    std::vector<Member> members(memberCount);
+    for (size_t i = 0; i < memberCount; ++i) {
+        if (i >= pipes) {
+            members[i].rd = members[i % pipes].rd;
+            members[i].wr = members[i % pipes].wr;
+            continue;
+        }
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+            std::perror("pipe2");
+            return EXIT_FAILURE;
+        }
+        members[i].rd = fds[0];
+        members[i].wr = fds[1];
+    }
+
+    // Large enough that nothing is refused: this measures the send path.
+    OutboxLimits limits;
+    limits.highWater = limits.lowWater = 1 << 30;
+
+    std::cout << memberCount << " members on " << pipes << " pipes, " << messages
+              << " messages in batches of " << batch << "\n";
+    size_t deliveries = memberCount * messages;
+
+    for (int variant = 0; variant < 3; ++variant) {
+        size_t bytes = 0;
+        double seconds = 0.0;
+        for (size_t first = 0; first < messages; first += batch) {
+            size_t last = std::min(messages, first + batch);
+            auto start = Clock::now();
+            if (variant == 0) {
+                for (size_t i = first; i < last; ++i) {
+                    std::string text = Text(i);
+                    for (auto& m : members) {
+                        std::string line = "[group:" + kGroup + "] " + kFrom + ": " + text;
+                        line.push_back('\n');
+                        bytes += line.size();
+                        if (write(m.wr, line.data(), line.size()) < 0) std::perror("write");
+                    }
+                }
+            } else {
+                for (size_t i = first; i < last; ++i) {
+                    Payload msg = MakePayload("[group:" + kGroup + "] " + kFrom + ": " + Text(i) + "\n");
+                    bytes += msg->size() * memberCount;
+                    for (auto& m : members) {
+                        m.out.Push(msg, limits);
+                        if (variant == 1) m.out.Flush(m.wr, limits);
+                    }
+                }
+                if (variant == 2) {
+                    for (auto& m : members) m.out.Flush(m.wr, limits);
+                }
+            }
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            Drain(members, pipes);
+        }
+        static const char* names[] = {"copy+write", "shared+write", "shared+writev"};
+        Report(names[variant], deliveries, bytes, seconds);
+    }
+
+    for (size_t i = 0; i < memberCount; ++i) {
+        if (!members[i].out.Empty()) std::cerr << "outbox not drained\n";
+        if (i < pipes) {
+            close(members[i].rd);
+            close(members[i].wr);
+        }
+    }
+    return 0;
+}
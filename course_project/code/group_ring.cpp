@@ -0,0 +1,295 @@
+#include "group_ring.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "shm_channel.hpp"
+
+// Positions count bytes ever published. A message is an 8-byte record
+// header (its length) and the frame, padded to 8 bytes; headers never
+// wrap, since the data size is a multiple of 8.
+struct GroupRing::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t dataBytes;
+    pthread_mutex_t lock;                       // robust, process-shared
+    alignas(64) std::atomic<uint64_t> reserved;  // end of the message being written
+    alignas(64) std::atomic<uint64_t> published; // end of the last complete message
+    alignas(64) std::atomic<uint32_t> seq;       // futex word, bumped per publish
+    std::atomic<uint32_t> sleepers;
+    std::atomic<uint32_t> closed;
+};
+
+struct GroupRing::Slot {
+    std::atomic<uint64_t> cursor;
+    std::atomic<uint64_t> evictedAt;  // Evicted: the server's cursor then
+    std::atomic<uint32_t> state;      // SlotState
+    std::atomic<uint32_t> waiting;    // the server's slot: asleep in its reactor
+    char login[kMaxLogin + 1];
+};
+
+namespace {
+
+constexpr uint32_t kMagic = 0x494d4752;  // "IMGR"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 4096;
+
+// A symlink to the server's memfd, /proc/<pid>/fd/<fd>.
+std::string LinkPath(std::string_view group) {
+    return "/dev/shm/im_group_" + std::string(group) + ".ring";
+}
+
+uint64_t Align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+}  // namespace
+
+std::unique_ptr<GroupRing> GroupRing::Create(std::string_view name) {
+    std::string link = LinkPath(name);
+    size_t size = kHeaderBytes + kSlots * sizeof(Slot) + kDataBytes;
+    int fd = memfd_create(("im_group_" + std::string(name)).c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return nullptr;
+    if (ftruncate(fd, (off_t)size) < 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<GroupRing> ring(new GroupRing());
+    ring->fd_ = fd;  // kept open for the clients' /proc path
+    if (!ring->Map(fd)) return nullptr;
+    unlink(link.c_str());
+    std::string target = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+    if (symlink(target.c_str(), link.c_str()) < 0) return nullptr;
+
+    // Fresh pages are zero: no messages, every slot Free.
+    Header* h = ring->header_;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&h->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    h->dataBytes = kDataBytes;
+    h->version = kVersion;
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = kMagic;
+    // The server starts out asleep: the first publisher rings.
+    ring->slots_[kServerSlot].waiting.store(1, std::memory_order_relaxed);
+    ring->slots_[kServerSlot].state.store((uint32_t)SlotState::Member, std::memory_order_release);
+    return ring;
+}
+
+std::unique_ptr<GroupRing> GroupRing::Open(std::string_view name) {
+    int fd = open(LinkPath(name).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    // Only a ring that cannot shrink under the mapping, or a reader could
+    // die of SIGBUS.
+    int seals = fcntl(fd, F_GET_SEALS);
+    std::unique_ptr<GroupRing> ring(new GroupRing());
+    bool mapped = seals >= 0 && (seals & F_SEAL_SHRINK) && ring->Map(fd);
+    close(fd);
+    if (!mapped) return nullptr;
+    const Header* h = ring->header_;
+    if (h->magic != kMagic || h->version != kVersion || h->dataBytes != kDataBytes) return nullptr;
+    return ring;
+}
+
+void GroupRing::Remove(std::string_view name) {
+    unlink(LinkPath(name).c_str());
+}
+
+bool GroupRing::Map(int fd) {
+    static_assert(sizeof(Header) <= kHeaderBytes, "header must fit its page");
+    static_assert(sizeof(Slot) == 64, "one slot per cache line");
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != kHeaderBytes + kSlots * sizeof(Slot) + kDataBytes)
+        return false;
+    void* base = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    size_ = (size_t)st.st_size;
+    header_ = static_cast<Header*>(base);
+    slots_ = reinterpret_cast<Slot*>(static_cast<char*>(base) + kHeaderBytes);
+    data_ = static_cast<char*>(base) + kHeaderBytes + kSlots * sizeof(Slot);
+    return true;
+}
+
+GroupRing::~GroupRing() {
+    if (header_) munmap(header_, size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+static void CopyIn(char* data, uint64_t pos, const void* src, size_t n) {
+    size_t at = pos & (GroupRing::kDataBytes - 1);
+    size_t first = std::min(n, GroupRing::kDataBytes - at);
+    std::memcpy(data + at, src, first);
+    std::memcpy(data, static_cast<const char*>(src) + first, n - first);
+}
+
+static void CopyOut(const char* data, uint64_t pos, void* dst, size_t n) {
+    size_t at = pos & (GroupRing::kDataBytes - 1);
+    size_t first = std::min(n, GroupRing::kDataBytes - at);
+    std::memcpy(dst, data + at, first);
+    std::memcpy(static_cast<char*>(dst) + first, data, n - first);
+}
+
+bool GroupRing::Publish(std::string_view msg) {
+    uint64_t record = 8 + Align8(msg.size());
+    if (record > kDataBytes / 4) return false;
+
+    Header* h = header_;
+    int rc = pthread_mutex_lock(&h->lock);
+    if (rc == EOWNERDEAD) {
+        // Its owner died mid-message; that message is dropped.
+        h->reserved.store(h->published.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        pthread_mutex_consistent(&h->lock);
+    } else if (rc != 0) {
+        return false;
+    }
+
+    // reserved is raised before the bytes under it are overwritten, so a
+    // reader that copied them can tell afterwards (see ReadNext).
+    uint64_t start = h->published.load(std::memory_order_relaxed);
+    h->reserved.store(start + record, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint32_t recordHeader[2] = {(uint32_t)msg.size(), 0};
+    CopyIn(data_, start, recordHeader, sizeof(recordHeader));
+    CopyIn(data_, start + 8, msg.data(), msg.size());
+    h->published.store(start + record, std::memory_order_release);
+    pthread_mutex_unlock(&h->lock);
+
+    WakeReaders();
+    return true;
+}
+
+bool GroupRing::TakeServerWake() {
+    std::atomic<uint32_t>& waiting = slots_[kServerSlot].waiting;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) == 0) return false;
+    return waiting.exchange(0, std::memory_order_acq_rel) == 1;
+}
+
+bool GroupRing::ReadNext(uint32_t slot, std::string& out, bool& lost) {
+    Slot& s = slots_[slot];
+    lost = false;
+    uint64_t cursor = s.cursor.load(std::memory_order_relaxed);
+    uint64_t published = header_->published.load(std::memory_order_acquire);
+    if (s.state.load(std::memory_order_acquire) == (uint32_t)SlotState::Evicted)
+        published = std::min(published, s.evictedAt.load(std::memory_order_relaxed));
+    if (cursor >= published) return false;
+
+    uint32_t recordHeader[2];
+    if (published - cursor <= kDataBytes) {
+        CopyOut(data_, cursor, recordHeader, sizeof(recordHeader));
+        uint64_t record = 8 + Align8(recordHeader[0]);
+        if (record <= published - cursor) {
+            out.resize(recordHeader[0]);
+            CopyOut(data_, cursor + 8, &out[0], out.size());
+            // Seqlock-style check: valid unless a publisher had reserved
+            // past this record's bytes by the time they were copied.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header_->reserved.load(std::memory_order_relaxed) - cursor <= kDataBytes) {
+                s.cursor.store(cursor + record, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    lost = true;
+    s.cursor.store(header_->published.load(std::memory_order_acquire), std::memory_order_release);
+    return false;
+}
+
+uint64_t GroupRing::Lag(uint32_t slot) const {
+    uint64_t cursor = slots_[slot].cursor.load(std::memory_order_acquire);
+    uint64_t published = header_->published.load(std::memory_order_acquire);
+    return published - cursor;
+}
+
+uint32_t GroupRing::AssignSlot(std::string_view login) {
+    if (login.empty() || login.size() > kMaxLogin) return kNoSlot;
+    for (uint32_t i = kServerSlot + 1; i < kSlots; ++i) {
+        Slot& s = slots_[i];
+        if (s.state.load(std::memory_order_acquire) != (uint32_t)SlotState::Free) continue;
+        std::memcpy(s.login, login.data(), login.size());
+        s.login[login.size()] = '\0';
+        s.cursor.store(header_->published.load(std::memory_order_acquire), std::memory_order_relaxed);
+        s.state.store((uint32_t)SlotState::Member, std::memory_order_release);
+        WakeReaders();
+        return i;
+    }
+    return kNoSlot;
+}
+
+void GroupRing::FreeSlot(uint32_t slot) {
+    if (slot == kNoSlot || slot == kServerSlot) return;
+    slots_[slot].state.store((uint32_t)SlotState::Free, std::memory_order_release);
+    WakeReaders();
+}
+
+void GroupRing::EvictSlot(uint32_t slot) {
+    if (slot == kNoSlot || slot == kServerSlot) return;
+    slots_[slot].evictedAt.store(slots_[kServerSlot].cursor.load(std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+    slots_[slot].state.store((uint32_t)SlotState::Evicted, std::memory_order_release);
+    WakeReaders();
+}
+
+bool GroupRing::ServerSleep() {
+    Slot& s = slots_[kServerSlot];
+    s.waiting.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_->published.load(std::memory_order_relaxed) == s.cursor.load(std::memory_order_relaxed))
+        return true;
+    s.waiting.store(0, std::memory_order_relaxed);
+    return false;
+}
+
+void GroupRing::Close() {
+    header_->closed.store(1, std::memory_order_release);
+    WakeReaders();
+}
+
+uint32_t GroupRing::FindSlot(std::string_view login) const {
+    if (login.empty() || login.size() > kMaxLogin) return kNoSlot;
+    for (uint32_t i = kServerSlot + 1; i < kSlots; ++i) {
+        const Slot& s = slots_[i];
+        if (s.state.load(std::memory_order_acquire) != (uint32_t)SlotState::Member) continue;
+        if (std::strncmp(s.login, login.data(), login.size()) == 0 && s.login[login.size()] == '\0') return i;
+    }
+    return kNoSlot;
+}
+
+GroupRing::SlotState GroupRing::State(uint32_t slot) const {
+    return static_cast<SlotState>(slots_[slot].state.load(std::memory_order_acquire));
+}
+
+void GroupRing::ReleaseEvicted(uint32_t slot) {
+    uint32_t evicted = (uint32_t)SlotState::Evicted;
+    slots_[slot].state.compare_exchange_strong(evicted, (uint32_t)SlotState::Free, std::memory_order_acq_rel);
+}
+
+bool GroupRing::Closed() const {
+    return header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint32_t GroupRing::Sequence() const {
+    return header_->seq.load(std::memory_order_seq_cst);
+}
+
+void GroupRing::WaitForPublish(uint32_t seq) {
+    header_->sleepers.fetch_add(1, std::memory_order_seq_cst);
+    FutexWait(header_->seq, seq);
+    header_->sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void GroupRing::WakeReaders() {
+    header_->seq.fetch_add(1, std::memory_order_seq_cst);
+    if (header_->sleepers.load(std::memory_order_seq_cst) > 0) FutexWake(header_->seq, INT_MAX);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Shared-memory broadcast ring of one group. The server creates it as a
+// memfd with its size sealed, so no process can truncate it under the
+// server's mapping, and links /dev/shm/im_group_<name>.ring to
+// /proc/<server pid>/fd/<fd>, where clients open it.
+//
+// A publisher writes each group message into the ring once, as a
+// GroupMessage frame. Every member that joined with a reader slot reads it
+// in place from its own cursor. The server is reader slot 0 and forwards
+// messages to the members that read their FIFO instead, so it copies per
+// member only for those. The server also owns the slots: it assigns them
+// on "JOINGROUP <login> <group> RING", frees them on leave, and after each
+// drain evicts readers that have fallen too far behind.
+//
+// Publishers serialise on a robust process-shared mutex, so a publisher
+// that dies mid-message loses only that message. The ring never waits for
+// readers. A reader more than Capacity() behind has lost messages, and its
+// next ReadNext says so.
+//
+// Readers sleep on a futex sequence word that every publish bumps, and
+// publishers call futex wake only when a reader is asleep. The server
+// sleeps in its reactor instead. Publishers wake it with a Ring doorbell
+// on the group FIFO, and only when it sleeps.
+class GroupRing {
+public:
+    static constexpr size_t kDataBytes = 1 << 20;
+    static constexpr uint32_t kSlots = 256;
+    static constexpr uint32_t kServerSlot = 0;
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+    static constexpr size_t kMaxLogin = 39;
+
+    enum class SlotState : uint32_t { Free, Member, Evicted };
+
+    // Server: a new, empty ring for group name, replacing a stale one.
+    static std::unique_ptr<GroupRing> Create(std::string_view name);
+    // Client: maps an existing ring; nullptr if the group has none or its
+    // size is not sealed.
+    static std::unique_ptr<GroupRing> Open(std::string_view name);
+    static void Remove(std::string_view name);
+
+    ~GroupRing();
+    GroupRing(const GroupRing&) = delete;
+    GroupRing& operator=(const GroupRing&) = delete;
+
+    size_t Capacity() const { return kDataBytes; }
+
+    // Any process. msg is one frame; false if it cannot be published.
+    bool Publish(std::string_view msg);
+    // After Publish: true, once, if the server sleeps and needs a doorbell.
+    bool TakeServerWake();
+
+    // The reader of slot: the next message after its cursor into out,
+    // advancing the cursor. false if there is none. lost is set if the
+    // reader was overrun, in which case it skips to the newest message.
+    // An evicted reader reads only up to where the server took over.
+    bool ReadNext(uint32_t slot, std::string& out, bool& lost);
+    // Bytes published but not yet read by slot.
+    uint64_t Lag(uint32_t slot) const;
+
+    // Server.
+    uint32_t AssignSlot(std::string_view login);  // kNoSlot if none is free
+    void FreeSlot(uint32_t slot);
+    // The server forwards slot's messages from its own cursor on.
+    void EvictSlot(uint32_t slot);
+    // Marks the server asleep; false if a message arrived meanwhile.
+    bool ServerSleep();
+    // The group was deleted: readers stop.
+    void Close();
+
+    // Client.
+    uint32_t FindSlot(std::string_view login) const;  // kNoSlot if login has none
+    SlotState State(uint32_t slot) const;
+    // Hands an evicted slot back for reuse, once it has been read out.
+    void ReleaseEvicted(uint32_t slot);
+    bool Closed() const;
+    // Sleeps until something is published after Sequence() returned seq,
+    // or WakeReaders is called.
+    uint32_t Sequence() const;
+    void WaitForPublish(uint32_t seq);
+    void WakeReaders();
+
+private:
+    GroupRing() = default;
+    bool Map(int fd);
+
+    struct Header;
+    struct Slot;
+    int fd_ = -1;  // server: the memfd, while the ring exists
+    Header* header_ = nullptr;
+    Slot* slots_ = nullptr;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,161 @@
+#include <sys/wait.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "group_ring.hpp"
+#include "linebuffer.hpp"
+#include "wire.hpp"
+
+// One group message to M member processes:
+//
+//   pipes  one write() per member per message, each member reading its own
+//          pipe (the FIFO fan-out im_server does)
+//   ring   one Publish per message into a GroupRing; every member reads it
+//          in place from its own slot, sleeping on the futex when idle
+//
+// Each member counts the messages it got. The ring is sized so readers that
+// keep up are never overrun; a reader that is, reports it.
+// Usage: group_ring_bench [messages] [members] [bytes]   (default 200000 8 100)
+
+using Clock = std::chrono::steady_clock;
+
+static std::string Message(size_t bytes) {
+    std::string msg;
+    AppendFrame(msg, FrameType::GroupMessage, {"bench", "sender", std::string(bytes, 'x')});
+    return msg;
+}
+
+static size_t CountFrames(LineBuffer& buf) {
+    size_t frames = 0;
+    ConsumeMessages(
+        buf, [](std::string_view) {}, [&frames](const Frame&) { ++frames; });
+    return frames;
+}
+
+static bool WaitAll(const std::vector<pid_t>& children) {
+    bool ok = true;
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        ok = ok && status == 0;
+    }
+    return ok;
+}
+
+static double RunPipes(size_t messages, size_t members, const std::string& msg) {
+    std::vector<int> writers;
+    std::vector<pid_t> children;
+    auto start = Clock::now();
+    for (size_t m = 0; m < members; ++m) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            std::perror("pipe");
+            std::exit(EXIT_FAILURE);
+        }
+        pid_t child = fork();
+        if (child == 0) {
+            for (int fd : writers) close(fd);
+            close(fds[1]);
+            LineBuffer buf;
+            size_t frames = 0;
+            while (buf.ReadFrom(fds[0]) > 0) frames += CountFrames(buf);
+            _exit(frames == messages ? 0 : 1);
+        }
+        close(fds[0]);
+        writers.push_back(fds[1]);
+        children.push_back(child);
+    }
+    for (size_t i = 0; i < messages; ++i) {
+        for (int fd : writers) {
+            if (write(fd, msg.data(), msg.size()) != (ssize_t)msg.size()) std::perror("write");
+        }
+    }
+    for (int fd : writers) close(fd);
+    if (!WaitAll(children)) std::cerr << "  a pipe member lost messages\n";
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double RunRing(size_t messages, size_t members, const std::string& msg) {
+    std::unique_ptr<GroupRing> ring = GroupRing::Create("group_ring_bench");
+    if (!ring) {
+        std::perror("GroupRing::Create");
+        std::exit(EXIT_FAILURE);
+    }
+    std::vector<uint32_t> slots;
+    for (size_t m = 0; m < members; ++m) slots.push_back(ring->AssignSlot("member" + std::to_string(m)));
+
+    auto start = Clock::now();
+    std::vector<pid_t> children;
+    for (uint32_t slot : slots) {
+        pid_t child = fork();
+        if (child == 0) {
+            // Maps the ring afresh, the way a member process does.
+            std::unique_ptr<GroupRing> mine = GroupRing::Open("group_ring_bench");
+            if (!mine) _exit(2);
+            std::string record;
+            size_t got = 0;
+            bool lost = false;
+            while (got < messages) {
+                uint32_t seq = mine->Sequence();
+                bool read = false;
+                while (mine->ReadNext(slot, record, lost)) {
+                    ++got;
+                    read = true;
+                }
+                if (lost) _exit(1);
+                if (!read) mine->WaitForPublish(seq);
+            }
+            _exit(0);
+        }
+        children.push_back(child);
+    }
+    // Backs off, as a real publisher cannot, so that no reader is overrun
+    // and every one has the full count to report.
+    for (size_t i = 0; i < messages; ++i) {
+        while (true) {
+            uint64_t lag = 0;
+            for (uint32_t slot : slots) lag = std::max(lag, ring->Lag(slot));
+            if (lag + msg.size() + 16 <= ring->Capacity()) break;
+            sched_yield();
+        }
+        ring->Publish(msg);
+    }
+    if (!WaitAll(children)) std::cerr << "  a ring member lost messages\n";
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    ring->Close();
+    GroupRing::Remove("group_ring_bench");
+    return seconds;
+}
+
+static void Report(const char* name, size_t messages, size_t members, double seconds) {
+    std::cout << "  " << name << ": " << messages << " messages in " << seconds << " s | "
+              << messages / seconds / 1e6 << " M msgs/s | " << messages * members / seconds / 1e6
+              << " M deliveries/s\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    size_t members = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8;
+    size_t bytes = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100;
+    if (messages == 0 || members == 0 || members >= GroupRing::kSlots || bytes == 0 || bytes > 4000) {
+        std::cerr << "usage: " << argv[0] << " [messages] [members < " << GroupRing::kSlots
+                  << "] [bytes <= 4000]\n";
+        return EXIT_FAILURE;
+    }
+    std::string msg = Message(bytes);
+
+    std::cout << messages << " group messages of " << msg.size() << " bytes to " << members << " members\n";
+    Report("pipes", messages, members, RunPipes(messages, members, msg));
+    Report("ring", messages, members, RunRing(messages, members, msg));
+    return 0;
+}
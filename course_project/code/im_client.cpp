@@ -6,10 +6,24 @@
 #include <signal.h>
 #include <errno.h>
 
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include "group_ring.hpp"
+#include "shm_channel.hpp"
+#include "wire.hpp"
 
 static const char* SERVER_CMD_FIFO = "/tmp/im_server_cmd.fifo";
 
@@ -48,14 +62,217 @@ static bool Push(int fd, const std::string& s) {
     return true;
 }
 
-static std::string ClientFifoPath(const std::string& login) {
-    return "/tmp/im_client_" + login + ".fifo";
+// A command as a frame once the server has shown it takes frames, else as
+// its text line. Frames larger than maxFrame go as text.
+static std::string EncodeCommand(bool frames, size_t maxFrame, FrameType type,
+                                 std::initializer_list<std::string_view> fields) {
+    std::string msg;
+    if (frames && AppendFrame(msg, type, fields) && msg.size() <= maxFrame) return msg;
+    msg = TextKeyword(type);
+    for (std::string_view f : fields) {
+        msg.push_back(' ');
+        msg.append(f.data(), f.size());
+    }
+    msg.push_back('\n');
+    return msg;
+}
+
+// Frames that would not be atomic on the shared FIFO go as text.
+static bool SendCommand(int fd, bool frames, FrameType type, std::initializer_list<std::string_view> fields) {
+    return Push(fd, EncodeCommand(frames, kMaxSharedFrame, type, fields));
+}
+
+struct Connection {
+    std::string login;
+    int fdCmd = -1;
+    std::unique_ptr<ShmChannel> shm;  // --shm
+    std::atomic<bool> frames{false};  // the server has sent a frame
+};
+
+// Tells the server to look at our rings. Always over the FIFO: the server
+// sleeps in its reactor, not on a futex.
+static void RingDoorbell(Connection& conn) {
+    SendCommand(conn.fdCmd, conn.frames, FrameType::Ring, {conn.login});
+}
+
+// Copies msg into the command ring, sleeping while it is full.
+static void WriteRing(Connection& conn, const std::string& msg) {
+    ByteRing& ring = conn.shm->ToServer();
+    size_t done = 0;
+    while (done < msg.size()) {
+        size_t n = ring.Write(msg.data() + done, msg.size() - done);
+        done += n;
+        if (ring.TakeReaderWake()) RingDoorbell(conn);
+        if (n == 0 && ring.WriterSleep()) FutexWait(ring.WriterWaiting(), 1);
+    }
+}
+
+// Over the command ring once the server reads it, else the FIFO.
+static bool SendCommand(Connection& conn, FrameType type, std::initializer_list<std::string_view> fields) {
+    if (conn.shm && conn.shm->ServerReading()) {
+        WriteRing(conn, EncodeCommand(conn.frames, 0xFFFF + kFrameHeader, type, fields));
+        return true;
+    }
+    return SendCommand(conn.fdCmd, conn.frames, type, fields);
+}
+
+static void PrintFrame(const Frame& f) {
+    auto arg = [&f](int i) { return i < f.fieldCount ? f.fields[i] : std::string_view(); };
+    switch (f.type) {
+    case FrameType::Notice:
+        std::cout << "SERVER: " << arg(0) << "\n";
+        break;
+    case FrameType::Private:
+        std::cout << "[pm] " << arg(0) << ": " << arg(1) << "\n";
+        break;
+    case FrameType::GroupMessage:
+        std::cout << "[group:" << arg(0) << "] " << arg(1) << ": " << arg(2) << "\n";
+        break;
+    case FrameType::HistoryEntry: {
+        Frame stored;
+        size_t size = 0;
+        if (DecodeFrame(arg(2), stored, size) != FrameDecode::Ok) break;
+        time_t t = (time_t)(std::strtoll(std::string(arg(1)).c_str(), nullptr, 10) / 1000);
+        tm local;
+        localtime_r(&t, &local);
+        char when[32];
+        std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+        std::cout << "[history #" << arg(0) << " " << when << "] ";
+        PrintFrame(stored);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Messages come from the FIFO and, with --shm, the delivery ring's thread.
+static std::mutex g_outputMutex;
+
+static void PrintMessages(LineBuffer& buf, Connection& conn) {
+    std::lock_guard<std::mutex> lock(g_outputMutex);
+    ConsumeMessages(
+        buf,
+        [](std::string_view line) { std::cout << line << "\n"; },
+        [&conn](const Frame& f) {
+            conn.frames = true;
+            PrintFrame(f);
+        });
+    std::cout.flush();
+}
+
+// Delivery ring reader: sleeps on the futex while the ring is empty, and
+// rings the doorbell when the server waits for room.
+static void ReadRing(Connection& conn, const std::atomic<bool>& stop) {
+    ByteRing& ring = conn.shm->ToClient();
+    LineBuffer buf;
+    while (!stop) {
+        if (ring.ReadInto(buf) > 0) {
+            if (ring.TakeWriterWake()) RingDoorbell(conn);
+            PrintMessages(buf, conn);
+            continue;
+        }
+        if (ring.ReaderSleep() && !stop) FutexWait(ring.ReaderWaiting(), 1);
+    }
 }
 
 static std::string GroupFifoPath(const std::string& group) {
     return "/tmp/im_group_" + group + ".fifo";
 }
 
+// With --shm, groups are posted to and read through their shared rings.
+struct GroupReader {
+    std::shared_ptr<GroupRing> ring;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+struct GroupRings {
+    std::unordered_map<std::string, std::shared_ptr<GroupRing>> open;  // by group
+    std::unordered_map<std::string, std::unique_ptr<GroupReader>> readers;
+};
+
+// The group's ring, mapped on first use; nullptr if it has none. A ring
+// whose group was deleted is dropped, in case it was created again.
+static std::shared_ptr<GroupRing> OpenGroupRing(GroupRings& rings, const std::string& group) {
+    auto it = rings.open.find(group);
+    if (it != rings.open.end() && !it->second->Closed()) return it->second;
+    std::shared_ptr<GroupRing> ring = GroupRing::Open(group);
+    if (ring) rings.open[group] = ring;
+    else if (it != rings.open.end()) rings.open.erase(it);
+    return ring;
+}
+
+// Waits for the server to give login a slot, then prints the group's
+// messages until the slot is freed (leave, disconnect), the server evicts
+// it, or the group is deleted. An evicted reader reads out what the server
+// left it; later messages come over the FIFO, and the first of them may
+// print before the last of these.
+static void ReadGroupRing(GroupReader& r, const std::string& login) {
+    GroupRing& ring = *r.ring;
+    uint32_t slot = GroupRing::kNoSlot;
+    std::string record;
+    while (!r.stop && !ring.Closed()) {
+        uint32_t seq = ring.Sequence();
+        if (slot == GroupRing::kNoSlot) {
+            slot = ring.FindSlot(login);
+            if (slot == GroupRing::kNoSlot) ring.WaitForPublish(seq);
+            continue;
+        }
+        GroupRing::SlotState state = ring.State(slot);
+        if (state == GroupRing::SlotState::Free) break;
+
+        bool read = false;
+        bool lost = false;
+        while (ring.ReadNext(slot, record, lost) || lost) {
+            read = true;
+            std::lock_guard<std::mutex> lock(g_outputMutex);
+            Frame f;
+            size_t size = 0;
+            if (lost) std::cout << "SERVER: group messages lost\n";
+            else if (!record.empty() && record[0] == kFrameMagic && DecodeFrame(record, f, size) == FrameDecode::Ok)
+                PrintFrame(f);
+            std::cout.flush();
+        }
+        if (state == GroupRing::SlotState::Evicted) {
+            ring.ReleaseEvicted(slot);
+            break;
+        }
+        if (!read) ring.WaitForPublish(seq);
+    }
+}
+
+static void StopGroupReader(GroupRings& rings, const std::string& group) {
+    auto it = rings.readers.find(group);
+    if (it == rings.readers.end()) return;
+    GroupReader& r = *it->second;
+    r.stop = true;
+    r.ring->WakeReaders();
+    r.thread.join();
+    rings.readers.erase(it);
+}
+
+// Publishes once for every member; the server needs a doorbell on the
+// group FIFO only when it sleeps.
+static bool PostToGroupRing(GroupRings& rings, Connection& conn, const std::string& group, const std::string& text) {
+    std::shared_ptr<GroupRing> ring = OpenGroupRing(rings, group);
+    std::string frame;
+    if (!ring || !AppendFrame(frame, FrameType::GroupMessage, {group, conn.login, text}) || !ring->Publish(frame))
+        return false;
+    if (ring->TakeServerWake()) {
+        int fdG = open(GroupFifoPath(group).c_str(), O_WRONLY | O_NONBLOCK);
+        if (fdG >= 0) {
+            SendCommand(fdG, conn.frames, FrameType::Ring, {conn.login});
+            close(fdG);
+        }
+    }
+    return true;
+}
+
+static std::string ClientFifoPath(const std::string& login) {
+    return "/tmp/im_client_" + login + ".fifo";
+}
+
 static void PrintHelp() {
     std::cout
         << "Commands:\n"
@@ -65,15 +282,31 @@ static void PrintHelp() {
         << "  /join <name>\n"
         << "  /leave <name>\n"
         << "  /g <name> <text>\n"
+        << "  /history <login|group> [since] [limit]\n"
+        << "  /stats\n"
         << "  /quit\n"
         << "  /help\n";
 }
 
+// im_client [login] [--binary] [--shm]
+//   --binary  ask the server for framed messages and send frames once it
+//             answers with one
+//   --shm     offer the server shared-memory rings for commands and
+//             deliveries, and read and post to joined groups through their
+//             rings; the FIFOs stay in use for whatever it declines
 int main(int argc, char** argv) {
     signal(SIGINT, on_sigint);
     signal(SIGTERM, on_sigint);
 
-    std::string login = (argc >= 2) ? argv[1] : "";
+    Connection conn;
+    std::string& login = conn.login;
+    bool binary = false;
+    bool shm = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--binary") == 0) binary = true;
+        else if (std::strcmp(argv[i], "--shm") == 0) shm = true;
+        else login = argv[i];
+    }
     if (login.empty()) {
         std::cout << "Enter login: ";
         std::getline(std::cin, login);
@@ -104,11 +337,25 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    Push(fdCmd, "CONNECT " + login + "\n");
+    conn.fdCmd = fdCmd;
+    if (shm) {
+        conn.shm = ShmChannel::Create(("im_client_" + login).c_str());
+        if (!conn.shm) std::perror("memfd");
+    }
+
+    GroupRings groupRings;
+    std::atomic<bool> stopRing{false};
+    std::thread ringReader;
+    if (conn.shm) {
+        ringReader = std::thread(ReadRing, std::ref(conn), std::cref(stopRing));
+        Push(fdCmd, "CONNECT " + login + (binary ? " BINARY " : " TEXT ") + conn.shm->Spec() + "\n");
+    } else {
+        Push(fdCmd, "CONNECT " + login + (binary ? " BINARY\n" : "\n"));
+    }
 
     std::cout << "Connected as '" << login << "'. Type /help\n";
 
-    std::string readBuf; 
+    LineBuffer readBuf;
 
     while (!g_stop) {
         pollfd fds[2]{};
@@ -127,20 +374,10 @@ int main(int argc, char** argv) {
         }
 
         if (fds[1].revents & POLLIN) {
-            char buf[4096];
             while (true) {
-                ssize_t n = read(fdIn, buf, sizeof(buf));
+                ssize_t n = readBuf.ReadFrom(fdIn);
                 if (n > 0) {
-                    readBuf.append(buf, buf + n);
-
-                    while (true) {
-                        size_t pos = readBuf.find('\n');
-                        if (pos == std::string::npos) break;
-                        std::string line = readBuf.substr(0, pos + 1);
-                        readBuf.erase(0, pos + 1);
-                        std::cout << line;
-                        std::cout.flush();
-                    }
+                    PrintMessages(readBuf, conn);
                     continue;
                 }
                 if (n == 0) break;
@@ -157,7 +394,8 @@ int main(int argc, char** argv) {
             if (line.empty()) continue;
 
             if (line == "/help") { PrintHelp(); continue; }
-            if (line == "/quit") { Push(fdCmd, "DISCONNECT " + login + "\n"); break; }
+            if (line == "/quit") { SendCommand(conn, FrameType::Disconnect, {login}); break; }
+            if (line == "/stats") { SendCommand(conn, FrameType::Stats, {login}); continue; }
 
             if (line.rfind("/msg ", 0) == 0) {
                 std::istringstream iss(line);
@@ -171,7 +409,7 @@ int main(int argc, char** argv) {
                     std::cout << "Usage: /msg <login> <text>\n";
                     continue;
                 }
-                Push(fdCmd, "SEND " + login + " " + to + " " + text + "\n");
+                SendCommand(conn, FrameType::Send, {login, to, text});
                 continue;
             }
 
@@ -180,7 +418,7 @@ int main(int argc, char** argv) {
                 std::string cmd, g;
                 iss >> cmd >> g;
                 if (g.empty()) { std::cout << "Usage: /create_group <name>\n"; continue; }
-                Push(fdCmd, "CREATEGROUP " + login + " " + g + "\n");
+                SendCommand(conn, FrameType::CreateGroup, {login, g});
                 continue;
             }
 
@@ -189,7 +427,7 @@ int main(int argc, char** argv) {
                 std::string cmd, g;
                 iss >> cmd >> g;
                 if (g.empty()) { std::cout << "Usage: /delete_group <name>\n"; continue; }
-                Push(fdCmd, "DELETEGROUP " + login + " " + g + "\n");
+                SendCommand(conn, FrameType::DeleteGroup, {login, g});
                 continue;
             }
 
@@ -198,7 +436,17 @@ int main(int argc, char** argv) {
                 std::string cmd, g;
                 iss >> cmd >> g;
                 if (g.empty()) { std::cout << "Usage: /join <name>\n"; continue; }
-                Push(fdCmd, "JOINGROUP " + login + " " + g + "\n");
+                std::shared_ptr<GroupRing> ring = conn.shm ? OpenGroupRing(groupRings, g) : nullptr;
+                if (!ring) {
+                    SendCommand(conn, FrameType::JoinGroup, {login, g});
+                    continue;
+                }
+                StopGroupReader(groupRings, g);
+                auto reader = std::make_unique<GroupReader>();
+                reader->ring = ring;
+                reader->thread = std::thread(ReadGroupRing, std::ref(*reader), std::cref(login));
+                groupRings.readers[g] = std::move(reader);
+                SendCommand(conn, FrameType::JoinGroup, {login, g, "RING"});
                 continue;
             }
 
@@ -207,7 +455,18 @@ int main(int argc, char** argv) {
                 std::string cmd, g;
                 iss >> cmd >> g;
                 if (g.empty()) { std::cout << "Usage: /leave <name>\n"; continue; }
-                Push(fdCmd, "LEAVEGROUP " + login + " " + g + "\n");
+                SendCommand(conn, FrameType::LeaveGroup, {login, g});
+                StopGroupReader(groupRings, g);
+                continue;
+            }
+
+            if (line.rfind("/history ", 0) == 0) {
+                // Your own login for the messages you received.
+                std::istringstream iss(line);
+                std::string cmd, target, since = "0", limit = "20";
+                iss >> cmd >> target >> since >> limit;
+                if (target.empty()) { std::cout << "Usage: /history <login|group> [since] [limit]\n"; continue; }
+                SendCommand(conn, FrameType::History, {login, target, since, limit});
                 continue;
             }
 
@@ -223,6 +482,7 @@ int main(int argc, char** argv) {
                     std::cout << "Usage: /g <group> <text>\n";
                     continue;
                 }
+                if (conn.shm && PostToGroupRing(groupRings, conn, g, text)) continue;
 
                 std::string gfifo = GroupFifoPath(g);
                 int fdG = open(gfifo.c_str(), O_WRONLY | O_NONBLOCK);
@@ -232,7 +492,7 @@ int main(int argc, char** argv) {
                     continue;
                 }
 
-                Push(fdG, "MSG " + login + " " + text + "\n");
+                SendCommand(fdG, conn.frames, FrameType::GroupPost, {login, text});
                 close(fdG);
                 continue;
             }
@@ -241,7 +501,14 @@ int main(int argc, char** argv) {
         }
     }
 
-    Push(fdCmd, "DISCONNECT " + login + "\n");
+    SendCommand(conn, FrameType::Disconnect, {login});
+    while (!groupRings.readers.empty()) StopGroupReader(groupRings, groupRings.readers.begin()->first);
+    if (ringReader.joinable()) {
+        stopRing = true;
+        conn.shm->ToClient().ReaderWaiting().store(0);
+        FutexWake(conn.shm->ToClient().ReaderWaiting());
+        ringReader.join();
+    }
     close(fdCmd);
     close(fdIn);
     if (fdDummyW >= 0) close(fdDummyW);
@@ -0,0 +1,520 @@
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "linebuffer.hpp"
+#include "wire.hpp"
+
+// Load generator for im_server. Simulates many clients in one process,
+// speaking the same FIFO protocol as im_client: each has its own client
+// FIFO, commands go to the server's command FIFO and group posts to the
+// group FIFOs.
+//
+// Setup connects every client, creates the groups and fills them with
+// random members, waiting for the server's notice at each step. Then a
+// sender thread posts at a fixed rate (open loop) for the warmup and the
+// measured duration. Each message is a PM between two random clients or a
+// post by a random member to a random group, in the given mix. A receiver
+// thread reads every client FIFO.
+//
+// Each message carries the time it was due to be sent, not the time it
+// went out, so a sender that falls behind shows up as latency rather than
+// as fewer, faster samples. A delivery's latency is its arrival time minus
+// that stamp. Only messages due within the measured duration are counted.
+//
+// Results go to stdout (or --json FILE) as one JSON object, with a summary
+// on stderr.
+
+static const char* SERVER_CMD_FIFO = "/tmp/im_server_cmd.fifo";
+
+static volatile sig_atomic_t g_stop = 0;
+static void OnSignal(int) { g_stop = 1; }
+
+struct Options {
+    size_t clients = 1000;
+    size_t groups = 10;
+    size_t groupSize = 50;
+    double pmRatio = 0.9;
+    size_t size = 100;      // message text bytes
+    double rate = 2000;     // messages per second, PMs and posts together
+    double duration = 10;   // seconds measured
+    double warmup = 2;      // seconds sent but not measured
+    double drain = 2;       // seconds to wait for the last deliveries
+    bool binary = false;
+    std::string prefix = "load";
+    std::string json;       // file; stdout if empty
+};
+
+struct SimClient {
+    std::string login;
+    std::string fifoPath;
+    int fd = -1;
+    LineBuffer buf;
+};
+
+struct SimGroup {
+    std::string name;
+    int fd = -1;  // its FIFO, for posts
+    std::vector<size_t> members;
+};
+
+// Counters the two threads share.
+struct Totals {
+    std::atomic<uint64_t> notices{0};
+    std::atomic<uint64_t> connected{0};
+    std::atomic<uint64_t> joined{0};   // "group created" and "joined group"
+    std::atomic<uint64_t> refused{0};  // "not connected", "dropped", ...
+    std::atomic<uint64_t> closed{0};   // client FIFOs the server closed
+    uint64_t closedUnderLoad = 0;      // closed, and refused, before the cleanup
+    uint64_t refusedUnderLoad = 0;
+    std::atomic<uint64_t> sentPm{0};
+    std::atomic<uint64_t> sentPosts{0};
+    std::atomic<uint64_t> expected{0};  // deliveries due, measured window
+    std::atomic<uint64_t> sentMeasured{0};
+    std::atomic<uint64_t> behindNs{0};  // worst lag of the sender behind schedule
+};
+
+static uint64_t Seconds(double s) { return (uint64_t)(s * 1e9); }
+
+// "@<due ns> " starts every text the sender makes; the rest is padding.
+static std::string MessageText(uint64_t due, size_t size) {
+    std::string text = "@" + std::to_string(due) + " ";
+    if (text.size() < size) text.append(size - text.size(), 'x');
+    return text;
+}
+
+static bool ParseDue(std::string_view text, uint64_t& due) {
+    if (text.empty() || text[0] != '@') return false;
+    due = 0;
+    size_t i = 1;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) due = due * 10 + (uint64_t)(text[i] - '0');
+    return i > 1;
+}
+
+static bool WriteAll(int fd, const std::string& s) {
+    const char* p = s.data();
+    size_t left = s.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n > 0) {
+            p += n;
+            left -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return false;
+    }
+    return true;
+}
+
+static std::string Encode(bool binary, FrameType type, std::initializer_list<std::string_view> fields) {
+    std::string msg;
+    if (binary && AppendFrame(msg, type, fields) && msg.size() <= kMaxSharedFrame) return msg;
+    msg = TextKeyword(type);
+    for (std::string_view f : fields) {
+        msg.push_back(' ');
+        msg.append(f.data(), f.size());
+    }
+    msg.push_back('\n');
+    return msg;
+}
+
+// The receiver: reads every client FIFO, counts notices, and records the
+// latency of each delivery due in [measureFrom, measureTo).
+class Receiver {
+public:
+    Receiver(std::vector<SimClient>& clients, Totals& totals) : clients_(clients), totals_(totals) {}
+
+    bool Open() {
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_ < 0) return false;
+        for (size_t i = 0; i < clients_.size(); ++i) {
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.u64 = i;
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, clients_[i].fd, &ev) < 0) return false;
+        }
+        return true;
+    }
+
+    void SetWindow(uint64_t from, uint64_t to) {
+        measureFrom_ = from;
+        measureTo_ = to;
+    }
+
+    void Run(const std::atomic<bool>& stop) {
+        std::vector<epoll_event> events(256);
+        while (!stop) {
+            int n = epoll_wait(epoll_, events.data(), (int)events.size(), 50);
+            for (int i = 0; i < n; ++i) Drain(clients_[events[i].data.u64]);
+        }
+    }
+
+    ~Receiver() {
+        if (epoll_ >= 0) close(epoll_);
+    }
+
+    const LatencyHistogram& Latency() const { return latency_; }
+    uint64_t Delivered() const { return delivered_; }
+    uint64_t DeliveredPm() const { return deliveredPm_; }
+    uint64_t Late() const { return late_; }
+
+private:
+    void Drain(SimClient& c) {
+        while (true) {
+            ssize_t n = c.buf.ReadFrom(c.fd);
+            if (n > 0) {
+                ConsumeMessages(
+                    c.buf, [this](std::string_view line) { OnLine(line); },
+                    [this](const Frame& f) { OnFrame(f); });
+                continue;
+            }
+            if (n == 0) {
+                // The server closed its end: disconnected as a slow client.
+                epoll_ctl(epoll_, EPOLL_CTL_DEL, c.fd, nullptr);
+                totals_.closed++;
+                return;
+            }
+            if (errno == EINTR) continue;
+            return;
+        }
+    }
+
+    void OnLine(std::string_view line) {
+        static const std::string_view kServer = "SERVER: ";
+        if (line.substr(0, kServer.size()) == kServer) {
+            OnNotice(line.substr(kServer.size()));
+            return;
+        }
+        size_t at = line.find(": @");
+        if (at == std::string_view::npos) return;
+        OnMessage(line.substr(at + 2), line.substr(0, 5) == "[pm] ");
+    }
+
+    void OnFrame(const Frame& f) {
+        if (f.type == FrameType::Notice && f.fieldCount == 1) OnNotice(f.fields[0]);
+        else if (f.type == FrameType::Private && f.fieldCount == 2) OnMessage(f.fields[1], true);
+        else if (f.type == FrameType::GroupMessage && f.fieldCount == 3) OnMessage(f.fields[2], false);
+    }
+
+    void OnNotice(std::string_view text) {
+        totals_.notices++;
+        if (text.substr(0, 13) == "connected as ") totals_.connected++;
+        else if (text.substr(0, 14) == "group created " || text.substr(0, 13) == "joined group ") totals_.joined++;
+        else if (text.substr(0, 13) != "delivered to ") totals_.refused++;
+    }
+
+    void OnMessage(std::string_view text, bool pm) {
+        uint64_t due = 0;
+        if (!ParseDue(text, due) || due < measureFrom_ || due >= measureTo_) return;
+        uint64_t now = NowNs();
+        latency_.Record(now > due ? now - due : 0);
+        ++delivered_;
+        if (pm) ++deliveredPm_;
+        if (now >= measureTo_) ++late_;
+    }
+
+    std::vector<SimClient>& clients_;
+    Totals& totals_;
+    int epoll_ = -1;
+    std::atomic<uint64_t> measureFrom_{UINT64_MAX};
+    std::atomic<uint64_t> measureTo_{0};
+    LatencyHistogram latency_;
+    uint64_t delivered_ = 0;
+    uint64_t deliveredPm_ = 0;
+    uint64_t late_ = 0;  // arrived after the window closed
+};
+
+// Sleeps until the counter reaches want; false on timeout or a stop signal.
+static bool WaitFor(const std::atomic<uint64_t>& counter, uint64_t want, double seconds) {
+    uint64_t deadline = NowNs() + Seconds(seconds);
+    while (counter < want) {
+        if (g_stop || NowNs() > deadline) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+static void SleepUntil(uint64_t t) {
+    timespec ts;
+    ts.tv_sec = (time_t)(t / 1000000000ull);
+    ts.tv_nsec = (long)(t % 1000000000ull);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+// The open-loop sender, from start until end: message k is due at
+// start + k / rate.
+static void Send(const Options& opt,
+                 int fdCmd,
+                 const std::vector<SimClient>& clients,
+                 const std::vector<SimGroup>& groups,
+                 uint64_t start,
+                 uint64_t measureFrom,
+                 uint64_t end,
+                 Totals& totals)
+{
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    double interval = 1e9 / opt.rate;
+    for (uint64_t k = 0; !g_stop; ++k) {
+        uint64_t due = start + (uint64_t)(k * interval);
+        if (due >= end) break;
+        uint64_t now = NowNs();
+        if (now < due) SleepUntil(due);
+        else totals.behindNs = std::max<uint64_t>(totals.behindNs, now - due);
+
+        bool measured = due >= measureFrom;
+        std::string text = MessageText(due, opt.size);
+        if (groups.empty() || coin(rng) < opt.pmRatio) {
+            size_t from = rng() % clients.size();
+            size_t to = (from + 1 + rng() % (clients.size() - 1)) % clients.size();
+            WriteAll(fdCmd, Encode(opt.binary, FrameType::Send, {clients[from].login, clients[to].login, text}));
+            totals.sentPm++;
+            if (measured) totals.expected++;
+        } else {
+            const SimGroup& g = groups[rng() % groups.size()];
+            size_t from = g.members[rng() % g.members.size()];
+            WriteAll(g.fd, Encode(opt.binary, FrameType::GroupPost, {clients[from].login, text}));
+            totals.sentPosts++;
+            if (measured) totals.expected += g.members.size();
+        }
+        if (measured) totals.sentMeasured++;
+    }
+}
+
+static void PrintJson(std::ostream& out,
+                      const Options& opt,
+                      const Totals& totals,
+                      const Receiver& receiver,
+                      bool setupOk)
+{
+    const LatencyHistogram& h = receiver.Latency();
+    auto us = [](uint64_t ns) { return ns / 1e3; };
+    char buf[1024];
+    out << "{\"config\": {\"clients\": " << opt.clients << ", \"groups\": " << opt.groups
+        << ", \"group_size\": " << opt.groupSize << ", \"pm_ratio\": " << opt.pmRatio << ", \"size\": " << opt.size
+        << ", \"rate\": " << opt.rate << ", \"duration\": " << opt.duration << ", \"warmup\": " << opt.warmup
+        << ", \"protocol\": \"" << (opt.binary ? "binary" : "text") << "\"},\n";
+    std::snprintf(buf, sizeof(buf),
+                  " \"setup_ok\": %s, \"sent\": %llu, \"sent_pm\": %llu, \"sent_group\": %llu,"
+                  " \"sent_measured\": %llu, \"sent_per_sec\": %.1f, \"sender_max_behind_us\": %.1f,\n"
+                  " \"expected_deliveries\": %llu, \"deliveries\": %llu, \"deliveries_pm\": %llu,"
+                  " \"lost\": %llu, \"late\": %llu, \"deliveries_per_sec\": %.1f,\n"
+                  " \"refused_notices\": %llu, \"clients_closed\": %llu,\n",
+                  setupOk ? "true" : "false",
+                  (unsigned long long)(totals.sentPm + totals.sentPosts), (unsigned long long)totals.sentPm.load(),
+                  (unsigned long long)totals.sentPosts.load(), (unsigned long long)totals.sentMeasured.load(),
+                  totals.sentMeasured / opt.duration, us(totals.behindNs),
+                  (unsigned long long)totals.expected.load(), (unsigned long long)receiver.Delivered(),
+                  (unsigned long long)receiver.DeliveredPm(),
+                  (unsigned long long)(totals.expected > receiver.Delivered() ? totals.expected - receiver.Delivered()
+                                                                              : 0),
+                  (unsigned long long)receiver.Late(), receiver.Delivered() / opt.duration,
+                  (unsigned long long)totals.refusedUnderLoad, (unsigned long long)totals.closedUnderLoad);
+    out << buf;
+    std::snprintf(buf, sizeof(buf),
+                  " \"latency_us\": {\"count\": %llu, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f,"
+                  " \"p999\": %.1f, \"max\": %.1f}}\n",
+                  (unsigned long long)h.Count(), h.Mean() / 1e3, us(h.Percentile(50)), us(h.Percentile(90)),
+                  us(h.Percentile(99)), us(h.Percentile(99.9)), us(h.Max()));
+    out << buf;
+}
+
+static void Usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--clients N] [--groups N] [--group-size N] [--pm-ratio F] [--size BYTES]"
+                 " [--rate MSGS/S] [--duration S] [--warmup S] [--drain S] [--binary] [--prefix P]"
+                 " [--json FILE]\n";
+}
+
+// im_load [options]
+//   --clients     simulated clients (default 1000)
+//   --groups      groups, each created by one of its members (default 10)
+//   --group-size  members per group, the creator included (default 50)
+//   --pm-ratio    share of messages that are PMs; the rest are group posts
+//                 (default 0.9)
+//   --size        message text bytes, timestamp included (default 100)
+//   --rate        messages sent per second (default 2000)
+//   --duration    seconds measured, after the warmup (default 10)
+//   --warmup      seconds of load before measuring (default 2)
+//   --drain       seconds to wait for deliveries after sending (default 2)
+//   --binary      speak frames instead of text lines
+//   --prefix      login and group name prefix (default "load")
+//   --json        write the results there instead of stdout
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--binary") opt.binary = true;
+        else if (arg == "--clients" && hasValue) opt.clients = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--groups" && hasValue) opt.groups = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--group-size" && hasValue) opt.groupSize = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--pm-ratio" && hasValue) opt.pmRatio = std::strtod(argv[++i], nullptr);
+        else if (arg == "--size" && hasValue) opt.size = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--rate" && hasValue) opt.rate = std::strtod(argv[++i], nullptr);
+        else if (arg == "--duration" && hasValue) opt.duration = std::strtod(argv[++i], nullptr);
+        else if (arg == "--warmup" && hasValue) opt.warmup = std::strtod(argv[++i], nullptr);
+        else if (arg == "--drain" && hasValue) opt.drain = std::strtod(argv[++i], nullptr);
+        else if (arg == "--prefix" && hasValue) opt.prefix = argv[++i];
+        else if (arg == "--json" && hasValue) opt.json = argv[++i];
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.clients < 2 || opt.rate <= 0 || opt.duration <= 0 || opt.warmup < 0 || opt.drain < 0 ||
+        opt.pmRatio < 0 || opt.pmRatio > 1 || opt.size > 3000 || (opt.groups > 0 && opt.groupSize == 0) ||
+        opt.groupSize > opt.clients) {
+        Usage(argv[0]);
+        return 2;
+    }
+    if (opt.pmRatio == 1) opt.groups = 0;
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int fdCmd = open(SERVER_CMD_FIFO, O_WRONLY | O_NONBLOCK);
+    if (fdCmd < 0) {
+        std::perror(("open(" + std::string(SERVER_CMD_FIFO) + "), server not running?").c_str());
+        return 1;
+    }
+    // Blocking from here on: a full command FIFO holds the sender back.
+    fcntl(fdCmd, F_SETFL, fcntl(fdCmd, F_GETFL) & ~O_NONBLOCK);
+
+    // Each client FIFO exists and has a reader before CONNECT, as the
+    // server opens it without blocking.
+    std::vector<SimClient> clients(opt.clients);
+    for (size_t i = 0; i < clients.size(); ++i) {
+        SimClient& c = clients[i];
+        c.login = opt.prefix + std::to_string(i);
+        c.fifoPath = "/tmp/im_client_" + c.login + ".fifo";
+        unlink(c.fifoPath.c_str());
+        if (mkfifo(c.fifoPath.c_str(), 0666) < 0 ||
+            (c.fd = open(c.fifoPath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0) {
+            std::perror(("client fifo " + c.fifoPath).c_str());
+            return 1;
+        }
+    }
+
+    Totals totals;
+    Receiver receiver(clients, totals);
+    if (!receiver.Open()) {
+        std::perror("epoll");
+        return 1;
+    }
+    std::atomic<bool> stopReceiver{false};
+    std::thread receiverThread([&] { receiver.Run(stopReceiver); });
+
+    auto cleanup = [&] {
+        for (SimClient& c : clients) WriteAll(fdCmd, Encode(opt.binary, FrameType::Disconnect, {c.login}));
+        usleep(200000);
+        stopReceiver = true;
+        receiverThread.join();
+        for (SimClient& c : clients) {
+            if (c.fd >= 0) close(c.fd);
+            unlink(c.fifoPath.c_str());
+        }
+        close(fdCmd);
+    };
+
+    bool setupOk = true;
+    for (SimClient& c : clients)
+        WriteAll(fdCmd, "CONNECT " + c.login + (opt.binary ? " BINARY\n" : "\n"));
+    if (!WaitFor(totals.connected, clients.size(), 10)) {
+        std::cerr << "only " << totals.connected << " of " << clients.size() << " clients connected\n";
+        setupOk = false;
+    }
+
+    std::mt19937_64 rng(7);
+    std::vector<SimGroup> groups(setupOk ? opt.groups : 0);
+    for (size_t j = 0; j < groups.size(); ++j) {
+        SimGroup& g = groups[j];
+        g.name = opt.prefix + "_g" + std::to_string(j);
+        std::vector<size_t> pool(clients.size());
+        for (size_t i = 0; i < pool.size(); ++i) pool[i] = i;
+        for (size_t m = 0; m < opt.groupSize; ++m) {
+            std::swap(pool[m], pool[m + rng() % (pool.size() - m)]);
+            g.members.push_back(pool[m]);
+        }
+        WriteAll(fdCmd, Encode(opt.binary, FrameType::CreateGroup, {clients[g.members[0]].login, g.name}));
+        if (!WaitFor(totals.joined, j * opt.groupSize + 1, 5)) {
+            std::cerr << "group " << g.name << " was not created\n";
+            setupOk = false;
+            groups.resize(j);
+            break;
+        }
+        for (size_t m = 1; m < g.members.size(); ++m)
+            WriteAll(fdCmd, Encode(opt.binary, FrameType::JoinGroup, {clients[g.members[m]].login, g.name}));
+        if (!WaitFor(totals.joined, (j + 1) * opt.groupSize, 10)) {
+            std::cerr << "only " << totals.joined - j * opt.groupSize << " of " << opt.groupSize
+                      << " members joined " << g.name << "\n";
+            setupOk = false;
+            groups.resize(j);
+            break;
+        }
+        g.fd = open(("/tmp/im_group_" + g.name + ".fifo").c_str(), O_WRONLY | O_CLOEXEC);
+        if (g.fd < 0) {
+            std::perror(("open group fifo " + g.name).c_str());
+            setupOk = false;
+            groups.resize(j);
+            break;
+        }
+    }
+    if (setupOk) {
+        uint64_t start = NowNs() + Seconds(0.1);
+        uint64_t measureFrom = start + Seconds(opt.warmup);
+        uint64_t end = measureFrom + Seconds(opt.duration);
+        receiver.SetWindow(measureFrom, end);
+        std::cerr << "im_load: " << clients.size() << " clients, " << groups.size() << " groups of "
+                  << opt.groupSize << ", " << opt.rate << " msgs/s for " << opt.warmup << "+" << opt.duration
+                  << " s\n";
+        Send(opt, fdCmd, clients, groups, start, measureFrom, end, totals);
+        uint64_t drainUntil = NowNs() + Seconds(opt.drain);
+        while (!g_stop && NowNs() < drainUntil) usleep(10000);
+    }
+
+    totals.closedUnderLoad = totals.closed;
+    totals.refusedUnderLoad = totals.refused;
+    for (SimGroup& g : groups) {
+        if (g.fd < 0) continue;
+        close(g.fd);
+        WriteAll(fdCmd, Encode(opt.binary, FrameType::DeleteGroup, {clients[g.members[0]].login, g.name}));
+    }
+    cleanup();
+
+    const LatencyHistogram& h = receiver.Latency();
+    std::cerr << "im_load: " << receiver.Delivered() << " of " << totals.expected << " deliveries, p50 "
+              << h.Percentile(50) / 1e3 << " us, p99 " << h.Percentile(99) / 1e3 << " us, p99.9 "
+              << h.Percentile(99.9) / 1e3 << " us\n";
+    if (opt.json.empty()) {
+        PrintJson(std::cout, opt, totals, receiver, setupOk);
+    } else {
+        std::ofstream out(opt.json);
+        PrintJson(out, opt, totals, receiver, setupOk);
+        if (!out) {
+            std::perror(("write " + opt.json).c_str());
+            return 1;
+        }
+    }
+    return setupOk ? 0 : 1;
+}
@@ -1,30 +1,48 @@
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/poll.h>
+#include <sys/signalfd.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <memory>
 #include <string>
-#include <vector>
+#include <string_view>
 #include <iostream>
-#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
-static const char* SERVER_CMD_FIFO = "/tmp/im_server_cmd.fifo";
+#include "mpsc_queue.hpp"
+#include "outbox.hpp"
+#include "reactor.hpp"
+#include "group_ring.hpp"
+#include "message_store.hpp"
+#include "registry.hpp"
+#include "shm_channel.hpp"
+#include "trace.hpp"
+#include "wire.hpp"
 
-static volatile sig_atomic_t g_stop = 0;
-static void on_sigint(int) { g_stop = 1; }
+static const char* SERVER_CMD_FIFO = "/tmp/im_server_cmd.fifo";
 
 static void Log(const std::string& msg) {
     std::time_t t = std::time(nullptr);
+    std::tm tm;
+    localtime_r(&t, &tm);
     char timebuf[64];
-    std::strftime(timebuf, sizeof(timebuf), "%F %T", std::localtime(&t));
-    std::cerr << "[" << timebuf << "] " << msg << "\n";
+    std::strftime(timebuf, sizeof(timebuf), "%F %T", &tm);
+    // One write per line, so lines logged by different shards do not mix.
+    std::cerr << ("[" + std::string(timebuf) + "] " + msg + "\n");
 }
 
 static bool CreateQueue(const std::string& path) {
@@ -46,337 +64,787 @@ static bool DeleteQueue(const std::string& path) {
     return false;
 }
 
-static bool Push(int fd, const std::string& s) {
+static std::string ClientFifoPath(std::string_view login) {
+    return "/tmp/im_client_" + std::string(login) + ".fifo";
+}
+static std::string GroupFifoPath(std::string_view group) {
+    return "/tmp/im_group_" + std::string(group) + ".fifo";
+}
 
-    const char* p = s.c_str();
-    size_t left = s.size();
+// A client is flushed before the handler is done once this much is queued
+// for it, so one busy handler does not run its outbox up to the watermark.
+static const size_t kFlushBatchBytes = 16 << 10;
+
+// Most stored messages one HISTORY answers with.
+static const size_t kMaxHistory = 1000;
+// Queued messages DeliverQueued takes from the store at a time.
+static const size_t kQueuedBatch = 256;
+
+// Work one shard hands another when the server is sharded. Everything is
+// copied except logins, which are views of the sender's interned names and
+// stay valid for the life of the server.
+struct ShardMessage {
+    enum class Kind {
+        Command,   // type, binary, args: a command from the command FIFO
+        Notice,    // args: login, text
+        Group,     // textMsg or frameMsg, as each client takes, to logins
+        LeaveAll,  // args: login, to drop from this shard's groups
+        History,   // args: HISTORY's, for a group its shard found login in
+        Stop,
+    };
+    Kind kind = Kind::Stop;
+    FrameType type = FrameType::Notice;
+    bool binary = false;
+    int argCount = 0;
+    std::string args[kMaxFields];
+    Payload textMsg;
+    Payload frameMsg;
+    std::vector<std::string_view> logins;
+};
 
-    while (left > 0) {
-        ssize_t n = write(fd, p, left);
-        if (n > 0) {
-            p += n;
-            left -= (size_t)n;
-            continue;
-        }
-        if (n < 0 && errno == EINTR) continue;
-        return false;
-    }
-    return true;
+struct Server {
+    Registry reg;
+    std::unique_ptr<Reactor> reactor;
+    OutboxLimits limits;
+    // Slow clients to disconnect once the current handler is done, so that
+    // a broadcast never sees its member list change under it.
+    std::vector<NameId> evicted;
+    // Clients with messages queued by the current handler. Flushed once it
+    // is done, so a client that got many messages gets one writev.
+    std::vector<NameId> unflushed;
+
+    // Sharded mode (--threads N): each client and group lives on the shard
+    // its name hashes to, and each shard runs its own reactor on its own
+    // thread. peers holds every shard, this one included; it is empty when
+    // the server is not sharded.
+    size_t shard = 0;
+    std::vector<Server*> peers;
+    Inbox<ShardMessage> inbox;
+    std::vector<uint32_t> loginShard;                    // by login id; kUnknownShard until hashed
+    std::vector<std::vector<std::string_view>> remote;   // BroadcastToGroup scratch, by shard
+    bool stopping = false;
+
+    MessageStore* store = nullptr;  // --store; one for every shard
+    std::string storeFrame;         // StoreMessage scratch
+};
+
+static const uint32_t kUnknownShard = UINT32_MAX;
+
+static size_t ShardOf(size_t shards, std::string_view name) {
+    return std::hash<std::string_view>()(name) % shards;
 }
 
-static std::string ClientFifoPath(const std::string& login) {
-    return "/tmp/im_client_" + login + ".fifo";
+// The shard that owns a login or group name.
+static size_t OwnerOf(const Server& srv, std::string_view name) {
+    return srv.peers.empty() ? srv.shard : ShardOf(srv.peers.size(), name);
 }
-static std::string GroupFifoPath(const std::string& group) {
-    return "/tmp/im_group_" + group + ".fifo";
+
+// OwnerOf for a login this shard has interned, hashed once per login.
+static size_t OwnerOf(Server& srv, NameId login) {
+    if (srv.peers.empty()) return srv.shard;
+    if (login >= srv.loginShard.size()) srv.loginShard.resize(login + 1, kUnknownShard);
+    if (srv.loginShard[login] == kUnknownShard)
+        srv.loginShard[login] = (uint32_t)ShardOf(srv.peers.size(), srv.reg.LoginName(login));
+    return srv.loginShard[login];
 }
 
-struct Client {
-    std::string login;       
+static void PostLeaveAll(Server& srv, std::string_view login) {
+    for (Server* peer : srv.peers) {
+        if (peer == &srv) continue;
+        ShardMessage msg;
+        msg.kind = ShardMessage::Kind::LeaveAll;
+        msg.argCount = 1;
+        msg.args[0] = std::string(login);
+        peer->inbox.Post(std::move(msg));
+    }
+}
 
-    std::string fifoPath;    
+static void StopWatchingWrite(Server& srv, Client& c) {
+    if (!c.watchingWrite) return;
+    srv.reactor->Remove(c.fdWrite);
+    c.watchingWrite = false;
+}
 
-    int fdWrite;             
+static void CloseClientFifo(Server& srv, Client& c) {
+    if (c.fdWrite < 0) return;
+    StopWatchingWrite(srv, c);
+    close(c.fdWrite);
+    c.fdWrite = -1;
+    c.out.Clear();
+}
 
-};
+static void DeliverQueued(Server& srv, Client& c);
 
-struct Group {
-    std::string name;              
+// Copies what the ring takes now and wakes the client if it sleeps on an
+// empty ring. When the ring is full the rest waits for the Ring doorbell
+// the client sends after reading.
+static void FlushClientRing(Server& srv, Client& c) {
+    ByteRing& ring = c.shm->ToClient();
+    while (true) {
+        Outbox::FlushResult result = c.out.Flush(ring, srv.limits);
+        if (ring.TakeReaderWake()) FutexWake(ring.ReaderWaiting());
+        if (result == Outbox::FlushResult::Drained) {
+            c.watchingWrite = false;
+            if (c.backlog) DeliverQueued(srv, c);
+            return;
+        }
+        if (ring.WriterSleep()) {
+            c.watchingWrite = true;
+            return;
+        }
+    }
+}
 
-    std::string fifoPath;          
+// Writes what the FIFO takes now; the rest waits for writability.
+static void FlushClient(Server& srv, Client& c) {
+    if (c.shm) {
+        FlushClientRing(srv, c);
+        return;
+    }
+    switch (c.out.Flush(c.fdWrite, srv.limits)) {
+    case Outbox::FlushResult::Drained:
+        StopWatchingWrite(srv, c);
+        if (c.backlog) DeliverQueued(srv, c);
+        break;
+    case Outbox::FlushResult::Blocked:
+        if (!c.watchingWrite) {
+            NameId id = c.id;
+            c.watchingWrite = srv.reactor->AddWritable(c.fdWrite, [&srv, id] {
+                if (Client* client = srv.reg.FindClient(id)) FlushClient(srv, *client);
+            });
+        }
+        break;
+    case Outbox::FlushResult::Error:
+        // Reader gone; reopened on the next message.
+        CloseClientFifo(srv, c);
+        break;
+    }
+}
 
-    int fdRead;                    
+static void Evict(Server& srv, Client& c) {
+    Log("EVICT " + c.login + ": " + std::to_string(c.out.Bytes()) + " bytes queued");
+    c.evicted = true;
+    srv.evicted.push_back(c.id);
+}
 
-    int fdDummyWrite;              
+static void FlushQueued(Server& srv) {
+    // By index: a flush that feeds DeliverQueued adds to unflushed.
+    for (size_t i = 0; i < srv.unflushed.size(); ++i) {
+        Client* c = srv.reg.FindClient(srv.unflushed[i]);
+        if (!c || !c->flushQueued) continue;
+        c->flushQueued = false;
+        if (!c->evicted && !c->watchingWrite && (c->fdWrite >= 0 || c->shm)) FlushClient(srv, *c);
+    }
+    srv.unflushed.clear();
+}
 
-    std::vector<std::string> members; 
+static void DisconnectEvicted(Server& srv) {
+    for (NameId id : srv.evicted) {
+        Client* c = srv.reg.FindClient(id);
+        if (!c || !c->evicted) continue;
+        CloseClientFifo(srv, *c);
+        std::string login = c->login;
+        srv.reg.RemoveClient(id);
+        srv.reg.LeaveAllGroups(login);
+        PostLeaveAll(srv, login);
+    }
+    srv.evicted.clear();
+}
 
-    std::string readBuf;           
+// msg is a text line ending in '\n' or a frame, as the client negotiated.
+// false if the message was dropped.
+static bool SendToClient(Server& srv, Client& c, const Payload& msg) {
+    if (c.evicted || !msg) return false;
 
-};
+    if (!c.shm && c.fdWrite < 0) {
+        c.fdWrite = open(c.fifoPath.c_str(), O_WRONLY | O_NONBLOCK);
+        if (c.fdWrite < 0) {
 
-static int FindClientIndex(const std::vector<Client>& clients, const std::string& login) {
-    for (int i = 0; i < (int)clients.size(); ++i) {
-        if (clients[i].login == login) return i;
+            return false;
+        }
     }
-    return -1;
-}
 
-static int FindGroupIndex(const std::vector<Group>& groups, const std::string& name) {
-    for (int i = 0; i < (int)groups.size(); ++i) {
-        if (groups[i].name == name) return i;
+    if (!c.out.Push(msg, srv.limits)) {
+        if (srv.limits.policy == SlowClientPolicy::Disconnect) Evict(srv, c);
+        return false;
     }
-    return -1;
+    if (c.watchingWrite) return true;
+    if (c.out.Bytes() >= kFlushBatchBytes) {
+        FlushClient(srv, c);
+    } else if (!c.flushQueued) {
+        c.flushQueued = true;
+        srv.unflushed.push_back(c.id);
+    }
+    return true;
 }
 
-static bool IsMember(const Group& g, const std::string& login) {
-    for (const auto& m : g.members) {
-        if (m == login) return true;
-    }
-    return false;
+static std::string Cat(std::initializer_list<std::string_view> parts) {
+    size_t size = 0;
+    for (std::string_view p : parts) size += p.size();
+    std::string s;
+    s.reserve(size + 1);
+    for (std::string_view p : parts) s.append(p.data(), p.size());
+    return s;
 }
 
-static void SendToClient(std::vector<Client>& clients,
-                         const std::string& login,
-                         std::string msgLine)
-{
-    int idx = FindClientIndex(clients, login);
-    if (idx < 0) return; 
+static Payload TextPayload(std::initializer_list<std::string_view> parts) {
+    std::string line = Cat(parts);
+    line.push_back('\n');
+    return MakePayload(std::move(line));
+}
 
-    if (msgLine.empty() || msgLine.back() != '\n') msgLine.push_back('\n');
+// nullptr if the fields do not fit a frame.
+static Payload FramePayload(FrameType type, std::initializer_list<std::string_view> fields) {
+    std::string frame;
+    if (!AppendFrame(frame, type, fields)) return nullptr;
+    return MakePayload(std::move(frame));
+}
 
-    Client& c = clients[idx];
+static void Notify(Server& srv, Client& c, std::string_view text) {
+    SendToClient(srv, c, c.binary ? FramePayload(FrameType::Notice, {text}) : TextPayload({"SERVER: ", text}));
+}
 
-    if (c.fdWrite < 0) {
-        c.fdWrite = open(c.fifoPath.c_str(), O_WRONLY | O_NONBLOCK);
-        if (c.fdWrite < 0) {
+static void Notify(Server& srv, std::string_view login, std::string_view text) {
+    size_t owner = OwnerOf(srv, login);
+    if (owner != srv.shard) {
+        ShardMessage msg;
+        msg.kind = ShardMessage::Kind::Notice;
+        msg.argCount = 2;
+        msg.args[0] = std::string(login);
+        msg.args[1] = std::string(text);
+        srv.peers[owner]->inbox.Post(std::move(msg));
+        return;
+    }
+    Client* c = srv.reg.FindClient(login);
+    if (c) Notify(srv, *c, text);
+}
 
-            return;
+static bool SendPrivate(Server& srv, Client& to, std::string_view from, std::string_view text) {
+    return SendToClient(srv, to, to.binary ? FramePayload(FrameType::Private, {from, text})
+                                           : TextPayload({"[pm] ", from, ": ", text}));
+}
+
+// Logs a message to the store, if there is one, as the frame a binary
+// client gets. false if it was not stored.
+static bool StoreMessage(Server& srv,
+                         MessageStore::Kind kind,
+                         std::string_view target,
+                         FrameType type,
+                         std::initializer_list<std::string_view> fields)
+{
+    if (!srv.store) return false;
+    srv.storeFrame.clear();
+    return AppendFrame(srv.storeFrame, type, fields) && srv.store->Append(kind, target, srv.storeFrame) != 0;
+}
+
+// Private messages stored for c while it was not connected. They go to
+// its outbox only while it is under lowWater, so none is refused, and
+// only those it took are marked delivered; FlushClient calls again for
+// the rest each time the outbox drains.
+static void DeliverQueued(Server& srv, Client& c) {
+    if (!srv.store || !c.backlog) return;
+    c.backlog = false;  // the flushes SendPrivate may do must not call back in
+    size_t sent = 0;
+    bool full = false;
+    while (!full) {
+        std::vector<MessageStore::Entry> queued = srv.store->Queued(c.login, kQueuedBatch);
+        if (queued.empty()) break;
+        uint64_t last = 0;
+        for (const MessageStore::Entry& e : queued) {
+            if (c.evicted || c.out.Bytes() >= srv.limits.lowWater) {
+                full = true;
+                break;
+            }
+            Frame msg;
+            size_t size = 0;
+            if (DecodeFrame(e.frame, msg, size) == FrameDecode::Ok && msg.fieldCount >= 2) {
+                if (!SendPrivate(srv, c, msg.fields[0], msg.fields[1])) {
+                    full = true;
+                    break;
+                }
+                ++sent;
+            }
+            last = e.seq;
         }
+        if (last != 0) srv.store->MarkDelivered(c.login, last);
     }
+    c.backlog = full && !c.evicted;
+    if (sent > 0)
+        Log(Cat({"DELIVER ", c.login, ": ", std::to_string(sent), " queued", c.backlog ? ", more to come" : ""}));
+}
 
-    if (!Push(c.fdWrite, msgLine)) {
+static std::string FormatTime(int64_t ms) {
+    time_t t = (time_t)(ms / 1000);
+    tm local;
+    localtime_r(&t, &local);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &local);
+    return buf;
+}
 
-        close(c.fdWrite);
-        c.fdWrite = -1;
+// A stored message as a HistoryEntry frame, which carries the stored frame
+// as is, or as "[history #<seq> <time>] " and the line a text client gets.
+static bool SendHistoryEntry(Server& srv, Client& c, const MessageStore::Entry& e) {
+    std::string seq = std::to_string(e.seq);
+    if (c.binary) {
+        Payload frame = FramePayload(FrameType::HistoryEntry, {seq, std::to_string(e.time), e.frame});
+        if (frame) return SendToClient(srv, c, frame);
     }
+    Frame msg;
+    size_t size = 0;
+    if (DecodeFrame(e.frame, msg, size) != FrameDecode::Ok) return false;
+    std::string prefix = Cat({"[history #", seq, " ", FormatTime(e.time), "] "});
+    if (msg.type == FrameType::Private && msg.fieldCount == 2)
+        return SendToClient(srv, c, TextPayload({prefix, "[pm] ", msg.fields[0], ": ", msg.fields[1]}));
+    if (msg.type == FrameType::GroupMessage && msg.fieldCount == 3)
+        return SendToClient(
+            srv, c, TextPayload({prefix, "[group:", msg.fields[0], "] ", msg.fields[1], ": ", msg.fields[2]}));
+    return false;
 }
 
-static void BroadcastToGroup(std::vector<Client>& clients,
+// Each form of the message is built at most once and shared by all the
+// members that take it. Members on other shards get one Group message per
+// shard, carrying both forms. Members with a slot in the group ring read
+// it there and are skipped.
+static void BroadcastToGroup(Server& srv,
                              const Group& g,
-                             const std::string& from,
-                             const std::string& text)
+                             std::string_view from,
+                             std::string_view text)
 {
-    for (const auto& member : g.members) {
-        SendToClient(clients, member,
-            "[group:" + g.name + "] " + from + ": " + text);
+    Payload textMsg;
+    Payload frameMsg;
+    bool frameBuilt = false;
+    auto textForm = [&]() -> const Payload& {
+        if (!textMsg) textMsg = TextPayload({"[group:", g.name, "] ", from, ": ", text});
+        return textMsg;
+    };
+    auto frameForm = [&]() -> const Payload& {
+        if (!frameBuilt) {
+            frameMsg = FramePayload(FrameType::GroupMessage, {g.name, from, text});
+            frameBuilt = true;
+        }
+        return frameMsg;
+    };
+
+    srv.remote.resize(srv.peers.size());
+    for (size_t i = 0; i < g.members.size(); ++i) {
+        if (g.readerSlots[i] != GroupRing::kNoSlot) continue;
+        NameId member = g.members[i];
+        size_t owner = OwnerOf(srv, member);
+        if (owner != srv.shard) {
+            srv.remote[owner].push_back(srv.reg.LoginName(member));
+            continue;
+        }
+        Client* c = srv.reg.FindClient(member);
+        if (!c) continue;
+        SendToClient(srv, *c, c->binary ? frameForm() : textForm());
     }
-}
 
-static void RemoveClientFromAllGroups(std::vector<Group>& groups, const std::string& login) {
-    for (auto& g : groups) {
-        std::vector<std::string> newList;
-        for (auto& m : g.members) {
-            if (m != login) newList.push_back(m);
-        }
-        g.members = std::move(newList);
+    for (size_t shard = 0; shard < srv.remote.size(); ++shard) {
+        if (srv.remote[shard].empty()) continue;
+        ShardMessage msg;
+        msg.kind = ShardMessage::Kind::Group;
+        msg.textMsg = textForm();
+        msg.frameMsg = frameForm();
+        msg.logins = std::move(srv.remote[shard]);
+        srv.remote[shard].clear();
+        srv.peers[shard]->inbox.Post(std::move(msg));
     }
 }
 
-static void HandleCommand(const std::string& rawLine,
-                          std::vector<Client>& clients,
-                          std::vector<Group>& groups)
+static void HandleGroupReadable(Group& g, Server& srv);
+
+// The handler keeps the group id rather than a pointer and looks the group
+// up on each wakeup.
+static bool WatchGroup(Server& srv, const Group& g) {
+    NameId id = g.id;
+    return srv.reactor->Add(g.fdRead, [&srv, id] {
+        if (Group* group = srv.reg.FindGroup(id)) HandleGroupReadable(*group, srv);
+    });
+}
+
+// Answers HISTORY for a login on this shard. A group target must have
+// been checked by the group's shard already.
+static void SendHistory(Server& srv,
+                        std::string_view from,
+                        std::string_view target,
+                        std::string_view sinceText,
+                        std::string_view limitText)
 {
+    Client* c = srv.reg.FindClient(from);
+    if (!c) return;
+
+    char* end = nullptr;
+    std::string since(sinceText), limitStr(limitText);
+    uint64_t after = std::strtoull(since.c_str(), &end, 10);
+    bool ok = !since.empty() && *end == '\0';
+    size_t limit = std::strtoull(limitStr.c_str(), &end, 10);
+    ok = ok && !limitStr.empty() && *end == '\0' && limit > 0;
+    if (!ok) {
+        Notify(srv, *c, "usage: HISTORY <login> <target> <since> <limit>");
+        return;
+    }
+    limit = std::min(limit, kMaxHistory);
+
+    // One more than asked, to tell whether there is more.
+    std::vector<MessageStore::Entry> entries = target == from ? srv.store->Inbox(from, after, limit + 1)
+                                                              : srv.store->GroupHistory(target, after, limit + 1);
+    bool more = entries.size() > limit;
+    if (more) entries.pop_back();
+    for (const MessageStore::Entry& e : entries) SendHistoryEntry(srv, *c, e);
+
+    Log(Cat({"HISTORY ", from, " '", target, "' since ", since, ": ", std::to_string(entries.size())}));
+    std::string summary = Cat({"history '", target, "': ", std::to_string(entries.size()), " messages"});
+    if (more) summary += Cat({", more after ", std::to_string(entries.back().seq)});
+    Notify(srv, *c, summary);
+}
 
-    std::string line = rawLine;
-    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
-        line.pop_back();
-    if (line.empty()) return;
+static void SendStats(Server& srv, std::string_view to) {
+    for (auto& [id, c] : srv.reg.Clients()) {
+        Notify(srv, to,
+               "stats " + c.login +
+               " queued_bytes=" + std::to_string(c.out.Bytes()) +
+               " queued_msgs=" + std::to_string(c.out.Messages()) +
+               " peak_bytes=" + std::to_string(c.out.PeakBytes()) +
+               " sent=" + std::to_string(c.out.Sent()) +
+               " dropped=" + std::to_string(c.out.Dropped()) +
+               " throttled=" + (c.out.Throttled() ? "1" : "0"));
+    }
+}
 
-    std::istringstream iss(line);
-    std::string cmd;
-    iss >> cmd;
+// cmd comes from a text line or a frame; both carry the same fields.
+static void HandleCommand(const Frame& cmd, Server& srv) {
+    Registry& reg = srv.reg;
+    auto arg = [&cmd](int i) { return i < cmd.fieldCount ? cmd.fields[i] : std::string_view(); };
 
-    if (cmd == "CONNECT") {
-        std::string login; iss >> login;
+    switch (cmd.type) {
+    case FrameType::Connect: {
+        std::string_view login = arg(0);
         if (login.empty()) return;
 
-        if (FindClientIndex(clients, login) >= 0) {
-            SendToClient(clients, login, "SERVER: already connected");
+        if (Client* existing = reg.FindClient(login)) {
+            Notify(srv, *existing, "already connected");
             return;
         }
 
-        Client c;
-        c.login = login;
+        Client& c = reg.AddClient(login);
         c.fifoPath = ClientFifoPath(login);
-        c.fdWrite = -1;
+        c.binary = cmd.binary || arg(1) == "BINARY";
 
         CreateQueue(c.fifoPath);
 
-        clients.push_back(c);
+        if (!arg(2).empty()) {
+            c.shm = ShmChannel::Attach(arg(2));
+            if (!c.shm) Log(Cat({"SHM ", login, ": cannot map '", arg(2), "', using the FIFO"}));
+        }
 
-        Log("CONNECT " + login);
-        SendToClient(clients, login, "SERVER: connected as '" + login + "'");
+        Log(Cat({"CONNECT ", login, c.binary ? " (binary)" : "", c.shm ? " (shm)" : ""}));
+        Notify(srv, c, Cat({"connected as '", login, "'"}));
+        if (size_t queued = srv.store ? srv.store->QueuedCount(login) : 0) {
+            Notify(srv, c, Cat({std::to_string(queued), " messages while you were away"}));
+            c.backlog = true;
+            DeliverQueued(srv, c);
+        }
         return;
     }
 
-    if (cmd == "DISCONNECT") {
-        std::string login; iss >> login;
+    case FrameType::Disconnect: {
+        std::string_view login = arg(0);
         if (login.empty()) return;
 
-        int idx = FindClientIndex(clients, login);
-        if (idx >= 0) {
-            Log("DISCONNECT " + login);
-            if (clients[idx].fdWrite >= 0) close(clients[idx].fdWrite);
-
-            clients[idx] = clients.back();
-            clients.pop_back();
+        if (Client* c = reg.FindClient(login)) {
+            Log(Cat({"DISCONNECT ", login}));
+            CloseClientFifo(srv, *c);
+            reg.RemoveClient(c->id);
         }
 
-        RemoveClientFromAllGroups(groups, login);
+        reg.LeaveAllGroups(login);
         return;
     }
 
-    if (cmd == "SEND") {
-        std::string from, to;
-        iss >> from >> to;
-
-        std::string text;
-        std::getline(iss, text);
-        if (!text.empty() && text[0] == ' ') text.erase(0, 1);
-
+    case FrameType::Send: {
+        std::string_view from = arg(0), to = arg(1), text = arg(2);
         if (from.empty() || to.empty() || text.empty()) return;
 
-        if (FindClientIndex(clients, to) < 0) {
-            SendToClient(clients, from, "SERVER: user '" + to + "' not connected");
+        Client* target = reg.FindClient(to);
+        if (!target) {
+            if (StoreMessage(srv, MessageStore::Kind::Queued, to, FrameType::Private, {from, text})) {
+                Notify(srv, from, Cat({"user '", to, "' not connected, message queued"}));
+                Log(Cat({"SEND ", from, "->", to, " '", text, "' (queued)"}));
+                return;
+            }
+            Notify(srv, from, Cat({"user '", to, "' not connected"}));
             return;
         }
 
-        SendToClient(clients, to, "[pm] " + from + ": " + text);
-        SendToClient(clients, from, "SERVER: delivered to '" + to + "'");
-        Log("SEND " + from + "->" + to + " '" + text + "'");
+        StoreMessage(srv, MessageStore::Kind::Private, to, FrameType::Private, {from, text});
+
+        if (!SendPrivate(srv, *target, from, text)) {
+            Notify(srv, from, Cat({"user '", to, "' is not reading, message dropped"}));
+            return;
+        }
+        Notify(srv, from, Cat({"delivered to '", to, "'"}));
+        Log(Cat({"SEND ", from, "->", to, " '", text, "'"}));
         return;
     }
 
-    if (cmd == "CREATEGROUP") {
-        std::string from, group;
-        iss >> from >> group;
+    case FrameType::CreateGroup: {
+        std::string_view from = arg(0), group = arg(1);
         if (from.empty() || group.empty()) return;
 
-        if (FindGroupIndex(groups, group) >= 0) {
-            SendToClient(clients, from, "SERVER: group already exists");
+        if (reg.FindGroup(group)) {
+            Notify(srv, from, "group already exists");
             return;
         }
 
-        Group g;
-        g.name = group;
-        g.fifoPath = GroupFifoPath(group);
-        g.fdRead = -1;
-        g.fdDummyWrite = -1;
-
-        if (!CreateQueue(g.fifoPath)) {
-            SendToClient(clients, from, "SERVER: cannot create group fifo");
+        std::string fifoPath = GroupFifoPath(group);
+        if (!CreateQueue(fifoPath)) {
+            Notify(srv, from, "cannot create group fifo");
             return;
         }
 
-        g.fdRead = open(g.fifoPath.c_str(), O_RDONLY | O_NONBLOCK);
-        if (g.fdRead < 0) {
-            std::perror(("open(" + g.fifoPath + ")").c_str());
-            DeleteQueue(g.fifoPath);
-            SendToClient(clients, from, "SERVER: cannot open group fifo for read");
+        int fdRead = open(fifoPath.c_str(), O_RDONLY | O_NONBLOCK);
+        if (fdRead < 0) {
+            std::perror(("open(" + fifoPath + ")").c_str());
+            DeleteQueue(fifoPath);
+            Notify(srv, from, "cannot open group fifo for read");
             return;
         }
 
+        Group& g = reg.AddGroup(group);
+        g.fifoPath = fifoPath;
+        g.fdRead = fdRead;
         g.fdDummyWrite = open(g.fifoPath.c_str(), O_WRONLY | O_NONBLOCK);
         if (g.fdDummyWrite < 0) g.fdDummyWrite = -1;
 
-        g.members.push_back(from);
+        if (!WatchGroup(srv, g)) {
+            close(g.fdRead);
+            if (g.fdDummyWrite >= 0) close(g.fdDummyWrite);
+            DeleteQueue(g.fifoPath);
+            reg.RemoveGroup(g.id);
+            Notify(srv, from, "cannot watch group fifo");
+            return;
+        }
 
-        groups.push_back(g);
+        g.ring = GroupRing::Create(group);
+        if (!g.ring) Log(Cat({"GROUPRING ", group, ": unavailable, fifo only"}));
+        reg.Join(g, from);
 
-        Log("CREATEGROUP " + group + " by " + from);
-        SendToClient(clients, from, "SERVER: group created '" + group + "'");
+        Log(Cat({"CREATEGROUP ", group, " by ", from}));
+        Notify(srv, from, Cat({"group created '", group, "'"}));
         return;
     }
 
-    if (cmd == "DELETEGROUP") {
-        std::string from, group;
-        iss >> from >> group;
+    case FrameType::DeleteGroup: {
+        std::string_view from = arg(0), group = arg(1);
         if (from.empty() || group.empty()) return;
 
-        int gi = FindGroupIndex(groups, group);
-        if (gi < 0) {
-            SendToClient(clients, from, "SERVER: group not found");
+        Group* g = reg.FindGroup(group);
+        if (!g) {
+            Notify(srv, from, "group not found");
             return;
         }
 
-        Log("DELETEGROUP " + group);
+        Log(Cat({"DELETEGROUP ", group}));
 
-        if (groups[gi].fdRead >= 0) close(groups[gi].fdRead);
-        if (groups[gi].fdDummyWrite >= 0) close(groups[gi].fdDummyWrite);
-        DeleteQueue(groups[gi].fifoPath);
+        if (g->fdRead >= 0) {
+            srv.reactor->Remove(g->fdRead);
+            close(g->fdRead);
+        }
+        if (g->fdDummyWrite >= 0) close(g->fdDummyWrite);
+        DeleteQueue(g->fifoPath);
+        if (g->ring) {
+            g->ring->Close();
+            GroupRing::Remove(group);
+        }
 
-        groups[gi] = groups.back();
-        groups.pop_back();
+        reg.RemoveGroup(g->id);
 
-        SendToClient(clients, from, "SERVER: group deleted '" + group + "'");
+        Notify(srv, from, Cat({"group deleted '", group, "'"}));
         return;
     }
 
-    if (cmd == "JOINGROUP") {
-        std::string from, group;
-        iss >> from >> group;
+    case FrameType::JoinGroup: {
+        std::string_view from = arg(0), group = arg(1);
         if (from.empty() || group.empty()) return;
 
-        int gi = FindGroupIndex(groups, group);
-        if (gi < 0) {
-            SendToClient(clients, from, "SERVER: group not found");
+        Group* g = reg.FindGroup(group);
+        if (!g) {
+            Notify(srv, from, "group not found");
             return;
         }
 
-        if (!IsMember(groups[gi], from)) {
-            groups[gi].members.push_back(from);
-        }
+        // A member that asks for a ring slot and gets none, or asks in a
+        // group without a ring, takes the group's messages over its FIFO.
+        uint32_t slot = GroupRing::kNoSlot;
+        if (arg(2) == "RING" && g->ring) slot = g->ring->AssignSlot(from);
+        reg.Join(*g, from, slot);
 
-        Log("JOINGROUP " + from + " -> " + group);
-        SendToClient(clients, from, "SERVER: joined group '" + group + "'");
+        Log(Cat({"JOINGROUP ", from, " -> ", group, slot != GroupRing::kNoSlot ? " (ring)" : ""}));
+        Notify(srv, from, Cat({"joined group '", group, "'"}));
         return;
     }
 
-    if (cmd == "LEAVEGROUP") {
-        std::string from, group;
-        iss >> from >> group;
+    case FrameType::LeaveGroup: {
+        std::string_view from = arg(0), group = arg(1);
         if (from.empty() || group.empty()) return;
 
-        int gi = FindGroupIndex(groups, group);
-        if (gi < 0) {
-            SendToClient(clients, from, "SERVER: group not found");
+        Group* g = reg.FindGroup(group);
+        if (!g) {
+            Notify(srv, from, "group not found");
             return;
         }
 
-        std::vector<std::string> newList;
-        for (auto& m : groups[gi].members) {
-            if (m != from) newList.push_back(m);
+        reg.Leave(*g, from);
+
+        Log(Cat({"LEAVEGROUP ", from, " <- ", group}));
+        Notify(srv, from, Cat({"left group '", group, "'"}));
+        return;
+    }
+
+    case FrameType::Stats: {
+        std::string_view from = arg(0);
+        if (from.empty()) return;
+        SendStats(srv, from);
+        return;
+    }
+
+    case FrameType::History: {
+        std::string_view from = arg(0), target = arg(1);
+        if (from.empty() || target.empty()) return;
+        if (!srv.store) {
+            Notify(srv, from, "history is not kept");
+            return;
         }
-        groups[gi].members = std::move(newList);
 
-        Log("LEAVEGROUP " + from + " <- " + group);
-        SendToClient(clients, from, "SERVER: left group '" + group + "'");
+        // A group's history is for its members, and its shard is the one
+        // that can tell; it hands the request on to the login's.
+        if (target != from) {
+            Group* g = reg.FindGroup(target);
+            if (!g) {
+                Notify(srv, from, "group not found");
+                return;
+            }
+            if (!reg.IsMember(*g, from)) {
+                Notify(srv, from, Cat({"not a member of group '", target, "'"}));
+                return;
+            }
+            size_t owner = OwnerOf(srv, from);
+            if (owner != srv.shard) {
+                ShardMessage msg;
+                msg.kind = ShardMessage::Kind::History;
+                msg.argCount = 4;
+                for (int i = 0; i < 4; ++i) msg.args[i] = std::string(arg(i));
+                srv.peers[owner]->inbox.Post(std::move(msg));
+                return;
+            }
+        }
+        SendHistory(srv, from, target, arg(2), arg(3));
         return;
     }
 
-    Log("UNKNOWN CMD: " + cmd);
-}
+    case FrameType::Ring: {
+        // The command ring was drained by whoever read the doorbell; here
+        // it means the client made room in a full delivery ring.
+        Client* c = reg.FindClient(arg(0));
+        if (!c || !c->shm || !c->watchingWrite) return;
+        c->watchingWrite = false;
+        FlushClient(srv, *c);
+        return;
+    }
 
-static void HandleGroupReadable(Group& g, std::vector<Client>& clients) {
-    char buf[4096];
+    default:
+        Log("UNEXPECTED FRAME " + std::to_string((int)cmd.type));
+        return;
+    }
+}
 
-    while (true) {
-        ssize_t n = read(g.fdRead, buf, sizeof(buf));
-        if (n > 0) {
-            g.readBuf.append(buf, buf + n);
+static bool ParseCommandLine(std::string_view line, Frame& cmd) {
+    if (line.empty() || line == "\r") return false;
+    if (!ParseTextMessage(line, cmd)) {
+        Log(Cat({"UNKNOWN CMD: ", line.substr(0, line.find(' '))}));
+        return false;
+    }
+    return true;
+}
 
-            while (true) {
-                size_t pos = g.readBuf.find('\n');
-                if (pos == std::string::npos) break;
+static void PostToGroup(std::string_view from, std::string_view text, Group& g, Server& srv) {
+    if (from.empty() || text.empty()) return;
+    Log(Cat({"GROUPMSG [", g.name, "] ", from, ": ", text}));
+    StoreMessage(srv, MessageStore::Kind::Group, g.name, FrameType::GroupMessage, {g.name, from, text});
+    BroadcastToGroup(srv, g, from, text);
+}
 
-                std::string oneLine = g.readBuf.substr(0, pos);
-                g.readBuf.erase(0, pos + 1);
+// A post that came over the FIFO goes into the ring like any other, so
+// ring readers see one order; DrainGroupRing then logs and forwards it.
+static void ReadGroupPost(const Frame& msg, Group& g, Server& srv) {
+    if (msg.type != FrameType::GroupPost || msg.fieldCount < 2) return;
+    std::string_view from = msg.fields[0], text = msg.fields[1];
+    if (g.ring) {
+        Payload frame = FramePayload(FrameType::GroupMessage, {g.name, from, text});
+        if (frame && g.ring->Publish(*frame)) return;
+    }
+    PostToGroup(from, text, g, srv);
+}
 
-                if (oneLine.empty()) continue;
+// A ring reader that lags by more than this is evicted and falls back to
+// the FIFO, before the publishers can overrun it.
+static uint64_t RingEvictLag(const GroupRing& ring) {
+    return ring.Capacity() / 4 * 3;
+}
 
-                std::istringstream iss(oneLine);
-                std::string tag, from;
-                iss >> tag >> from;
-                std::string text;
-                std::getline(iss, text);
-                if (!text.empty() && text[0] == ' ') text.erase(0, 1);
+static void EvictLaggingReaders(Group& g, Server& srv) {
+    for (size_t i = 0; i < g.members.size(); ++i) {
+        uint32_t slot = g.readerSlots[i];
+        if (slot == GroupRing::kNoSlot || g.ring->Lag(slot) <= RingEvictLag(*g.ring)) continue;
+        g.ring->EvictSlot(slot);
+        g.readerSlots[i] = GroupRing::kNoSlot;
+        std::string_view login = srv.reg.LoginName(g.members[i]);
+        Log(Cat({"GROUPRING ", g.name, ": evicted ", login}));
+        Notify(srv, login, Cat({"fell behind in group '", g.name, "', messages now come over the fifo"}));
+    }
+}
 
-                if (tag == "MSG" && !from.empty() && !text.empty()) {
-                    Log("GROUPMSG [" + g.name + "] " + from + ": " + text);
-                    BroadcastToGroup(clients, g, from, text);
-                }
+// The server reads the ring as slot 0: it logs each message and forwards
+// it to the members without a slot.
+static void DrainGroupRing(Group& g, Server& srv) {
+    std::string record;
+    do {
+        while (true) {
+            bool lost = false;
+            if (!g.ring->ReadNext(GroupRing::kServerSlot, record, lost)) {
+                if (!lost) break;
+                Log(Cat({"GROUPRING ", g.name, ": overrun, messages lost"}));
+                continue;
             }
+            Frame msg;
+            size_t size = 0;
+            if (record.empty() || record[0] != kFrameMagic || DecodeFrame(record, msg, size) != FrameDecode::Ok ||
+                size != record.size() || msg.type != FrameType::GroupMessage || msg.fieldCount < 3 ||
+                msg.fields[0] != g.name)
+                continue;
+            PostToGroup(msg.fields[1], msg.fields[2], g, srv);
+        }
+        EvictLaggingReaders(g, srv);
+    } while (!g.ring->ServerSleep());
+}
+
+static void HandleGroupReadable(Group& g, Server& srv) {
+    // Ring doorbells carry nothing: the ring is drained below either way.
+    auto onMessage = [&](const Frame& msg) {
+        if (msg.type == FrameType::Ring) return;
+        ReadGroupPost(msg, g, srv);
+    };
+    while (true) {
+        ssize_t n = g.readBuf.ReadFrom(g.fdRead);
+        if (n > 0) {
+            ConsumeMessages(
+                g.readBuf,
+                [&](std::string_view line) {
+                    Frame msg;
+                    if (ParseTextMessage(line, msg)) onMessage(msg);
+                },
+                onMessage);
             continue;
         }
 
@@ -388,13 +856,273 @@ static void HandleGroupReadable(Group& g, std::vector<Client>& clients) {
         std::perror("read(group)");
         break;
     }
+    if (g.ring) DrainGroupRing(g, srv);
+}
+
+static void HandleShardMessage(ShardMessage& msg, Server& srv) {
+    switch (msg.kind) {
+    case ShardMessage::Kind::Command: {
+        Frame cmd;
+        cmd.type = msg.type;
+        cmd.binary = msg.binary;
+        cmd.fieldCount = msg.argCount;
+        for (int i = 0; i < msg.argCount; ++i) cmd.fields[i] = msg.args[i];
+        HandleCommand(cmd, srv);
+        return;
+    }
+    case ShardMessage::Kind::Notice:
+        Notify(srv, msg.args[0], msg.args[1]);
+        return;
+    case ShardMessage::Kind::Group:
+        for (std::string_view login : msg.logins) {
+            Client* c = srv.reg.FindClient(login);
+            if (c) SendToClient(srv, *c, c->binary ? msg.frameMsg : msg.textMsg);
+        }
+        return;
+    case ShardMessage::Kind::LeaveAll:
+        srv.reg.LeaveAllGroups(msg.args[0]);
+        return;
+    case ShardMessage::Kind::History:
+        SendHistory(srv, msg.args[0], msg.args[1], msg.args[2], msg.args[3]);
+        return;
+    case ShardMessage::Kind::Stop:
+        srv.stopping = true;
+        return;
+    }
+}
+
+// The acceptor's side of sharded mode: passes cmd to the shard that owns
+// the login or group it is about. The acceptor is the only thread reading
+// the command FIFO and each inbox keeps its producers' order, so one
+// sender's commands to one shard run in the order they were written.
+// Disconnect and Stats concern every shard and go to all of them.
+static void RouteCommand(const Frame& cmd, std::vector<std::unique_ptr<Server>>& shards) {
+    ShardMessage msg;
+    msg.kind = ShardMessage::Kind::Command;
+    msg.type = cmd.type;
+    msg.binary = cmd.binary;
+    msg.argCount = cmd.fieldCount;
+    for (int i = 0; i < cmd.fieldCount; ++i) msg.args[i] = std::string(cmd.fields[i]);
+    auto arg = [&msg](int i) { return i < msg.argCount ? std::string_view(msg.args[i]) : std::string_view(); };
+
+    std::string_view key = arg(0);
+    switch (cmd.type) {
+    case FrameType::Stats:
+        for (size_t i = 1; i < shards.size(); ++i) shards[i]->inbox.Post(msg);
+        shards[0]->inbox.Post(std::move(msg));
+        return;
+    case FrameType::Disconnect: {
+        // Drop the login from the groups of every other shard, queued
+        // ahead of anything it sends after reconnecting.
+        if (key.empty()) return;
+        size_t owner = ShardOf(shards.size(), key);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (i == owner) continue;
+            ShardMessage leave;
+            leave.kind = ShardMessage::Kind::LeaveAll;
+            leave.argCount = 1;
+            leave.args[0] = std::string(key);
+            shards[i]->inbox.Post(std::move(leave));
+        }
+        break;
+    }
+    case FrameType::Send:
+    case FrameType::CreateGroup:
+    case FrameType::DeleteGroup:
+    case FrameType::JoinGroup:
+    case FrameType::LeaveGroup:
+        key = arg(1);
+        break;
+    case FrameType::History:
+        // A group's, to the group's shard for the membership check.
+        if (arg(1) != arg(0)) key = arg(1);
+        break;
+    default:
+        break;
+    }
+    shards[ShardOf(shards.size(), key)]->inbox.Post(std::move(msg));
+}
+
+// The command ring of a client connected over shared memory.
+struct CommandRing {
+    std::unique_ptr<ShmChannel> channel;
+    LineBuffer buf;
+};
+
+// What the thread reading the command FIFO needs: where commands go, and
+// the command rings it reads for shared-memory clients, by login. Rings
+// are shared_ptrs so one being drained outlives a Disconnect read from it.
+struct CommandReader {
+    std::vector<std::unique_ptr<Server>>* shards;
+    std::unordered_map<std::string, std::shared_ptr<CommandRing>> rings;
+};
+
+static void DispatchCommand(const Frame& cmd, CommandReader& reader) {
+    std::vector<std::unique_ptr<Server>>& shards = *reader.shards;
+    if (shards.size() > 1) {
+        RouteCommand(cmd, shards);
+    } else {
+        HandleCommand(cmd, *shards[0]);
+    }
+}
+
+static void AttachCommandRing(CommandReader& reader, std::string_view login, std::string_view spec) {
+    std::string key(login);
+    if (key.empty() || reader.rings.count(key)) return;
+    auto ring = std::make_shared<CommandRing>();
+    ring->channel = ShmChannel::Attach(spec);
+    if (!ring->channel) return;
+    // Asleep from the start, so the first command rings the doorbell.
+    ring->channel->ToServer().ReaderSleep();
+    ring->channel->SetServerReading();
+    reader.rings.emplace(std::move(key), std::move(ring));
+}
+
+static void ReadCommand(const Frame& cmd, CommandReader& reader);
+
+// Runs everything in login's command ring, then sleeps it. Doorbells
+// inside the ring mean nothing and are skipped.
+static void DrainCommandRing(CommandReader& reader, std::string_view login) {
+    auto it = reader.rings.find(std::string(login));
+    if (it == reader.rings.end()) return;
+    std::shared_ptr<CommandRing> ring = it->second;
+    ByteRing& in = ring->channel->ToServer();
+    auto run = [&reader](const Frame& cmd) {
+        if (cmd.type != FrameType::Ring) ReadCommand(cmd, reader);
+    };
+    do {
+        in.ReadInto(ring->buf);
+        if (in.TakeWriterWake()) FutexWake(in.WriterWaiting());
+        ConsumeMessages(
+            ring->buf,
+            [&](std::string_view line) {
+                Frame cmd;
+                if (ParseCommandLine(line, cmd)) run(cmd);
+            },
+            run);
+    } while (!in.ReaderSleep());
+}
+
+static void ReadCommand(const Frame& cmd, CommandReader& reader) {
+    auto arg = [&cmd](int i) { return i < cmd.fieldCount ? cmd.fields[i] : std::string_view(); };
+    if (cmd.type == FrameType::Connect && !arg(2).empty()) AttachCommandRing(reader, arg(0), arg(2));
+    if (cmd.type == FrameType::Ring) DrainCommandRing(reader, arg(0));
+
+    DispatchCommand(cmd, reader);
+
+    if (cmd.type == FrameType::Disconnect) reader.rings.erase(std::string(arg(0)));
+}
+
+static bool RunOnce(Server& srv) {
+    if (!srv.reactor->RunOnce()) return false;
+    FlushQueued(srv);
+    DisconnectEvicted(srv);
+    return true;
+}
+
+static void CloseShard(Server& srv) {
+    for (auto& [id, c] : srv.reg.Clients()) {
+        CloseClientFifo(srv, c);
+    }
+    for (auto& [id, g] : srv.reg.Groups()) {
+        if (g.fdRead >= 0) close(g.fdRead);
+        if (g.fdDummyWrite >= 0) close(g.fdDummyWrite);
+        DeleteQueue(g.fifoPath);
+        if (g.ring) {
+            g.ring->Close();
+            GroupRing::Remove(g.name);
+        }
+    }
+    srv.reactor.reset();
 }
 
-int main() {
+static void RunShard(Server& srv) {
+    TRACE_THREAD_NAME("shard");
+    while (!srv.stopping) {
+        if (!RunOnce(srv)) break;
+    }
+    CloseShard(srv);
+}
+
+static void Usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--poll] [--threads N] [--high-water BYTES] [--low-water BYTES]"
+                 " [--slow-policy drop|disconnect] [--store DIR]\n";
+}
+
+// im_server [--poll] [--threads N] [--high-water BYTES] [--low-water BYTES]
+//           [--slow-policy drop|disconnect] [--store DIR]
+//   --poll         wait with poll(2) instead of edge-triggered epoll
+//   --threads      shard clients and groups over N threads, each with its
+//                  own reactor, behind one thread reading the command FIFO
+//                  (default 1: everything on the main thread)
+//   --high-water   per-client bytes queued for a full FIFO before the client
+//                  counts as slow (default 1 MiB)
+//   --low-water    queue size at which a slow client is served again
+//                  (default 256 KiB)
+//   --slow-policy  drop messages to a slow client (default) or disconnect it
+//   --store        keep every message in DIR: private messages to users who
+//                  are not connected are queued for their next CONNECT, and
+//                  HISTORY answers from it (default: nothing is kept)
+int main(int argc, char* argv[]) {
+    OutboxLimits limits;
+    Reactor::Backend backend = Reactor::Backend::Epoll;
+    size_t threads = 1;
+    std::string storeDir;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--poll") {
+            backend = Reactor::Backend::Poll;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::strtoull(argv[++i], nullptr, 10);
+            if (threads == 0) {
+                Usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "--high-water" && i + 1 < argc) {
+            limits.highWater = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--low-water" && i + 1 < argc) {
+            limits.lowWater = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--store" && i + 1 < argc) {
+            storeDir = argv[++i];
+        } else if (arg == "--slow-policy" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "drop") {
+                limits.policy = SlowClientPolicy::Drop;
+            } else if (policy == "disconnect") {
+                limits.policy = SlowClientPolicy::Disconnect;
+            } else {
+                Usage(argv[0]);
+                return 2;
+            }
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (limits.highWater == 0 || limits.lowWater > limits.highWater) {
+        std::cerr << "--high-water must be positive and at least --low-water\n";
+        return 2;
+    }
 
     signal(SIGPIPE, SIG_IGN);
-    signal(SIGINT, on_sigint);
-    signal(SIGTERM, on_sigint);
+
+    // SIGINT/SIGTERM arrive through a signalfd watched like any other fd,
+    // so the wait needs no timeout to notice a stop request. Shard threads
+    // inherit the blocked mask, so the signals only ever reach the signalfd.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &stopSignals, nullptr) < 0) {
+        std::perror("sigprocmask");
+        return 1;
+    }
+    int fd_signal = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd_signal < 0) {
+        std::perror("signalfd");
+        return 1;
+    }
 
     Log("Server start...");
 
@@ -409,78 +1137,119 @@ int main() {
     int fd_cmd_dummy_w = open(SERVER_CMD_FIFO, O_WRONLY | O_NONBLOCK);
     if (fd_cmd_dummy_w < 0) fd_cmd_dummy_w = -1;
 
-    std::vector<Client> clients;
-    std::vector<Group> groups;
+    std::unique_ptr<MessageStore> store;
+    if (!storeDir.empty()) {
+        auto start = std::chrono::steady_clock::now();
+        store = MessageStore::Open(storeDir, StoreOptions());
+        if (!store) {
+            std::perror(("store " + storeDir).c_str());
+            return 1;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        Log("Store " + storeDir + ": last seq " + std::to_string(store->LastSeq()) + " in " +
+            std::to_string(store->Segments()) + " segments, recovered in " + std::to_string(ms.count()) + " ms");
+    }
+
+    std::vector<std::unique_ptr<Server>> shards;
+    for (size_t i = 0; i < threads; ++i) {
+        auto srv = std::make_unique<Server>();
+        srv->limits = limits;
+        srv->store = store.get();
+        srv->shard = i;
+        srv->reactor = Reactor::Create(backend);
+        if (!srv->reactor) return 1;
+        shards.push_back(std::move(srv));
+    }
+    bool sharded = threads > 1;
+    if (sharded) {
+        for (auto& srv : shards) {
+            for (auto& peer : shards) srv->peers.push_back(peer.get());
+            Server* self = srv.get();
+            if (!srv->inbox.Open() || !srv->reactor->Add(srv->inbox.Fd(), [self] {
+                    self->inbox.Drain([self](ShardMessage& msg) { HandleShardMessage(msg, *self); });
+                })) {
+                std::perror("eventfd");
+                return 1;
+            }
+        }
+    }
 
-    std::string cmdBuf; 
+    // Unsharded, the command FIFO is read by the one server's reactor;
+    // sharded, by the acceptor's own, which watches nothing else.
+    std::unique_ptr<Reactor> acceptor;
+    if (sharded) {
+        acceptor = Reactor::Create(backend);
+        if (!acceptor) return 1;
+    }
+    Reactor& mainReactor = sharded ? *acceptor : *shards[0]->reactor;
 
-    while (!g_stop) {
+    bool stop = false;
 
-        std::vector<pollfd> fds;
-        fds.push_back(pollfd{fd_cmd_r, POLLIN, 0});
+    mainReactor.Add(fd_signal, [&] {
+        signalfd_siginfo info;
+        while (read(fd_signal, &info, sizeof(info)) == (ssize_t)sizeof(info)) stop = true;
+    });
 
-        std::vector<int> groupIndexForPoll;
-        for (int i = 0; i < (int)groups.size(); ++i) {
-            if (groups[i].fdRead < 0) continue;
-            fds.push_back(pollfd{groups[i].fdRead, POLLIN, 0});
-            groupIndexForPoll.push_back(i);
-        }
+    // Whichever thread appends, the batched fdatasync runs here.
+    if (store && !mainReactor.Add(store->SyncFd(), [&store] { store->Sync(); })) {
+        std::perror("timerfd");
+        return 1;
+    }
 
-        int rc = poll(fds.data(), fds.size(), 500);
-        if (rc < 0) {
+    LineBuffer cmdBuf;
+    CommandReader reader;
+    reader.shards = &shards;
+    auto dispatch = [&reader](const Frame& cmd) { ReadCommand(cmd, reader); };
+
+    mainReactor.Add(fd_cmd_r, [&] {
+        while (true) {
+            ssize_t n = cmdBuf.ReadFrom(fd_cmd_r);
+            if (n > 0) {
+                ConsumeMessages(
+                    cmdBuf,
+                    [&](std::string_view line) {
+                        Frame cmd;
+                        if (ParseCommandLine(line, cmd)) dispatch(cmd);
+                    },
+                    dispatch);
+                continue;
+            }
+            if (n == 0) break;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
             if (errno == EINTR) continue;
-            std::perror("poll");
+            std::perror("read(cmd)");
             break;
         }
-        if (rc == 0) continue;
-
-        if (fds[0].revents & POLLIN) {
-            char buf[4096];
-            while (true) {
-                ssize_t n = read(fd_cmd_r, buf, sizeof(buf));
-                if (n > 0) {
-                    cmdBuf.append(buf, buf + n);
-
-                    while (true) {
-                        size_t pos = cmdBuf.find('\n');
-                        if (pos == std::string::npos) break;
-                        std::string oneCmd = cmdBuf.substr(0, pos + 1);
-                        cmdBuf.erase(0, pos + 1);
-                        HandleCommand(oneCmd, clients, groups);
-                    }
-                    continue;
-                }
-                if (n == 0) break;
-                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-                if (errno == EINTR) continue;
-                std::perror("read(cmd)");
-                break;
-            }
-        }
+    });
 
-        for (size_t p = 1; p < fds.size(); ++p) {
-            if (!(fds[p].revents & POLLIN)) continue;
-            int gi = groupIndexForPoll[p - 1];
-            if (gi >= 0 && gi < (int)groups.size()) {
-                HandleGroupReadable(groups[gi], clients);
-            }
+    if (!sharded) {
+        while (!stop) {
+            if (!RunOnce(*shards[0])) break;
         }
+        Log("Server stop... cleaning");
+        CloseShard(*shards[0]);
+    } else {
+        Log("Sharded over " + std::to_string(threads) + " threads");
+        std::vector<std::thread> workers;
+        for (auto& srv : shards) workers.emplace_back(RunShard, std::ref(*srv));
+        while (!stop) {
+            if (!acceptor->RunOnce()) break;
+        }
+        Log("Server stop... cleaning");
+        // Queued behind every command already routed, so each shard
+        // finishes those before it closes its FIFOs.
+        for (auto& srv : shards) {
+            ShardMessage msg;
+            msg.kind = ShardMessage::Kind::Stop;
+            srv->inbox.Post(std::move(msg));
+        }
+        for (auto& t : workers) t.join();
+        acceptor.reset();
     }
 
-    Log("Server stop... cleaning");
-
-    for (auto& c : clients) {
-        if (c.fdWrite >= 0) close(c.fdWrite);
-    }
-    for (auto& g : groups) {
-        if (g.fdRead >= 0) close(g.fdRead);
-        if (g.fdDummyWrite >= 0) close(g.fdDummyWrite);
-        DeleteQueue(g.fifoPath);
-    }
-
+    close(fd_signal);
     close(fd_cmd_r);
     if (fd_cmd_dummy_w >= 0) close(fd_cmd_dummy_w);
     DeleteQueue(SERVER_CMD_FIFO);
     return 0;
 }
-
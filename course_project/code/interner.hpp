@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using NameId = uint32_t;
+static const NameId kNoName = UINT32_MAX;
+
+// Maps each distinct string to a small dense id. Strings are never
+// forgotten, so an id stays valid (and keeps its meaning) for the life of
+// the server.
+class Interner {
+public:
+    NameId Intern(std::string_view s) {
+        auto it = ids_.find(s);
+        if (it != ids_.end()) return it->second;
+        NameId id = static_cast<NameId>(storage_.size());
+        storage_.emplace_back(s);
+        ids_.emplace(storage_.back(), id);
+        return id;
+    }
+
+    NameId Find(std::string_view s) const {
+        auto it = ids_.find(s);
+        return it == ids_.end() ? kNoName : it->second;
+    }
+
+    const std::string& Name(NameId id) const { return storage_[id]; }
+    size_t Size() const { return storage_.size(); }
+
+private:
+    std::deque<std::string> storage_;  // by id; deque keeps the views in ids_ valid
+    std::unordered_map<std::string_view, NameId> ids_;
+};
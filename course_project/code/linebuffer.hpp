@@ -0,0 +1,87 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// Read buffer for a FIFO. read() goes straight into the free tail and
+// consumers advance a head offset, so taking a message off the front costs
+// nothing however much is queued behind it. The unread bytes are moved to
+// the front only when the tail runs out of room, and then they are
+// usually a single partial message.
+//
+// Newlines are found with memchr (vectorised in glibc). The scan position
+// is remembered, so a line that arrives over many reads is scanned once.
+class LineBuffer {
+public:
+    static constexpr size_t kReadChunk = 4096;
+
+    // One read() of up to kReadChunk bytes into the tail; returns its result.
+    ssize_t ReadFrom(int fd) {
+        Reserve(kReadChunk);
+        ssize_t n = read(fd, buf_.data() + tail_, kReadChunk);
+        if (n > 0) tail_ += (size_t)n;
+        return n;
+    }
+
+    void Append(const char* data, size_t n) {
+        Reserve(n);
+        std::memcpy(buf_.data() + tail_, data, n);
+        tail_ += n;
+    }
+
+    // The unread bytes. Invalidated by ReadFrom and Append.
+    std::string_view Peek() const { return std::string_view(buf_.data() + head_, tail_ - head_); }
+    size_t Size() const { return tail_ - head_; }
+    bool Empty() const { return head_ == tail_; }
+
+    void Consume(size_t n) {
+        head_ += n;
+        scanned_ = scanned_ > n ? scanned_ - n : 0;
+        if (head_ == tail_) head_ = tail_ = scanned_ = 0;
+    }
+
+    // Offset of the first '\n' in Peek(), or npos.
+    size_t FindNewline() {
+        const char* start = buf_.data() + head_;
+        const void* nl = std::memchr(start + scanned_, '\n', Size() - scanned_);
+        if (!nl) {
+            scanned_ = Size();
+            return std::string_view::npos;
+        }
+        return static_cast<const char*>(nl) - start;
+    }
+
+    // The next complete line without its '\n', consumed; false if there
+    // is none yet. The view lives until the next ReadFrom or Append.
+    bool NextLine(std::string_view& line) {
+        size_t nl = FindNewline();
+        if (nl == std::string_view::npos) return false;
+        line = std::string_view(buf_.data() + head_, nl);
+        Consume(nl + 1);
+        return true;
+    }
+
+private:
+    void Reserve(size_t n) {
+        if (buf_.size() - tail_ >= n) return;
+        size_t unread = tail_ - head_;
+        // Moving no more than was consumed since the last move keeps the
+        // copying linear in the bytes read.
+        if (head_ > 0 && unread <= head_) {
+            std::memmove(buf_.data(), buf_.data() + head_, unread);
+            head_ = 0;
+            tail_ = unread;
+        }
+        if (buf_.size() - tail_ < n) buf_.resize(std::max(buf_.size() * 2, tail_ + n));
+    }
+
+    std::vector<char> buf_;
+    size_t head_ = 0;
+    size_t tail_ = 0;
+    size_t scanned_ = 0;  // bytes after head_ known to hold no '\n'
+};
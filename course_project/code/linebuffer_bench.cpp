@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "linebuffer.hpp"
+#include "wire.hpp"
+
+// Line splitting of FIFO reads, fed in kReadChunk pieces from memory:
+//
+//   string erase      append, then find('\n') + substr + erase(0, pos + 1)
+//                     per line (the im_server and im_client loops before)
+//   LineBuffer        NextLine over an offset buffer
+//   ConsumeMessages   the same buffer through the text/frame splitter
+//
+// Inputs: dense short commands, a mix of lengths, and long lines that
+// span many reads.
+// Usage: linebuffer_bench [MiB]   (default 32)
+
+using Clock = std::chrono::steady_clock;
+
+static std::string MakeInput(size_t bytes, size_t minLen, size_t maxLen) {
+    std::mt19937 rng(207);
+    std::uniform_int_distribution<size_t> len(minLen, maxLen);
+    std::string s;
+    s.reserve(bytes + maxLen);
+    while (s.size() < bytes) {
+        size_t n = len(rng);
+        s += "MSG user";
+        s += std::to_string(rng() % 1000);
+        s.push_back(' ');
+        while (n-- > 0) s.push_back('a' + rng() % 26);
+        s.push_back('\n');
+    }
+    return s;
+}
+
+static void Report(const char* name, size_t lines, size_t bytes, double seconds) {
+    std::cout << "    " << name << ": " << lines << " lines in " << seconds << " s | "
+              << bytes / seconds / (1 << 20) << " MiB/s | " << seconds / lines * 1e9 << " ns/line\n";
+}
+
+template <class Run>
+static void Time(const char* name, const std::string& input, Run run) {
+    size_t checksum = 0;
+    auto start = Clock::now();
+    size_t lines = run(input, checksum);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    Report(name, lines, input.size(), seconds);
+    if (checksum + lines != input.size()) std::cerr << "    checksum mismatch\n";
+}
+
+static size_t StringErase(const std::string& input, size_t& checksum) {
+    std::string buf;
+    size_t lines = 0;
+    for (size_t off = 0; off < input.size(); off += LineBuffer::kReadChunk) {
+        buf.append(input, off, LineBuffer::kReadChunk);
+        while (true) {
+            size_t pos = buf.find('\n');
+            if (pos == std::string::npos) break;
+            std::string line = buf.substr(0, pos);
+            buf.erase(0, pos + 1);
+            checksum += line.size();
+            ++lines;
+        }
+    }
+    return lines;
+}
+
+static size_t NextLine(const std::string& input, size_t& checksum) {
+    LineBuffer buf;
+    size_t lines = 0;
+    for (size_t off = 0; off < input.size(); off += LineBuffer::kReadChunk) {
+        buf.Append(input.data() + off, std::min(LineBuffer::kReadChunk, input.size() - off));
+        std::string_view line;
+        while (buf.NextLine(line)) {
+            checksum += line.size();
+            ++lines;
+        }
+    }
+    return lines;
+}
+
+static size_t Consume(const std::string& input, size_t& checksum) {
+    LineBuffer buf;
+    size_t lines = 0;
+    for (size_t off = 0; off < input.size(); off += LineBuffer::kReadChunk) {
+        buf.Append(input.data() + off, std::min(LineBuffer::kReadChunk, input.size() - off));
+        ConsumeMessages(
+            buf,
+            [&](std::string_view line) {
+                checksum += line.size();
+                ++lines;
+            },
+            [](const Frame&) {});
+    }
+    return lines;
+}
+
+int main(int argc, char* argv[]) {
+    size_t mib = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 32;
+    if (mib == 0) {
+        std::cerr << "usage: " << argv[0] << " [MiB]\n";
+        return EXIT_FAILURE;
+    }
+
+    struct Case {
+        const char* name;
+        size_t minLen, maxLen;
+    } cases[] = {
+        {"dense (4-16 byte texts)", 4, 16},
+        {"mixed (4-400 byte texts)", 4, 400},
+        {"long (32-64 KiB lines)", 32 << 10, 64 << 10},
+    };
+
+    for (const Case& c : cases) {
+        std::string input = MakeInput(mib << 20, c.minLen, c.maxLen);
+        std::cout << c.name << ", " << (input.size() >> 20) << " MiB in " << LineBuffer::kReadChunk
+                  << " byte reads\n";
+        Time("string erase", input, StringErase);
+        Time("LineBuffer", input, NextLine);
+        Time("ConsumeMessages", input, Consume);
+    }
+    return 0;
+}
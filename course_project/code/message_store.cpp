@@ -0,0 +1,360 @@
+#include "message_store.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+// A record: this header, the target, the frame, padded to 8 bytes. The
+// checksum covers everything after it, so a record only counts once all
+// of it reached the file.
+struct RecordHeader {
+    uint32_t size;  // header + target + frame, unpadded
+    uint32_t checksum;
+    uint64_t seq;
+    int64_t time;
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t targetLen;
+    uint32_t frameLen;
+};
+
+static_assert(sizeof(RecordHeader) == 32, "records start 8-aligned");
+
+namespace {
+
+uint64_t Align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+uint32_t Checksum(const char* p, size_t n) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<uint8_t>(p[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t RecordChecksum(const char* record, uint32_t size) {
+    size_t skip = offsetof(RecordHeader, seq);
+    return Checksum(record + skip, size - skip);
+}
+
+// Gives the first size bytes of fd blocks, so writes through the mapping
+// cannot meet a full disk, which would raise SIGBUS. errno on failure.
+bool Reserve(int fd, size_t size) {
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err != 0) errno = err;
+    return err == 0;
+}
+
+// "<20 digits>.log", the sequence number of the segment's first record.
+bool ParseSegmentName(const char* name, uint64_t& firstSeq) {
+    if (std::strlen(name) != 24 || std::strcmp(name + 20, ".log") != 0) return false;
+    firstSeq = 0;
+    for (int i = 0; i < 20; ++i) {
+        if (name[i] < '0' || name[i] > '9') return false;
+        firstSeq = firstSeq * 10 + (uint64_t)(name[i] - '0');
+    }
+    return true;
+}
+
+std::string SegmentName(uint64_t firstSeq) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020" PRIu64 ".log", firstSeq);
+    return name;
+}
+
+int64_t NowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+template <class T>
+std::vector<T>& Slot(std::vector<std::vector<T>>& index, NameId id) {
+    if (id >= index.size()) index.resize(id + 1);
+    return index[id];
+}
+
+}  // namespace
+
+std::unique_ptr<MessageStore> MessageStore::Open(const std::string& dir, const StoreOptions& options) {
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) return nullptr;
+    std::unique_ptr<MessageStore> store(new MessageStore());
+    store->dir_ = dir;
+    store->options_ = options;
+    store->dirFd_ = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (store->dirFd_ < 0) return nullptr;
+    store->timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (store->timerFd_ < 0) return nullptr;
+    if (!store->Recover()) return nullptr;
+    return store;
+}
+
+MessageStore::~MessageStore() {
+    if (!segments_.empty() && unsynced_ > 0) fdatasync(segments_.back().fd);
+    for (Segment& s : segments_) {
+        munmap(s.base, s.size);
+        close(s.fd);
+    }
+    if (timerFd_ >= 0) close(timerFd_);
+    if (dirFd_ >= 0) close(dirFd_);
+}
+
+// Maps every segment in order of first seq and indexes its records up to
+// the first one that is torn or out of sequence.
+bool MessageStore::Recover() {
+    DIR* d = fdopendir(dup(dirFd_));
+    if (!d) return false;
+    std::vector<uint64_t> found;
+    while (dirent* e = readdir(d)) {
+        uint64_t firstSeq = 0;
+        if (ParseSegmentName(e->d_name, firstSeq)) found.push_back(firstSeq);
+    }
+    closedir(d);
+    std::sort(found.begin(), found.end());
+
+    bool clean = true;  // the last segment ends in zeroes, ready for appends
+    for (uint64_t firstSeq : found) {
+        if (!MapSegment(dir_ + "/" + SegmentName(firstSeq), firstSeq, false)) return false;
+        Segment& s = segments_.back();
+        uint32_t segment = (uint32_t)(segments_.size() - 1);
+        uint64_t seq = firstSeq;
+        size_t pos = 0;
+        while (pos + sizeof(RecordHeader) <= s.size) {
+            RecordHeader h;
+            std::memcpy(&h, s.base + pos, sizeof(h));
+            if (h.size < sizeof(h) || h.size > s.size - pos || h.seq != seq ||
+                h.size != sizeof(h) + h.targetLen + h.frameLen || h.checksum != RecordChecksum(s.base + pos, h.size))
+                break;
+            Index(s.base + pos, segment, (uint32_t)pos);
+            pos += Align8(h.size);
+            ++seq;
+        }
+        s.used = pos;
+        nextSeq_ = std::max(nextSeq_, seq);
+        size_t tail = std::min(s.size - pos, sizeof(RecordHeader));
+        clean = std::all_of(s.base + pos, s.base + pos + tail, [](char c) { return c == 0; });
+    }
+    if (!segments_.empty() && !clean && segments_.back().used == 0) {
+        // Torn at its first record, so it holds nothing: start it over,
+        // as its name is the one the next segment would take.
+        // Reserve below gives it its size back.
+        if (ftruncate(segments_.back().fd, 0) < 0) return false;
+        clean = true;
+    }
+    if (segments_.empty() || !clean) return AddSegment();
+    // The segment that takes appends may be sparse, from a store written
+    // before segments were reserved.
+    return Reserve(segments_.back().fd, segments_.back().size);
+}
+
+bool MessageStore::MapSegment(const std::string& path, uint64_t firstSeq, bool create) {
+    int fd = open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC : O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t size = options_.segmentBytes;
+    struct stat st;
+    if (create ? !Reserve(fd, size) : fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        if (create) unlink(path.c_str());  // so the next AddSegment can try again
+        errno = err;
+        return false;
+    }
+    if (!create) size = (size_t)st.st_size;
+    if (size == 0) {
+        // Created, but the crash came before it was sized.
+        size = options_.segmentBytes;
+        if (!Reserve(fd, size)) {
+            close(fd);
+            return false;
+        }
+    }
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    segments_.push_back(Segment{firstSeq, fd, static_cast<char*>(base), size, 0});
+    return true;
+}
+
+// Starts the segment that takes appends from nextSeq_ on. The one before
+// is synced first, since Sync only ever syncs the last.
+bool MessageStore::AddSegment() {
+    if (!segments_.empty() && unsynced_ > 0) {
+        fdatasync(segments_.back().fd);
+        unsynced_ = 0;
+    }
+    if (!MapSegment(dir_ + "/" + SegmentName(nextSeq_), nextSeq_, true)) return false;
+    fsync(dirFd_);
+    return true;
+}
+
+void MessageStore::Index(const char* record, uint32_t segment, uint32_t offset) {
+    RecordHeader h;
+    std::memcpy(&h, record, sizeof(h));
+    std::string_view target(record + sizeof(h), h.targetLen);
+    Ref ref{h.seq, segment, offset};
+    switch (static_cast<Kind>(h.kind)) {
+    case Kind::Private:
+        Slot(inbox_, logins_.Intern(target)).push_back(ref);
+        break;
+    case Kind::Queued: {
+        NameId id = logins_.Intern(target);
+        Slot(inbox_, id).push_back(ref);
+        Slot(queued_, id).push_back(ref);
+        break;
+    }
+    case Kind::Group:
+        Slot(posts_, groups_.Intern(target)).push_back(ref);
+        break;
+    case Kind::Delivered: {
+        // The frame is the last delivered seq; logs from before partial
+        // delivery have none and mean all of them.
+        std::vector<Ref>& queued = Slot(queued_, logins_.Intern(target));
+        if (h.frameLen < sizeof(uint64_t)) {
+            queued.clear();
+            break;
+        }
+        uint64_t upTo;
+        std::memcpy(&upTo, record + sizeof(h) + h.targetLen, sizeof(upTo));
+        auto end = std::upper_bound(queued.begin(), queued.end(), upTo,
+                                    [](uint64_t seq, const Ref& r) { return seq < r.seq; });
+        queued.erase(queued.begin(), end);
+        break;
+    }
+    }
+}
+
+uint64_t MessageStore::Append(Kind kind, std::string_view target, std::string_view frame) {
+    std::lock_guard<std::mutex> lock(mu_);
+    return AppendLocked(kind, target, frame);
+}
+
+uint64_t MessageStore::AppendLocked(Kind kind, std::string_view target, std::string_view frame) {
+    size_t size = sizeof(RecordHeader) + target.size() + frame.size();
+    if (target.size() > UINT16_MAX || Align8(size) > options_.segmentBytes) return 0;
+    if (segments_.back().used + Align8(size) > segments_.back().size && !AddSegment()) return 0;
+
+    Segment& s = segments_.back();
+    char* record = s.base + s.used;
+    RecordHeader h{};
+    h.size = (uint32_t)size;
+    h.seq = nextSeq_;
+    h.time = NowMs();
+    h.kind = static_cast<uint8_t>(kind);
+    h.targetLen = (uint16_t)target.size();
+    h.frameLen = (uint32_t)frame.size();
+    std::memcpy(record, &h, sizeof(h));
+    std::memcpy(record + sizeof(h), target.data(), target.size());
+    std::memcpy(record + sizeof(h) + target.size(), frame.data(), frame.size());
+    h.checksum = RecordChecksum(record, h.size);
+    std::memcpy(record + offsetof(RecordHeader, checksum), &h.checksum, sizeof(h.checksum));
+
+    Index(record, (uint32_t)(segments_.size() - 1), (uint32_t)s.used);
+    s.used += Align8(size);
+    unsynced_ += Align8(size);
+    if (unsynced_ >= options_.syncBytes) {
+        fdatasync(s.fd);
+        unsynced_ = 0;
+    } else {
+        ArmSync();
+    }
+    return nextSeq_++;
+}
+
+void MessageStore::ArmSync() {
+    if (syncArmed_) return;
+    itimerspec when{};
+    when.it_value.tv_sec = options_.syncDelayMs / 1000;
+    when.it_value.tv_nsec = (long)(options_.syncDelayMs % 1000) * 1000000;
+    if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) when.it_value.tv_nsec = 1;
+    if (timerfd_settime(timerFd_, 0, &when, nullptr) == 0) syncArmed_ = true;
+}
+
+// The fdatasync itself runs unlocked, so appends from other shards go on
+// meanwhile; they count towards the next batch.
+void MessageStore::Sync() {
+    uint64_t expirations;
+    while (read(timerFd_, &expirations, sizeof(expirations)) > 0) {}
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        syncArmed_ = false;
+        if (unsynced_ == 0) return;
+        unsynced_ = 0;
+        fd = segments_.back().fd;
+    }
+    fdatasync(fd);
+}
+
+std::vector<MessageStore::Entry> MessageStore::Queued(std::string_view login, size_t limit) {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::vector<Entry> entries;
+    NameId id = logins_.Find(login);
+    if (id == kNoName || id >= queued_.size()) return entries;
+    for (size_t i = 0; i < queued_[id].size() && i < limit; ++i) entries.push_back(At(queued_[id][i]));
+    return entries;
+}
+
+size_t MessageStore::QueuedCount(std::string_view login) {
+    std::lock_guard<std::mutex> lock(mu_);
+    NameId id = logins_.Find(login);
+    return id == kNoName || id >= queued_.size() ? 0 : queued_[id].size();
+}
+
+void MessageStore::MarkDelivered(std::string_view login, uint64_t seq) {
+    std::lock_guard<std::mutex> lock(mu_);
+    AppendLocked(Kind::Delivered, login, std::string_view(reinterpret_cast<const char*>(&seq), sizeof(seq)));
+}
+
+std::vector<MessageStore::Entry> MessageStore::Inbox(std::string_view login, uint64_t since, size_t limit) {
+    std::lock_guard<std::mutex> lock(mu_);
+    return Range(inbox_, logins_.Find(login), since, limit);
+}
+
+std::vector<MessageStore::Entry> MessageStore::GroupHistory(std::string_view group, uint64_t since, size_t limit) {
+    std::lock_guard<std::mutex> lock(mu_);
+    return Range(posts_, groups_.Find(group), since, limit);
+}
+
+std::vector<MessageStore::Entry> MessageStore::Range(const std::vector<std::vector<Ref>>& index,
+                                                     NameId id,
+                                                     uint64_t since,
+                                                     size_t limit) const
+{
+    std::vector<Entry> entries;
+    if (id == kNoName || id >= index.size()) return entries;
+    const std::vector<Ref>& refs = index[id];
+    auto it = std::upper_bound(refs.begin(), refs.end(), since,
+                               [](uint64_t seq, const Ref& ref) { return seq < ref.seq; });
+    for (; it != refs.end() && entries.size() < limit; ++it) entries.push_back(At(*it));
+    return entries;
+}
+
+MessageStore::Entry MessageStore::At(const Ref& ref) const {
+    const char* record = segments_[ref.segment].base + ref.offset;
+    RecordHeader h;
+    std::memcpy(&h, record, sizeof(h));
+    return Entry{h.seq, h.time, static_cast<Kind>(h.kind),
+                 std::string_view(record + sizeof(h) + h.targetLen, h.frameLen)};
+}
+
+uint64_t MessageStore::LastSeq() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return nextSeq_ - 1;
+}
+
+size_t MessageStore::Segments() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return segments_.size();
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "interner.hpp"
+
+struct StoreOptions {
+    size_t segmentBytes = 64 << 20;  // size of each segment file
+    size_t syncBytes = 1 << 20;      // fdatasync once this much is unsynced...
+    int syncDelayMs = 5;             // ...or this long after the first unsynced append
+};
+
+// Persistent message log of im_server (--store DIR).
+//
+// Messages are appended to segment files, DIR/<first seq>.log, each
+// preallocated and mapped. Their blocks are reserved up front, so a full
+// disk fails the segment, and with it Append, rather than a write through
+// the mapping. A record is a small header, its target (login
+// or group) and the message as the frame a binary client gets, so history
+// is answered with views into the mapping; nothing is deserialised.
+//
+// Appends are made durable in batches. fdatasync runs once syncBytes are
+// unsynced, or when SyncFd() fires, syncDelayMs after the first unsynced
+// append. A crash loses at most the last batch.
+//
+// The per-recipient, per-group and offline-queue indexes hold (seq,
+// segment, offset) and live in memory; Open rebuilds them by scanning the
+// segments. A torn record ends its segment's log: appends go to a new
+// segment rather than over it.
+//
+// One store is shared by every shard, so every call locks.
+class MessageStore {
+public:
+    enum class Kind : uint8_t {
+        Private = 1,  // to a connected login
+        Queued,       // to a login that was not connected, until it connects
+        Group,        // to a group
+        Delivered,    // marker: the target's Queued up to the seq it holds were delivered
+    };
+
+    struct Entry {
+        uint64_t seq;
+        int64_t time;  // ms since the epoch
+        Kind kind;
+        std::string_view frame;  // into the mapping, valid while the store is open
+    };
+
+    // Creates dir if needed and recovers what it holds. nullptr, with
+    // errno set, on failure.
+    static std::unique_ptr<MessageStore> Open(const std::string& dir, const StoreOptions& options);
+
+    ~MessageStore();
+    MessageStore(const MessageStore&) = delete;
+    MessageStore& operator=(const MessageStore&) = delete;
+
+    // The new message's sequence number; 0 if it cannot be stored.
+    uint64_t Append(Kind kind, std::string_view target, std::string_view frame);
+
+    // Up to limit of login's queued messages, oldest first. They stay
+    // queued until MarkDelivered.
+    std::vector<Entry> Queued(std::string_view login, size_t limit);
+    size_t QueuedCount(std::string_view login);
+    // login's queued messages up to seq were delivered.
+    void MarkDelivered(std::string_view login, uint64_t seq);
+    // Up to limit messages with seq > since, oldest first: the private
+    // messages login received, or the messages posted to group.
+    std::vector<Entry> Inbox(std::string_view login, uint64_t since, size_t limit);
+    std::vector<Entry> GroupHistory(std::string_view group, uint64_t since, size_t limit);
+
+    // A timerfd; when readable, call Sync.
+    int SyncFd() const { return timerFd_; }
+    void Sync();
+
+    uint64_t LastSeq() const;
+    size_t Segments() const;
+
+private:
+    struct Segment {
+        uint64_t firstSeq;
+        int fd;
+        char* base;
+        size_t size;
+        size_t used;
+    };
+    struct Ref {
+        uint64_t seq;
+        uint32_t segment;
+        uint32_t offset;
+    };
+
+    MessageStore() = default;
+    bool Recover();
+    bool MapSegment(const std::string& path, uint64_t firstSeq, bool create);
+    bool AddSegment();
+    void Index(const char* record, uint32_t segment, uint32_t offset);
+    Entry At(const Ref& ref) const;
+    std::vector<Entry> Range(const std::vector<std::vector<Ref>>& index, NameId id, uint64_t since, size_t limit) const;
+    uint64_t AppendLocked(Kind kind, std::string_view target, std::string_view frame);
+    void ArmSync();
+
+    std::string dir_;
+    StoreOptions options_;
+    int dirFd_ = -1;
+    int timerFd_ = -1;
+
+    mutable std::mutex mu_;
+    std::vector<Segment> segments_;  // the last one takes appends
+    uint64_t nextSeq_ = 1;
+    size_t unsynced_ = 0;
+    bool syncArmed_ = false;
+
+    Interner logins_;
+    Interner groups_;
+    std::vector<std::vector<Ref>> inbox_;   // by login id
+    std::vector<std::vector<Ref>> queued_;  // by login id
+    std::vector<std::vector<Ref>> posts_;   // by group id
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+// Unbounded lock-free multi-producer single-consumer queue (Vyukov's
+// linked list). Push is one exchange plus one store and never waits for
+// other producers or the consumer. Items from one producer come out in the
+// order it pushed them.
+//
+// A push that has done its exchange but not yet linked its node hides it,
+// and everything pushed after it, from Pop until it finishes; Pop returns
+// false meanwhile, as for an empty queue.
+template <class T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(new Node()), tail_(head_.load()) {}
+    ~MpscQueue() {
+        while (tail_) {
+            Node* next = tail_->next.load(std::memory_order_relaxed);
+            delete tail_;
+            tail_ = next;
+        }
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread.
+    void Push(T value) {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer thread only. tail_ is a spent node whose successor holds the
+    // oldest item; after the pop that successor is the spent node.
+    bool Pop(T& out) {
+        Node* next = tail_->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        out = std::move(next->value);
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node*> head_;  // last pushed
+    Node* tail_;               // consumer side
+};
+
+// An MpscQueue with an eventfd doorbell, so the consumer can wait for it
+// in a reactor next to its other fds. Producers ring only when the
+// consumer has taken the last ring, so a burst of posts costs one write().
+template <class T>
+class Inbox {
+public:
+    ~Inbox() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool Open() {
+        fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return fd_ >= 0;
+    }
+    int Fd() const { return fd_; }
+
+    // Any thread.
+    void Post(T value) {
+        queue_.Push(std::move(value));
+        if (!rung_.exchange(true, std::memory_order_acq_rel)) {
+            uint64_t one = 1;
+            (void)!write(fd_, &one, sizeof(one));
+        }
+    }
+
+    // Consumer thread, when Fd() is readable. The ring is taken before the
+    // queue is read, so an item pushed after the last Pop rings again.
+    template <class Handler>
+    void Drain(Handler handle) {
+        uint64_t count;
+        (void)!read(fd_, &count, sizeof(count));
+        rung_.exchange(false, std::memory_order_acq_rel);
+        T value;
+        while (queue_.Pop(value)) handle(value);
+    }
+
+private:
+    MpscQueue<T> queue_;
+    std::atomic<bool> rung_{false};
+    int fd_ = -1;
+};
@@ -0,0 +1,78 @@
+#include "outbox.hpp"
+
+#include <sys/uio.h>
+#include <errno.h>
+
+#include <algorithm>
+
+#include "shm_channel.hpp"
+
+bool Outbox::Push(Payload msg, const OutboxLimits& limits) {
+    if (throttled_ || bytes_ + msg->size() > limits.highWater) {
+        throttled_ = true;
+        ++dropped_;
+        return false;
+    }
+    bytes_ += msg->size();
+    peakBytes_ = std::max(peakBytes_, bytes_);
+    msgs_.push_back(std::move(msg));
+    return true;
+}
+
+Outbox::FlushResult Outbox::Flush(int fd, const OutboxLimits& limits) {
+    FlushResult result = FlushResult::Drained;
+    iovec iov[kMaxIov];
+    while (!msgs_.empty()) {
+        int count = 0;
+        for (auto it = msgs_.begin(); it != msgs_.end() && count < kMaxIov; ++it, ++count) {
+            size_t skip = count == 0 ? headOffset_ : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+            iov[count].iov_len = (*it)->size() - skip;
+        }
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::Blocked : FlushResult::Error;
+            break;
+        }
+        bytes_ -= (size_t)n;
+        // Retire the messages written in full; keep the offset into the
+        // first one that was not.
+        size_t left = (size_t)n + headOffset_;
+        while (!msgs_.empty() && left >= msgs_.front()->size()) {
+            left -= msgs_.front()->size();
+            msgs_.pop_front();
+            ++sent_;
+        }
+        headOffset_ = left;
+    }
+    if (throttled_ && bytes_ <= limits.lowWater) throttled_ = false;
+    return result;
+}
+
+Outbox::FlushResult Outbox::Flush(ByteRing& ring, const OutboxLimits& limits) {
+    FlushResult result = FlushResult::Drained;
+    while (!msgs_.empty()) {
+        const std::string& msg = *msgs_.front();
+        size_t n = ring.Write(msg.data() + headOffset_, msg.size() - headOffset_);
+        bytes_ -= n;
+        headOffset_ += n;
+        if (headOffset_ < msg.size()) {
+            result = FlushResult::Blocked;
+            break;
+        }
+        msgs_.pop_front();
+        headOffset_ = 0;
+        ++sent_;
+    }
+    if (throttled_ && bytes_ <= limits.lowWater) throttled_ = false;
+    return result;
+}
+
+void Outbox::Clear() {
+    dropped_ += msgs_.size();
+    msgs_.clear();
+    headOffset_ = 0;
+    bytes_ = 0;
+    throttled_ = false;
+}
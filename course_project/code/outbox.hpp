@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+class ByteRing;
+
+// One serialised message line. Immutable once built, so a group broadcast
+// builds it once and every member's outbox holds the same buffer.
+using Payload = std::shared_ptr<const std::string>;
+
+inline Payload MakePayload(std::string line) {
+    return std::make_shared<const std::string>(std::move(line));
+}
+
+enum class SlowClientPolicy { Drop, Disconnect };
+
+struct OutboxLimits {
+    size_t highWater = 1 << 20;
+    size_t lowWater = 256 << 10;
+    SlowClientPolicy policy = SlowClientPolicy::Drop;
+};
+
+// Messages accepted for one client but not yet written to its FIFO (or
+// its shared-memory ring).
+//
+// A message that would take the queue past highWater is refused and the
+// outbox becomes throttled: it refuses everything until flushing brings it
+// down to lowWater. What happens to a throttled client is the caller's
+// policy.
+class Outbox {
+public:
+    enum class FlushResult { Drained, Blocked, Error };
+
+    // false if the message was refused.
+    bool Push(Payload msg, const OutboxLimits& limits);
+    // Writes until the queue is empty or fd would block, gathering up to
+    // kMaxIov queued messages per writev.
+    FlushResult Flush(int fd, const OutboxLimits& limits);
+    // The same into a shared-memory delivery ring: copies until the queue
+    // is empty (Drained) or the ring is full (Blocked).
+    FlushResult Flush(ByteRing& ring, const OutboxLimits& limits);
+    // Drops everything queued, e.g. when the reader went away.
+    void Clear();
+
+    bool Empty() const { return msgs_.empty(); }
+    bool Throttled() const { return throttled_; }
+    size_t Bytes() const { return bytes_; }
+    size_t Messages() const { return msgs_.size(); }
+    size_t PeakBytes() const { return peakBytes_; }
+    uint64_t Sent() const { return sent_; }
+    uint64_t Dropped() const { return dropped_; }
+
+    static constexpr int kMaxIov = 64;
+
+private:
+    std::deque<Payload> msgs_;
+    size_t headOffset_ = 0;  // bytes of msgs_.front() already written
+    size_t bytes_ = 0;       // not yet written
+    size_t peakBytes_ = 0;
+    uint64_t sent_ = 0;
+    uint64_t dropped_ = 0;
+    bool throttled_ = false;
+};
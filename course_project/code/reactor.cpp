@@ -0,0 +1,143 @@
+#include "reactor.hpp"
+
+#include <sys/epoll.h>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdio>
+
+#include "trace.hpp"
+
+bool Reactor::Add(int fd, std::function<void()> onReadable) {
+    return AddWatch(fd, false, std::move(onReadable));
+}
+
+bool Reactor::AddWritable(int fd, std::function<void()> onWritable) {
+    return AddWatch(fd, true, std::move(onWritable));
+}
+
+bool Reactor::AddWatch(int fd, bool writable, std::function<void()> onReady) {
+    if (watches_.count(fd)) return false;
+    auto w = std::make_unique<Watch>();
+    w->fd = fd;
+    w->onReady = std::move(onReady);
+    w->writable = writable;
+    if (!Register(*w)) return false;
+    watches_.emplace(fd, std::move(w));
+    return true;
+}
+
+void Reactor::Remove(int fd) {
+    auto it = watches_.find(fd);
+    if (it == watches_.end()) return;
+    Unregister(*it->second);
+    it->second->removed = true;
+    // The watch may still sit in ready_ or be running right now.
+    retired_.push_back(std::move(it->second));
+    watches_.erase(it);
+}
+
+bool Reactor::RunOnce() {
+    ready_.clear();
+    {
+        TRACE_SCOPE("wait");
+        if (!Wait(ready_)) return false;
+    }
+    TRACE_SCOPE("dispatch");
+    for (Watch* w : ready_) {
+        if (!w->removed) w->onReady();
+    }
+    retired_.clear();
+    return true;
+}
+
+namespace {
+
+class EpollReactor : public Reactor {
+public:
+    explicit EpollReactor(int epfd) : epfd_(epfd) {}
+    ~EpollReactor() override { close(epfd_); }
+
+protected:
+    bool Register(Watch& w) override {
+        epoll_event ev{};
+        ev.events = (w.writable ? EPOLLOUT : EPOLLIN) | EPOLLET;
+        ev.data.ptr = &w;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, w.fd, &ev) == 0) return true;
+        std::perror("epoll_ctl(ADD)");
+        return false;
+    }
+
+    void Unregister(Watch& w) override {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, w.fd, nullptr);
+    }
+
+    bool Wait(std::vector<Watch*>& ready) override {
+        epoll_event events[256];
+        int n = epoll_wait(epfd_, events, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) return true;
+            std::perror("epoll_wait");
+            return false;
+        }
+        for (int i = 0; i < n; ++i) {
+            ready.push_back(static_cast<Watch*>(events[i].data.ptr));
+        }
+        return true;
+    }
+
+private:
+    int epfd_;
+};
+
+class PollReactor : public Reactor {
+protected:
+    bool Register(Watch& w) override {
+        w.slot = fds_.size();
+        fds_.push_back(pollfd{w.fd, (short)(w.writable ? POLLOUT : POLLIN), 0});
+        owners_.push_back(&w);
+        return true;
+    }
+
+    // Swap-with-last: the order of fds_ does not matter.
+    void Unregister(Watch& w) override {
+        size_t last = fds_.size() - 1;
+        fds_[w.slot] = fds_[last];
+        owners_[w.slot] = owners_[last];
+        owners_[w.slot]->slot = w.slot;
+        fds_.pop_back();
+        owners_.pop_back();
+    }
+
+    bool Wait(std::vector<Watch*>& ready) override {
+        int rc = poll(fds_.data(), fds_.size(), -1);
+        if (rc < 0) {
+            if (errno == EINTR) return true;
+            std::perror("poll");
+            return false;
+        }
+        for (size_t i = 0; i < fds_.size() && rc > 0; ++i) {
+            if (fds_[i].revents == 0) continue;
+            --rc;
+            if (fds_[i].revents & (fds_[i].events | POLLHUP | POLLERR)) ready.push_back(owners_[i]);
+        }
+        return true;
+    }
+
+private:
+    std::vector<pollfd> fds_;
+    std::vector<Watch*> owners_;  // parallel to fds_
+};
+
+}  // namespace
+
+std::unique_ptr<Reactor> Reactor::Create(Backend backend) {
+    if (backend == Backend::Poll) return std::make_unique<PollReactor>();
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        std::perror("epoll_create1");
+        return nullptr;
+    }
+    return std::make_unique<EpollReactor>(epfd);
+}
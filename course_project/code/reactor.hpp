@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Persistent readiness registrations with per-fd handlers, for reading or
+// for writing.
+//
+// Handlers must drain their fd (read or write until EAGAIN): the epoll
+// backend is edge-triggered and reports a fd again only when new data or
+// buffer space arrives. The
+// poll backend is level-triggered and keeps its pollfd array between waits,
+// rebuilding nothing unless a fd was added or removed.
+//
+// Add and Remove may be called from inside a handler. A fd removed while
+// its readiness is still pending in the current batch is not dispatched,
+// even if the fd number is reused by a new registration right away. Call
+// Remove before closing the fd.
+class Reactor {
+public:
+    enum class Backend { Epoll, Poll };
+
+    // nullptr if the backend cannot be set up.
+    static std::unique_ptr<Reactor> Create(Backend backend);
+
+    virtual ~Reactor() = default;
+
+    bool Add(int fd, std::function<void()> onReadable);
+    // Level-triggered backends report a writable fd on every wait: remove
+    // it once there is nothing left to write.
+    bool AddWritable(int fd, std::function<void()> onWritable);
+    void Remove(int fd);
+
+    // Blocks with no timeout until some fd is readable or a signal arrives,
+    // then runs the handlers. Returns false on a wait error other than EINTR.
+    bool RunOnce();
+
+protected:
+    struct Watch {
+        int fd;
+        std::function<void()> onReady;
+        bool writable = false;
+        bool removed = false;
+        size_t slot = 0;  // backend bookkeeping
+    };
+
+    virtual bool Register(Watch& w) = 0;
+    virtual void Unregister(Watch& w) = 0;
+    // Appends the watches that are ready; leaves ready empty on EINTR.
+    virtual bool Wait(std::vector<Watch*>& ready) = 0;
+
+private:
+    bool AddWatch(int fd, bool writable, std::function<void()> onReady);
+
+    std::unordered_map<int, std::unique_ptr<Watch>> watches_;
+    std::vector<std::unique_ptr<Watch>> retired_;  // removed during dispatch
+    std::vector<Watch*> ready_;
+};
@@ -0,0 +1,115 @@
+#include "registry.hpp"
+
+#include <algorithm>
+
+Client* Registry::FindClient(std::string_view login) {
+    return FindClient(logins_.Find(login));
+}
+
+Client* Registry::FindClient(NameId login) {
+    auto it = clients_.find(login);
+    return it == clients_.end() ? nullptr : &it->second;
+}
+
+Client& Registry::AddClient(std::string_view login) {
+    NameId id = logins_.Intern(login);
+    Client& c = clients_[id];
+    c.id = id;
+    c.login = std::string(login);
+    c.fdWrite = -1;
+    c.out = Outbox();
+    c.watchingWrite = false;
+    c.flushQueued = false;
+    c.evicted = false;
+    c.binary = false;
+    c.backlog = false;
+    c.shm.reset();
+    return c;
+}
+
+void Registry::RemoveClient(NameId login) {
+    clients_.erase(login);
+}
+
+Group* Registry::FindGroup(std::string_view name) {
+    return FindGroup(groupNames_.Find(name));
+}
+
+Group* Registry::FindGroup(NameId name) {
+    auto it = groups_.find(name);
+    return it == groups_.end() ? nullptr : &it->second;
+}
+
+Group& Registry::AddGroup(std::string_view name) {
+    NameId id = groupNames_.Intern(name);
+    Group& g = groups_[id];
+    g.id = id;
+    g.name = std::string(name);
+    g.fdRead = -1;
+    g.fdDummyWrite = -1;
+    g.ring.reset();
+    return g;
+}
+
+void Registry::RemoveGroup(NameId name) {
+    auto it = groups_.find(name);
+    if (it == groups_.end()) return;
+    for (NameId login : it->second.members) {
+        auto& list = groupsOf_[login];
+        list.erase(std::find(list.begin(), list.end(), name));
+    }
+    groups_.erase(it);
+}
+
+bool Registry::IsMember(const Group& g, std::string_view login) const {
+    NameId id = logins_.Find(login);
+    return id != kNoName && g.memberSlot.count(id) != 0;
+}
+
+void Registry::Join(Group& g, std::string_view login, uint32_t readerSlot) {
+    NameId id = logins_.Intern(login);
+    auto [it, added] = g.memberSlot.emplace(id, g.members.size());
+    if (!added) {
+        uint32_t& current = g.readerSlots[it->second];
+        if (current != readerSlot && g.ring) g.ring->FreeSlot(current);
+        current = readerSlot;
+        return;
+    }
+    g.members.push_back(id);
+    g.readerSlots.push_back(readerSlot);
+    groupsOf_[id].push_back(g.id);
+}
+
+// Swap-with-last removal: member order is not preserved.
+void Registry::Unlink(Group& g, NameId login) {
+    auto it = g.memberSlot.find(login);
+    if (it == g.memberSlot.end()) return;
+    size_t slot = it->second;
+    if (g.ring) g.ring->FreeSlot(g.readerSlots[slot]);
+    NameId last = g.members.back();
+    g.members[slot] = last;
+    g.readerSlots[slot] = g.readerSlots.back();
+    g.memberSlot[last] = slot;
+    g.members.pop_back();
+    g.readerSlots.pop_back();
+    g.memberSlot.erase(login);
+}
+
+void Registry::Leave(Group& g, std::string_view login) {
+    NameId id = logins_.Find(login);
+    if (id == kNoName || g.memberSlot.count(id) == 0) return;
+    Unlink(g, id);
+    auto& list = groupsOf_[id];
+    list.erase(std::find(list.begin(), list.end(), g.id));
+}
+
+void Registry::LeaveAllGroups(std::string_view login) {
+    NameId id = logins_.Find(login);
+    if (id == kNoName) return;
+    auto it = groupsOf_.find(id);
+    if (it == groupsOf_.end()) return;
+    for (NameId group : it->second) {
+        Unlink(groups_.at(group), id);
+    }
+    groupsOf_.erase(it);
+}
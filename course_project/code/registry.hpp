@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "group_ring.hpp"
+#include "interner.hpp"
+#include "linebuffer.hpp"
+#include "outbox.hpp"
+#include "shm_channel.hpp"
+
+struct Client {
+    NameId id;
+    std::string login;
+    std::string fifoPath;
+    int fdWrite;
+    Outbox out;
+    bool watchingWrite;  // fdWrite is registered for writability, or shm is
+                         // full and waiting for the client's Ring
+    bool flushQueued;    // in Server::unflushed
+    bool evicted;        // slow; disconnected after the current handler
+    bool binary;         // takes frames rather than text lines
+    bool backlog;        // stored messages still queued for it (DeliverQueued)
+    std::unique_ptr<ShmChannel> shm;  // delivers over its ring instead of fifoPath
+};
+
+struct Group {
+    NameId id;
+    std::string name;
+    std::string fifoPath;
+    int fdRead;
+    int fdDummyWrite;
+    std::vector<NameId> members;                  // logins, connected or not; unordered
+    std::unordered_map<NameId, size_t> memberSlot; // login -> index in members
+    // By index in members: the member's reader slot in ring, or
+    // GroupRing::kNoSlot if it takes group messages over its FIFO.
+    std::vector<uint32_t> readerSlots;
+    std::unique_ptr<GroupRing> ring;  // nullptr: fan-out over FIFOs only
+    LineBuffer readBuf;
+};
+
+// Connected clients and existing groups, keyed by interned login and group
+// name, plus the reverse login -> groups index, so that lookups, joins,
+// leaves and disconnects cost O(1) per group involved instead of scanning
+// every client or member.
+//
+// Clients and groups live in node-based maps: pointers stay valid until
+// the entry is removed.
+class Registry {
+public:
+    Client* FindClient(std::string_view login);
+    Client* FindClient(NameId login);
+    Client& AddClient(std::string_view login);
+    void RemoveClient(NameId login);
+
+    Group* FindGroup(std::string_view name);
+    Group* FindGroup(NameId name);
+    Group& AddGroup(std::string_view name);
+    void RemoveGroup(NameId name);
+
+    bool IsMember(const Group& g, std::string_view login) const;
+    // Joining again replaces the member's reader slot; the old one is freed.
+    void Join(Group& g, std::string_view login, uint32_t readerSlot = GroupRing::kNoSlot);
+    void Leave(Group& g, std::string_view login);
+    void LeaveAllGroups(std::string_view login);
+
+    // Interned, so the view stays valid for the life of the registry.
+    std::string_view LoginName(NameId login) const { return logins_.Name(login); }
+
+    std::unordered_map<NameId, Client>& Clients() { return clients_; }
+    std::unordered_map<NameId, Group>& Groups() { return groups_; }
+
+private:
+    void Unlink(Group& g, NameId login);
+
+    Interner logins_;
+    Interner groupNames_;
+    std::unordered_map<NameId, Client> clients_;
+    std::unordered_map<NameId, Group> groups_;
+    std::unordered_map<NameId, std::vector<NameId>> groupsOf_;  // login -> groups
+};
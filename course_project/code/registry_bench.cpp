@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "registry.hpp"
+
+// Registry operations at server scale: connect, group joins, login lookups,
+// group fan-out resolution (member -> connected client) and disconnects.
+// The same workload runs against the linear vectors im_server used before
+// the Registry, on a sample of the operations, for comparison.
+// Usage: registry_bench [clients] [groups] [groups_per_client]
+//        (default 100000 10000 5)
+
+using Clock = std::chrono::steady_clock;
+
+static double Seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void Report(const char* name, size_t ops, double seconds) {
+    std::cout << "  " << name << ": " << ops << " ops in " << seconds << " s | "
+              << seconds / ops * 1e9 << " ns/op\n";
+}
+
+// The data structures and scans im_server.cpp had before the Registry.
+namespace linear {
+
+struct Client {
+    std::string login;
+};
+
+struct Group {
+    std::string name;
+    std::vector<std::string> members;
+};
+
+static int FindClientIndex(const std::vector<Client>& clients, const std::string& login) {
+    for (int i = 0; i < (int)clients.size(); ++i) {
+        if (clients[i].login == login) return i;
+    }
+    return -1;
+}
+
+static int FindGroupIndex(const std::vector<Group>& groups, const std::string& name) {
+    for (int i = 0; i < (int)groups.size(); ++i) {
+        if (groups[i].name == name) return i;
+    }
+    return -1;
+}
+
+static bool IsMember(const Group& g, const std::string& login) {
+    for (const auto& m : g.members) {
+        if (m == login) return true;
+    }
+    return false;
+}
+
+static void RemoveClientFromAllGroups(std::vector<Group>& groups, const std::string& login) {
+    for (auto& g : groups) {
+        std::vector<std::string> newList;
+        for (auto& m : g.members) {
+            if (m != login) newList.push_back(m);
+        }
+        g.members = std::move(newList);
+    }
+}
+
+}  // namespace linear
+
+struct Workload {
+    std::vector<std::string> logins;
+    std::vector<std::string> groups;
+    std::vector<std::pair<size_t, size_t>> joins;  // (client, group)
+    std::vector<size_t> lookups;                   // client indices
+    std::vector<size_t> disconnects;               // client indices
+};
+
+static Workload MakeWorkload(size_t clients, size_t groups, size_t perClient) {
+    Workload w;
+    std::mt19937 rng(207);
+    for (size_t i = 0; i < clients; ++i) w.logins.push_back("user" + std::to_string(i));
+    for (size_t i = 0; i < groups; ++i) w.groups.push_back("group" + std::to_string(i));
+    std::uniform_int_distribution<size_t> pickGroup(0, groups - 1);
+    std::uniform_int_distribution<size_t> pickClient(0, clients - 1);
+    for (size_t c = 0; c < clients; ++c) {
+        for (size_t k = 0; k < perClient; ++k) w.joins.emplace_back(c, pickGroup(rng));
+    }
+    std::shuffle(w.joins.begin(), w.joins.end(), rng);
+    for (size_t i = 0; i < 1000000; ++i) w.lookups.push_back(pickClient(rng));
+    for (size_t i = 0; i < clients / 10; ++i) w.disconnects.push_back(pickClient(rng));
+    return w;
+}
+
+static void RunRegistry(const Workload& w) {
+    std::cout << "Registry\n";
+    Registry reg;
+
+    auto start = Clock::now();
+    for (const auto& login : w.logins) reg.AddClient(login);
+    for (const auto& name : w.groups) reg.AddGroup(name);
+    Report("connect + create group", w.logins.size() + w.groups.size(), Seconds(start));
+
+    start = Clock::now();
+    for (const auto& [c, g] : w.joins) reg.Join(*reg.FindGroup(w.groups[g]), w.logins[c]);
+    Report("join", w.joins.size(), Seconds(start));
+
+    start = Clock::now();
+    size_t found = 0;
+    for (size_t c : w.lookups) found += reg.FindClient(w.logins[c]) != nullptr;
+    Report("find client", w.lookups.size(), Seconds(start));
+
+    start = Clock::now();
+    size_t delivered = 0;
+    size_t visited = 0;
+    for (auto& [id, g] : reg.Groups()) {
+        for (NameId member : g.members) {
+            delivered += reg.FindClient(member) != nullptr;
+        }
+        visited += g.members.size();
+    }
+    Report("fan-out member -> client", visited, Seconds(start));
+
+    start = Clock::now();
+    for (size_t c : w.disconnects) {
+        if (Client* client = reg.FindClient(w.logins[c])) reg.RemoveClient(client->id);
+        reg.LeaveAllGroups(w.logins[c]);
+    }
+    Report("disconnect", w.disconnects.size(), Seconds(start));
+    std::cout << "  (found " << found << ", delivered " << delivered << ")\n";
+}
+
+// Operation counts are cut down so the quadratic parts finish; per-op
+// times are what to compare.
+static void RunLinear(const Workload& w) {
+    std::cout << "linear vectors (before)\n";
+    std::vector<linear::Client> clients;
+    std::vector<linear::Group> groups;
+
+    auto start = Clock::now();
+    for (const auto& login : w.logins) clients.push_back(linear::Client{login});
+    for (const auto& name : w.groups) groups.push_back(linear::Group{name, {}});
+    Report("connect + create group", w.logins.size() + w.groups.size(), Seconds(start));
+
+    // Fill the groups directly, then time a sample of joins through the scans.
+    size_t sample = std::min<size_t>(2000, w.joins.size());
+    for (size_t i = sample; i < w.joins.size(); ++i) {
+        groups[w.joins[i].second].members.push_back(w.logins[w.joins[i].first]);
+    }
+    start = Clock::now();
+    for (size_t i = 0; i < sample; ++i) {
+        const auto& [c, g] = w.joins[i];
+        int gi = linear::FindGroupIndex(groups, w.groups[g]);
+        if (!linear::IsMember(groups[gi], w.logins[c])) groups[gi].members.push_back(w.logins[c]);
+    }
+    Report("join", sample, Seconds(start));
+
+    sample = std::min<size_t>(2000, w.lookups.size());
+    start = Clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < sample; ++i) found += linear::FindClientIndex(clients, w.logins[w.lookups[i]]) >= 0;
+    Report("find client", sample, Seconds(start));
+
+    // One FindClientIndex per member, over the first groups only.
+    start = Clock::now();
+    size_t visited = 0;
+    for (size_t g = 0; g < groups.size() && visited < 2000; ++g) {
+        for (const auto& member : groups[g].members) {
+            found += linear::FindClientIndex(clients, member) >= 0;
+        }
+        visited += groups[g].members.size();
+    }
+    Report("fan-out member -> client", visited, Seconds(start));
+
+    sample = std::min<size_t>(20, w.disconnects.size());
+    start = Clock::now();
+    for (size_t i = 0; i < sample; ++i) {
+        const std::string& login = w.logins[w.disconnects[i]];
+        int idx = linear::FindClientIndex(clients, login);
+        if (idx >= 0) {
+            clients[idx] = clients.back();
+            clients.pop_back();
+        }
+        linear::RemoveClientFromAllGroups(groups, login);
+    }
+    Report("disconnect", sample, Seconds(start));
+    std::cout << "  (found " << found << ")\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t clients = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    size_t groups = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000;
+    size_t perClient = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 5;
+    if (clients == 0 || groups == 0) {
+        std::cerr << "usage: " << argv[0] << " [clients] [groups] [groups_per_client]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << clients << " clients, " << groups << " groups, " << perClient << " groups per client\n";
+    Workload w = MakeWorkload(clients, groups, perClient);
+    RunRegistry(w);
+    RunLinear(w);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "shm_channel.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Positions count bytes ever written and read, so head == tail is empty
+// and head - tail == size is full. Each is written by one side only and
+// sits on its own cache line.
+struct RingControl {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> readerWaiting;
+    std::atomic<uint32_t> writerWaiting;
+};
+
+namespace {
+
+constexpr uint32_t kMagic = 0x494d5348;  // "IMSH"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 4096;
+
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t commandBytes;
+    uint32_t deliveryBytes;
+    std::atomic<uint32_t> serverReading;
+    RingControl toServer;
+    RingControl toClient;
+};
+
+static_assert(sizeof(ShmHeader) <= kHeaderBytes, "header must fit its page");
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "ring words are shared between processes");
+
+bool PowerOfTwo(size_t n) { return n != 0 && (n & (n - 1)) == 0; }
+
+}  // namespace
+
+ByteRing::ByteRing(RingControl* control, char* data, size_t size)
+    : control_(control), data_(data), mask_(size - 1) {}
+
+// The other side is another process: a position it wrote is clamped, so
+// a bad one cannot make a copy run outside the ring.
+size_t ByteRing::Write(const char* p, size_t n) {
+    uint64_t head = control_->head.load(std::memory_order_relaxed);
+    uint64_t tail = control_->tail.load(std::memory_order_acquire);
+    uint64_t used = std::min<uint64_t>(head - tail, mask_ + 1);
+    n = std::min<size_t>(n, mask_ + 1 - used);
+    if (n == 0) return 0;
+    size_t at = head & mask_;
+    size_t first = std::min(n, mask_ + 1 - at);
+    std::memcpy(data_ + at, p, first);
+    std::memcpy(data_, p + first, n - first);
+    control_->head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+size_t ByteRing::ReadInto(LineBuffer& buf) {
+    uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+    uint64_t head = control_->head.load(std::memory_order_acquire);
+    size_t n = std::min<uint64_t>(head - tail, mask_ + 1);
+    if (n == 0) return 0;
+    size_t at = tail & mask_;
+    size_t first = std::min(n, mask_ + 1 - at);
+    buf.Append(data_ + at, first);
+    buf.Append(data_, n - first);
+    control_->tail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+// Each sleep/wake pair is a store then a load on both sides, with a full
+// fence between: either the waker sees the waiting word, or the sleeper
+// sees the position that was just published.
+bool ByteRing::ReaderSleep() {
+    control_->readerWaiting.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (control_->head.load(std::memory_order_relaxed) == control_->tail.load(std::memory_order_relaxed))
+        return true;
+    control_->readerWaiting.store(0, std::memory_order_relaxed);
+    return false;
+}
+
+bool ByteRing::TakeReaderWake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (control_->readerWaiting.load(std::memory_order_relaxed) == 0) return false;
+    return control_->readerWaiting.exchange(0, std::memory_order_acq_rel) == 1;
+}
+
+bool ByteRing::WriterSleep() {
+    control_->writerWaiting.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (control_->head.load(std::memory_order_relaxed) - control_->tail.load(std::memory_order_relaxed) > mask_)
+        return true;
+    control_->writerWaiting.store(0, std::memory_order_relaxed);
+    return false;
+}
+
+bool ByteRing::TakeWriterWake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (control_->writerWaiting.load(std::memory_order_relaxed) == 0) return false;
+    return control_->writerWaiting.exchange(0, std::memory_order_acq_rel) == 1;
+}
+
+std::atomic<uint32_t>& ByteRing::ReaderWaiting() { return control_->readerWaiting; }
+std::atomic<uint32_t>& ByteRing::WriterWaiting() { return control_->writerWaiting; }
+
+// Not FUTEX_PRIVATE_FLAG: the words live in a MAP_SHARED mapping and the
+// other side is another process.
+void FutexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>& word, int sleepers) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, sleepers, nullptr, nullptr, 0);
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Create(const char* name) {
+    size_t size = kHeaderBytes + kCommandRingBytes + kDeliveryRingBytes;
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return nullptr;
+    if (ftruncate(fd, (off_t)size) < 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmChannel> ch(new ShmChannel());
+    ch->fd_ = fd;
+    if (!ch->Map(fd, size)) return nullptr;
+    // The memfd starts zeroed: empty rings, nobody waiting.
+    auto* h = static_cast<ShmHeader*>(ch->base_);
+    h->magic = kMagic;
+    h->version = kVersion;
+    h->commandBytes = kCommandRingBytes;
+    h->deliveryBytes = kDeliveryRingBytes;
+    if (!ch->Bind()) return nullptr;
+    return ch;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Attach(std::string_view spec) {
+    std::string s(spec);
+    char* end = nullptr;
+    long pid = std::strtol(s.c_str(), &end, 10);
+    if (end == s.c_str() || *end != ':' || pid <= 0) return nullptr;
+    const char* fdText = end + 1;
+    long remoteFd = std::strtol(fdText, &end, 10);
+    if (end == fdText || *end != '\0' || remoteFd < 0) return nullptr;
+
+    std::string path = "/proc/" + std::to_string(pid) + "/fd/" + std::to_string(remoteFd);
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    // Unless it cannot shrink, the client could truncate it under our
+    // mapping and the next ring access would raise SIGBUS.
+    int seals = fcntl(fd, F_GET_SEALS);
+    struct stat st;
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) < 0 || (size_t)st.st_size < kHeaderBytes) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmChannel> ch(new ShmChannel());
+    bool mapped = ch->Map(fd, (size_t)st.st_size);
+    close(fd);  // the mapping keeps the memfd alive
+    if (!mapped || !ch->Bind()) return nullptr;
+    return ch;
+}
+
+bool ShmChannel::Map(int fd, size_t size) {
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    base_ = base;
+    size_ = size;
+    return true;
+}
+
+// Checks the header against the mapping and points the rings into it.
+bool ShmChannel::Bind() {
+    auto* h = static_cast<ShmHeader*>(base_);
+    if (h->magic != kMagic || h->version != kVersion || !PowerOfTwo(h->commandBytes) ||
+        !PowerOfTwo(h->deliveryBytes) || kHeaderBytes + h->commandBytes + h->deliveryBytes != size_)
+        return false;
+
+    char* data = static_cast<char*>(base_) + kHeaderBytes;
+    toServer_ = ByteRing(&h->toServer, data, h->commandBytes);
+    toClient_ = ByteRing(&h->toClient, data + h->commandBytes, h->deliveryBytes);
+    return true;
+}
+
+ShmChannel::~ShmChannel() {
+    if (base_) munmap(base_, size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+std::string ShmChannel::Spec() const {
+    return std::to_string(getpid()) + ":" + std::to_string(fd_);
+}
+
+bool ShmChannel::ServerReading() const {
+    return static_cast<const ShmHeader*>(base_)->serverReading.load(std::memory_order_acquire) != 0;
+}
+
+void ShmChannel::SetServerReading() {
+    static_cast<ShmHeader*>(base_)->serverReading.store(1, std::memory_order_release);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "linebuffer.hpp"
+
+// Shared-memory transport between one im_client and im_server: a memfd
+// holding two single-producer single-consumer byte rings, commands to the
+// server and deliveries to the client. Each ring carries exactly the bytes
+// the FIFO would (text lines and frames), so both ends parse them with
+// ConsumeMessages; the bytes never pass through the kernel.
+//
+// The client creates the memfd and names it in CONNECT as "<pid>:<fd>";
+// the server maps it through /proc/<pid>/fd/<fd>. Either side that cannot
+// keeps using the FIFOs. The memfd's size is sealed, so a client cannot
+// shrink it under the server's mapping and have the server die of SIGBUS.
+//
+// A reader that finds its ring empty, and a writer that finds it full,
+// say so in a waiting word before they sleep; the other side wakes them
+// only when that word is set, so a busy ring costs no syscalls. The client
+// sleeps on the words with futex(2). The server sleeps in its reactor, so
+// the client wakes it with a Ring doorbell on the command FIFO instead.
+
+struct RingControl;
+
+class ByteRing {
+public:
+    ByteRing() = default;
+    ByteRing(RingControl* control, char* data, size_t size);
+
+    // Producer. Copies as much of p as fits and returns how much that was.
+    size_t Write(const char* p, size_t n);
+    // Consumer. Moves everything readable into buf; returns the bytes.
+    size_t ReadInto(LineBuffer& buf);
+
+    // Consumer, on finding the ring empty: true if it may now sleep on
+    // ReaderWaiting() (expecting 1); false if data arrived meanwhile.
+    bool ReaderSleep();
+    // Producer, after Write: true, once, if the reader went to sleep.
+    bool TakeReaderWake();
+    // Producer, on finding the ring full; the mirror of ReaderSleep.
+    bool WriterSleep();
+    // Consumer, after ReadInto; the mirror of TakeReaderWake.
+    bool TakeWriterWake();
+
+    std::atomic<uint32_t>& ReaderWaiting();
+    std::atomic<uint32_t>& WriterWaiting();
+
+private:
+    RingControl* control_ = nullptr;
+    char* data_ = nullptr;
+    size_t mask_ = 0;  // size - 1; the size is a power of two
+};
+
+// Sleeps while word == expected (or until woken). Works across processes.
+void FutexWait(std::atomic<uint32_t>& word, uint32_t expected);
+void FutexWake(std::atomic<uint32_t>& word, int sleepers = 1);
+
+class ShmChannel {
+public:
+    static constexpr size_t kCommandRingBytes = 64 << 10;
+    static constexpr size_t kDeliveryRingBytes = 1 << 20;
+
+    // Client side: a new memfd with empty rings. nullptr on failure.
+    static std::unique_ptr<ShmChannel> Create(const char* name);
+    // Server side: maps the memfd a client named in CONNECT. nullptr if
+    // spec is malformed, the fd cannot be opened, its size is not sealed,
+    // or it is not a channel.
+    static std::unique_ptr<ShmChannel> Attach(std::string_view spec);
+
+    ~ShmChannel();
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    // "<pid>:<fd>", for CONNECT.
+    std::string Spec() const;
+
+    ByteRing& ToServer() { return toServer_; }
+    ByteRing& ToClient() { return toClient_; }
+
+    // Set by the server once it reads ToServer(); commands go over the
+    // FIFO until then.
+    bool ServerReading() const;
+    void SetServerReading();
+
+private:
+    ShmChannel() = default;
+    bool Map(int fd, size_t size);
+    bool Bind();
+
+    int fd_ = -1;  // client side only
+    void* base_ = nullptr;
+    size_t size_ = 0;
+    ByteRing toServer_;
+    ByteRing toClient_;
+};
@@ -0,0 +1,140 @@
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "shm_channel.hpp"
+
+// Server -> client deliveries between two processes, the way im_server
+// feeds a client:
+//
+//   pipe      one write() per message into a pipe, read() in 4 KiB pieces
+//             (the FIFO path)
+//   shm ring  copied into a ShmChannel delivery ring; the reader sleeps on
+//             the futex only when the ring is empty and the writer only
+//             when it is full
+//
+// The reader splits lines either way. Reported per variant: messages per
+// second, and for the ring how often the writer found the reader asleep.
+// Usage: shm_ring_bench [messages] [bytes]   (default 1000000 100)
+
+using Clock = std::chrono::steady_clock;
+
+static std::string Message(size_t bytes) {
+    std::string msg(bytes - 1, 'x');
+    msg.push_back('\n');
+    return msg;
+}
+
+static size_t CountLines(LineBuffer& buf) {
+    size_t lines = 0;
+    std::string_view line;
+    while (buf.NextLine(line)) ++lines;
+    return lines;
+}
+
+static double RunPipe(size_t messages, const std::string& msg) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        std::perror("pipe");
+        std::exit(EXIT_FAILURE);
+    }
+    auto start = Clock::now();
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[1]);
+        LineBuffer buf;
+        size_t lines = 0;
+        while (buf.ReadFrom(fds[0]) > 0) lines += CountLines(buf);
+        _exit(lines == messages ? 0 : 1);
+    }
+    close(fds[0]);
+    for (size_t i = 0; i < messages; ++i) {
+        if (write(fds[1], msg.data(), msg.size()) != (ssize_t)msg.size()) std::perror("write");
+    }
+    close(fds[1]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (status != 0) std::cerr << "  pipe reader lost messages\n";
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double RunRing(size_t messages, const std::string& msg, size_t& wakes) {
+    std::unique_ptr<ShmChannel> ch = ShmChannel::Create("shm_ring_bench");
+    if (!ch) {
+        std::perror("memfd");
+        std::exit(EXIT_FAILURE);
+    }
+    ByteRing& ring = ch->ToClient();
+    size_t total = messages * msg.size();
+
+    auto start = Clock::now();
+    pid_t child = fork();
+    if (child == 0) {
+        // Inherits the mapping. Wakes the writer the way im_client does,
+        // here with a futex as both ends can sleep on one.
+        LineBuffer buf;
+        size_t lines = 0;
+        size_t read = 0;
+        while (read < total) {
+            size_t n = ring.ReadInto(buf);
+            if (n > 0) {
+                read += n;
+                if (ring.TakeWriterWake()) FutexWake(ring.WriterWaiting());
+                lines += CountLines(buf);
+                continue;
+            }
+            if (ring.ReaderSleep()) FutexWait(ring.ReaderWaiting(), 1);
+        }
+        _exit(lines == messages ? 0 : 1);
+    }
+    wakes = 0;
+    for (size_t i = 0; i < messages; ++i) {
+        size_t done = 0;
+        while (done < msg.size()) {
+            size_t n = ring.Write(msg.data() + done, msg.size() - done);
+            done += n;
+            if (ring.TakeReaderWake()) {
+                FutexWake(ring.ReaderWaiting());
+                ++wakes;
+            }
+            if (n == 0 && ring.WriterSleep()) FutexWait(ring.WriterWaiting(), 1);
+        }
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (status != 0) std::cerr << "  ring reader lost messages\n";
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void Report(const char* name, size_t messages, size_t bytes, double seconds) {
+    std::cout << "  " << name << ": " << messages << " messages in " << seconds << " s | "
+              << messages / seconds / 1e6 << " M msgs/s | " << messages * bytes / seconds / (1 << 20)
+              << " MiB/s";
+}
+
+int main(int argc, char* argv[]) {
+    size_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t bytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+    if (messages == 0 || bytes == 0) {
+        std::cerr << "usage: " << argv[0] << " [messages] [bytes]\n";
+        return EXIT_FAILURE;
+    }
+    std::string msg = Message(bytes);
+
+    std::cout << messages << " messages of " << bytes << " bytes\n";
+    Report("pipe", messages, bytes, RunPipe(messages, msg));
+    std::cout << "\n";
+    size_t wakes = 0;
+    double seconds = RunRing(messages, msg, wakes);
+    Report("shm ring", messages, bytes, seconds);
+    std::cout << " | " << wakes << " reader wakes\n";
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "message_store.hpp"
+#include "wire.hpp"
+
+// MessageStore throughput and recovery, in a scratch directory:
+//
+//   append     messages/s and MiB/s with fdatasync per message, batched by
+//              the default StoreOptions, and never (page cache only)
+//   recovery   Open on the batched run's log: scanning every segment and
+//              rebuilding the indexes
+//   history    Inbox and GroupHistory queries of 50 from a random point
+//
+// Messages are private to one of 1000 logins or posts to one of 100 groups,
+// in equal parts, as the frames im_server stores. fdatasync-per-message is
+// run on a tenth of the messages; it is bound by the disk either way.
+// Usage: store_bench [messages] [bytes] [dir]   (default 1000000 100 /tmp/store_bench)
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t kLogins = 1000;
+static const size_t kGroups = 100;
+
+static double Seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void RemoveDir(const std::string& dir) {
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name != "." && name != "..") unlink((dir + "/" + name).c_str());
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+static std::unique_ptr<MessageStore> OpenOrDie(const std::string& dir, const StoreOptions& options) {
+    std::unique_ptr<MessageStore> store = MessageStore::Open(dir, options);
+    if (!store) {
+        std::perror(("open " + dir).c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    return store;
+}
+
+static double RunAppend(const std::string& dir, const StoreOptions& options, size_t messages, size_t bytes) {
+    RemoveDir(dir);
+    std::unique_ptr<MessageStore> store = OpenOrDie(dir, options);
+    std::string text(bytes, 'x');
+    std::string frame;
+    auto start = Clock::now();
+    for (size_t i = 0; i < messages; ++i) {
+        std::string target = (i % 2 ? "user" : "group") + std::to_string(i / 2 % (i % 2 ? kLogins : kGroups));
+        frame.clear();
+        if (i % 2) {
+            AppendFrame(frame, FrameType::Private, {"sender", text});
+            store->Append(MessageStore::Kind::Private, target, frame);
+        } else {
+            AppendFrame(frame, FrameType::GroupMessage, {target, "sender", text});
+            store->Append(MessageStore::Kind::Group, target, frame);
+        }
+    }
+    store->Sync();
+    return Seconds(start);
+}
+
+static void Report(const char* name, size_t messages, size_t bytes, double seconds) {
+    std::cout << "  " << name << ": " << messages << " messages in " << seconds << " s | "
+              << messages / seconds / 1e6 << " M msgs/s | " << messages * bytes / seconds / (1 << 20)
+              << " MiB/s\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t bytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+    std::string dir = argc > 3 ? argv[3] : "/tmp/store_bench";
+    if (messages < 10 || bytes == 0 || bytes > 4000) {
+        std::cerr << "usage: " << argv[0] << " [messages >= 10] [bytes <= 4000] [dir]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << messages << " messages of " << bytes << " bytes in " << dir << "\n";
+    StoreOptions each;
+    each.syncBytes = 1;
+    Report("append, fdatasync each", messages / 10, bytes, RunAppend(dir, each, messages / 10, bytes));
+    StoreOptions never;
+    never.syncBytes = SIZE_MAX;
+    Report("append, no fdatasync", messages, bytes, RunAppend(dir, never, messages, bytes));
+    StoreOptions batched;
+    Report("append, batched", messages, bytes, RunAppend(dir, batched, messages, bytes));
+
+    auto start = Clock::now();
+    std::unique_ptr<MessageStore> store = OpenOrDie(dir, batched);
+    double seconds = Seconds(start);
+    std::cout << "  recovery: " << store->LastSeq() << " records in " << store->Segments() << " segments in "
+              << seconds * 1e3 << " ms | " << store->LastSeq() / seconds / 1e6 << " M records/s\n";
+
+    std::mt19937 rng(1);
+    size_t queries = 100000;
+    size_t found = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < queries; ++i) {
+        uint64_t since = rng() % messages;
+        if (i % 2) {
+            found += store->Inbox("user" + std::to_string(rng() % kLogins), since, 50).size();
+        } else {
+            found += store->GroupHistory("group" + std::to_string(rng() % kGroups), since, 50).size();
+        }
+    }
+    seconds = Seconds(start);
+    std::cout << "  history: " << queries << " queries in " << seconds << " s | " << seconds / queries * 1e6
+              << " us/query | " << found / (double)queries << " messages/query\n";
+
+    store.reset();
+    RemoveDir(dir);
+    return 0;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#include "linebuffer.hpp"
+
+// Framed binary protocol, spoken next to the text one on the same FIFOs.
+//
+// A frame is
+//   u8 kFrameMagic | u8 type | u16 body length | body
+// and the body is its fields back to back, each a u16 length and the
+// bytes. Integers are little-endian. kFrameMagic never starts a text line,
+// so readers tell the two apart by the first byte of each message.
+//
+// A FIFO write of at most PIPE_BUF bytes is atomic. Writers that share a
+// FIFO (the command FIFO, group FIFOs) keep frames within kMaxSharedFrame
+// so frames from different writers never interleave, the same guarantee
+// text lines rely on.
+//
+// A client asks for frames from the server with "CONNECT <login> BINARY"
+// (or a Connect frame). A server that predates frames ignores the extra
+// word and answers in text, which tells the client to stay with text.
+//
+// "CONNECT <login> BINARY|TEXT <pid>:<fd>" also offers shared-memory rings
+// (shm_channel.hpp); the messages on them are the same as on the FIFOs.
+
+constexpr char kFrameMagic = '\x01';
+constexpr size_t kFrameHeader = 4;
+constexpr size_t kMaxSharedFrame = 4096;  // PIPE_BUF
+constexpr int kMaxFields = 4;
+
+enum class FrameType : uint8_t {
+    // client -> server command FIFO
+    Connect = 1,   // login [, "BINARY" | "TEXT" [, shm channel "<pid>:<fd>"]]
+    Disconnect,    // login
+    Send,          // from, to, text
+    CreateGroup,   // from, group
+    DeleteGroup,   // from, group
+    JoinGroup,     // from, group [, "RING": read the group's shared ring]
+    LeaveGroup,    // from, group
+    Stats,         // from
+    // client -> group FIFO
+    GroupPost,     // from, text
+    // server -> client FIFO
+    Notice,        // text
+    Private,       // from, text
+    GroupMessage,  // group, from, text
+    // client -> server command FIFO, doorbell for a shared-memory client:
+    // its command ring has data, or it read from a full delivery ring.
+    // client -> group FIFO: the group ring has messages for the server.
+    Ring,          // login
+    // client -> server command FIFO, with --store: stored messages to
+    // target (the sender's own login, or a group) after seq since
+    History,       // from, target, since, limit
+    // server -> client FIFO, one per message History found
+    HistoryEntry,  // seq, time (ms since the epoch), the message's frame
+};
+
+constexpr uint8_t kLastFrameType = static_cast<uint8_t>(FrameType::HistoryEntry);
+
+// A parsed message, text or binary. Fields point into the read buffer and
+// are only valid until it is consumed.
+struct Frame {
+    FrameType type;
+    int fieldCount = 0;
+    std::string_view fields[kMaxFields];
+    bool binary = false;  // arrived as a frame rather than a text line
+};
+
+// Keyword of the text form of a client -> server message.
+inline const char* TextKeyword(FrameType type) {
+    switch (type) {
+    case FrameType::Connect: return "CONNECT";
+    case FrameType::Disconnect: return "DISCONNECT";
+    case FrameType::Send: return "SEND";
+    case FrameType::CreateGroup: return "CREATEGROUP";
+    case FrameType::DeleteGroup: return "DELETEGROUP";
+    case FrameType::JoinGroup: return "JOINGROUP";
+    case FrameType::LeaveGroup: return "LEAVEGROUP";
+    case FrameType::Stats: return "STATS";
+    case FrameType::GroupPost: return "MSG";
+    case FrameType::Ring: return "RING";
+    case FrameType::History: return "HISTORY";
+    default: return nullptr;
+    }
+}
+
+// Appends one frame to out. false, with out untouched, if a field or the
+// body does not fit a u16 length or there are too many fields.
+inline bool AppendFrame(std::string& out, FrameType type, std::initializer_list<std::string_view> fields) {
+    if (fields.size() > (size_t)kMaxFields) return false;
+    size_t body = 0;
+    for (std::string_view f : fields) {
+        if (f.size() > 0xFFFF) return false;
+        body += 2 + f.size();
+    }
+    if (body > 0xFFFF) return false;
+
+    out.reserve(out.size() + kFrameHeader + body);
+    out.push_back(kFrameMagic);
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(body & 0xFF));
+    out.push_back(static_cast<char>(body >> 8));
+    for (std::string_view f : fields) {
+        out.push_back(static_cast<char>(f.size() & 0xFF));
+        out.push_back(static_cast<char>(f.size() >> 8));
+        out.append(f.data(), f.size());
+    }
+    return true;
+}
+
+enum class FrameDecode { Ok, Incomplete, Bad };
+
+inline uint16_t ReadU16(const char* p) {
+    return static_cast<uint16_t>(static_cast<uint8_t>(p[0]) | static_cast<uint8_t>(p[1]) << 8);
+}
+
+// Decodes the frame at the start of in, which begins with kFrameMagic.
+// Unless the result is Incomplete, size is set to the bytes the frame
+// occupies, so the caller can skip a Bad one.
+inline FrameDecode DecodeFrame(std::string_view in, Frame& frame, size_t& size) {
+    if (in.size() < kFrameHeader) return FrameDecode::Incomplete;
+    size = kFrameHeader + ReadU16(in.data() + 2);
+    if (in.size() < size) return FrameDecode::Incomplete;
+
+    uint8_t type = static_cast<uint8_t>(in[1]);
+    if (type == 0 || type > kLastFrameType) return FrameDecode::Bad;
+    frame.type = static_cast<FrameType>(type);
+    frame.fieldCount = 0;
+    frame.binary = true;
+
+    size_t pos = kFrameHeader;
+    while (pos < size) {
+        if (frame.fieldCount == kMaxFields || size - pos < 2) return FrameDecode::Bad;
+        size_t len = ReadU16(in.data() + pos);
+        pos += 2;
+        if (size - pos < len) return FrameDecode::Bad;
+        frame.fields[frame.fieldCount++] = in.substr(pos, len);
+        pos += len;
+    }
+    return FrameDecode::Ok;
+}
+
+inline std::string_view NextToken(std::string_view& s) {
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        s = {};
+        return {};
+    }
+    size_t end = s.find_first_of(" \t", start);
+    if (end == std::string_view::npos) end = s.size();
+    std::string_view token = s.substr(start, end - start);
+    s.remove_prefix(end);
+    return token;
+}
+
+// Parses a client -> server text line (without its '\n') into the frame
+// it stands for: "SEND a b some text" is Send{a, b, "some text"}.
+// false for an unknown keyword.
+inline bool ParseTextMessage(std::string_view line, Frame& frame) {
+    while (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+    std::string_view keyword = NextToken(line);
+    uint8_t type = 1;
+    for (; type <= kLastFrameType; ++type) {
+        const char* k = TextKeyword(static_cast<FrameType>(type));
+        if (k && keyword == k) break;
+    }
+    if (type > kLastFrameType) return false;
+    frame.type = static_cast<FrameType>(type);
+    frame.fieldCount = 0;
+    frame.binary = false;
+
+    // Send and GroupPost end with free text: the rest of the line after
+    // one separating space.
+    int words = 2;
+    bool text = false;
+    switch (frame.type) {
+    case FrameType::Connect:
+    case FrameType::JoinGroup: words = 3; break;
+    case FrameType::History: words = 4; break;
+    case FrameType::Disconnect:
+    case FrameType::Stats:
+    case FrameType::Ring: words = 1; break;
+    case FrameType::Send: text = true; break;
+    case FrameType::GroupPost: words = 1; text = true; break;
+    default: break;
+    }
+    for (int i = 0; i < words; ++i) {
+        std::string_view token = NextToken(line);
+        if (token.empty()) break;
+        frame.fields[frame.fieldCount++] = token;
+    }
+    if (text && frame.fieldCount == words) {
+        if (!line.empty() && line[0] == ' ') line.remove_prefix(1);
+        frame.fields[frame.fieldCount++] = line;
+    }
+    return true;
+}
+
+// Hands every complete message at the front of buf to onLine (a text line
+// without its '\n') or onFrame, consuming each. Malformed frames are
+// skipped. Both callbacks see views into buf and must not modify it.
+template <class OnLine, class OnFrame>
+void ConsumeMessages(LineBuffer& buf, OnLine onLine, OnFrame onFrame) {
+    while (!buf.Empty()) {
+        std::string_view rest = buf.Peek();
+        if (rest[0] == kFrameMagic) {
+            Frame frame;
+            size_t size = 0;
+            FrameDecode r = DecodeFrame(rest, frame, size);
+            if (r == FrameDecode::Incomplete) break;
+            if (r == FrameDecode::Ok) onFrame(frame);
+            buf.Consume(size);
+            continue;
+        }
+        size_t nl = buf.FindNewline();
+        if (nl == std::string_view::npos) break;
+        onLine(rest.substr(0, nl));
+        buf.Consume(nl + 1);
+    }
+}
@@ -1,8 +1,10 @@
 #include <iostream>
+#include "trace.hpp"
 
 int main() {
     int x;
     while (std::cin >> x) {
+        TRACE_SCOPE("number");
         if (x < 0) {
             return 0;
         }
@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <cstdlib>
+#include "trace.hpp"
 
 using fd_t = int;
 
@@ -67,6 +68,7 @@ int main() {
 
     char buf[1024];
     while (true) {
+        TRACE_SCOPE("relay");
         ssize_t n = read(pipefd[0], buf, sizeof(buf));
         if (n <= 0) {
             break;
@@ -2,6 +2,7 @@
 #include <vector>
 #include <pthread.h>
 #include "det.hpp"
+#include "trace.hpp"
 
 struct ThreadData {
     int n;
@@ -18,8 +19,11 @@ struct ThreadData {
 
 void* thread_worker(void* arg) {
     ThreadData* data = static_cast<ThreadData*>(arg);
+    TRACE_THREAD_NAME("det worker");
+    TRACE_SCOPE("worker");
     data->result = 0.0L;
     for (int i = data->start_row; i <= data->end_row; ++i) {
+        TRACE_SCOPE("minor");
         long double sub_det = det_single(minor(data->matrix, i, 0));
         data->result += sign(i) * data->matrix[i][0] * sub_det;
     }
@@ -33,6 +37,7 @@ long double det_parallel(const std::vector<std::vector<long double>>& matrix, in
     }
 
     if (num_threads > n) num_threads = n;
+    TRACE_SCOPE("det_parallel");
 
     std::vector<pthread_t> threads(num_threads);
     std::vector<ThreadData*> tdata(num_threads);
@@ -4,6 +4,8 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <cstdlib>
+#include "shared_queue.hpp"
+#include "trace.hpp"
 
 using fd_t = int;
 
@@ -12,6 +14,84 @@ struct SharedData {
     int state;
 };
 
+static void PushOrWait(QueueRegion *region, OutRing *ring, const OutRecord &rec) {
+    unsigned spins = 0;
+    while (!TryPushRecord(ring, rec)) {
+        if (region->shutdown.load(std::memory_order_acquire)) {
+            return;
+        }
+        Backoff(spins);
+    }
+}
+
+static void ProcessBatch(QueueRegion *region, OutRing *ring, const Batch &batch) {
+    TRACE_SCOPE("process_batch");
+    if (static_cast<int64_t>(batch.first) > region->cancel_index.load(std::memory_order_acquire)) {
+        PushOrWait(region, ring, OutRecord{batch.id, 0, kBatchEnd});
+        return;
+    }
+
+    for (uint32_t i = 0; i < batch.count; ++i) {
+        int64_t index = static_cast<int64_t>(batch.first + i);
+        if (index >= region->cancel_index.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        int x = batch.numbers[i];
+        if (x < 0 || (x > 1 && IsPrime(x))) {
+            CancelAt(region, index);
+            PushOrWait(region, ring, OutRecord{batch.id, 0, kBatchStop});
+            return;
+        }
+        if (x > 1) {
+            PushOrWait(region, ring, OutRecord{batch.id, x, kComposite});
+        }
+    }
+    PushOrWait(region, ring, OutRecord{batch.id, 0, kBatchEnd});
+}
+
+static int RunWorker(fd_t map_fd, int child) {
+    struct stat st;
+    if (fstat(map_fd, &st) == -1) {
+        perror("fstat map");
+        return EXIT_FAILURE;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    QueueRegion *region = static_cast<QueueRegion *>(addr);
+    if (child < 0 || child >= static_cast<int>(region->children) ||
+        size < QueueRegionSize(static_cast<int>(region->children))) {
+        munmap(addr, size);
+        return EXIT_FAILURE;
+    }
+    OutRing *ring = ChildRing(region, child);
+
+    unsigned spins = 0;
+    while (!region->shutdown.load(std::memory_order_acquire)) {
+        uint64_t pos;
+        Batch *batch = TryBeginDequeue(region, pos);
+        if (batch) {
+            ProcessBatch(region, ring, *batch);
+            FinishDequeue(region, pos);
+            spins = 0;
+            continue;
+        }
+        if (region->closed.load(std::memory_order_acquire) && QueueDrained(region)) {
+            break;
+        }
+        Backoff(spins);
+    }
+
+    munmap(addr, size);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         return EXIT_FAILURE;
@@ -24,6 +104,12 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    if (argc >= 3) {
+        int rc = RunWorker(map_fd, atoi(argv[2]));
+        close(map_fd);
+        return rc;
+    }
+
     void *addr = mmap(nullptr, sizeof(SharedData), PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
     if (addr == MAP_FAILED) {
         perror("mmap");
@@ -34,9 +120,13 @@ int main(int argc, char *argv[]) {
     SharedData *shared = static_cast<SharedData *>(addr);
 
     while (true) {
-        while (shared->state == 0) {
-            usleep(1000);
+        {
+            TRACE_SCOPE("wait_number");
+            while (shared->state == 0) {
+                usleep(1000);
+            }
         }
+        TRACE_SCOPE("number");
 
         if (shared->state == 2) {
             break;
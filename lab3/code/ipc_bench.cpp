@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "latency_histogram.hpp"
+#include "shared_queue.hpp"
+#include "transport.hpp"
+
+// Usage: ipc_bench [-n items] [-r composite_ratio] [-j children,...] [-m] [-S]
+//   -n  numbers per run (default 5000; the slot transport needs ~1 ms each)
+//   -r  share of composites among them, the rest are 0/1 that need no output
+//   -j  queue transport child counts to run (default 1,2,4)
+//   -m  feed the transports through the mmap scanner instead of fscanf
+//   -S  skip the one-slot usleep baseline
+// Must be started from the build directory, next to ./child.
+
+static const char *kInputFile = "ipc_bench_input.txt";
+
+static bool GenerateInput(size_t items, double composite_ratio) {
+    FILE *f = fopen(kInputFile, "w");
+    if (!f) {
+        perror("fopen");
+        return false;
+    }
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<int> factor(2, 46340);
+    for (size_t i = 0; i < items; ++i) {
+        if (coin(gen) < composite_ratio) {
+            fprintf(f, "%d\n", factor(gen) * factor(gen));
+        } else {
+            fprintf(f, "%d\n", static_cast<int>(i & 1));
+        }
+    }
+    fprintf(f, "-1\n");
+    fclose(f);
+    return true;
+}
+
+struct Usage {
+    long nvcsw;
+    long nivcsw;
+    long minflt;
+};
+
+static Usage TakeUsage() {
+    rusage self{};
+    rusage children{};
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return Usage{self.ru_nvcsw + children.ru_nvcsw, self.ru_nivcsw + children.ru_nivcsw,
+                 self.ru_minflt + children.ru_minflt};
+}
+
+static bool RunOne(const std::string &name, int children, bool use_mmap, size_t items) {
+    int input_fd = open(kInputFile, O_RDONLY);
+    if (input_fd == -1) {
+        perror("open input");
+        return false;
+    }
+    NumberInput input;
+    if (!OpenInput(input_fd, use_mmap, input)) {
+        return false;
+    }
+
+    // Composites are printed by the transport; keep them off the report.
+    std::cout.flush();
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    LatencyHistogram latency;
+    Usage before = TakeUsage();
+    uint64_t start = NowNs();
+    int rc = children > 0 ? RunQueueTransport(input, children, &latency) : RunSlotTransport(input, &latency);
+    uint64_t elapsed = NowNs() - start;
+    Usage after = TakeUsage();
+
+    std::cout.flush();
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    if (rc != EXIT_SUCCESS) {
+        std::cerr << name << ": transport failed\n";
+        return false;
+    }
+
+    double per_item = 1.0 / static_cast<double>(items);
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+              << std::setw(12) << std::setprecision(0) << items / (elapsed / 1e9)
+              << std::setw(10) << std::setprecision(1) << latency.Percentile(50) / 1e3
+              << std::setw(10) << latency.Percentile(99) / 1e3
+              << std::setw(10) << latency.Percentile(99.9) / 1e3
+              << std::setw(10) << latency.Max() / 1e3
+              << std::setw(10) << std::setprecision(4) << (after.nvcsw - before.nvcsw) * per_item
+              << std::setw(10) << (after.nivcsw - before.nivcsw) * per_item
+              << std::setw(10) << (after.minflt - before.minflt) * per_item << "\n";
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    size_t items = 5000;
+    double ratio = 0.5;
+    std::vector<int> child_counts = {1, 2, 4};
+    bool use_mmap = false;
+    bool with_slot = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:j:mS")) != -1) {
+        switch (opt) {
+        case 'n':
+            items = static_cast<size_t>(atoll(optarg));
+            break;
+        case 'r':
+            ratio = atof(optarg);
+            break;
+        case 'j': {
+            child_counts.clear();
+            std::stringstream ss(optarg);
+            std::string part;
+            while (std::getline(ss, part, ',')) {
+                child_counts.push_back(atoi(part.c_str()));
+            }
+            break;
+        }
+        case 'm':
+            use_mmap = true;
+            break;
+        case 'S':
+            with_slot = false;
+            break;
+        default:
+            std::cerr << "usage: " << argv[0] << " [-n items] [-r composite_ratio] [-j children,...] [-m] [-S]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!GenerateInput(items, ratio)) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "items " << items << ", composite ratio " << ratio << ", input "
+              << (use_mmap ? "mmap" : "fscanf") << "\n"
+              << "latency in us, counters per item (getrusage, parent + children)\n";
+    std::cout << std::left << std::setw(12) << "transport" << std::right
+              << std::setw(12) << "items/s" << std::setw(10) << "p50" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::setw(10) << "vcsw"
+              << std::setw(10) << "ivcsw" << std::setw(10) << "minflt" << "\n";
+
+    bool ok = true;
+    if (with_slot) {
+        ok = RunOne("slot", 0, use_mmap, items) && ok;
+    }
+    for (int children : child_counts) {
+        if (children < 1 || children > kMaxChildren) {
+            continue;
+        }
+        ok = RunOne("queue-j" + std::to_string(children), children, use_mmap, items) && ok;
+    }
+
+    unlink(kInputFile);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
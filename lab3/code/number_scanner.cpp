@@ -0,0 +1,166 @@
+#include "number_scanner.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+bool IsSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool IsDigit(unsigned char c) {
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+const char *SkipSpaces(const char *p, const char *end) {
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab_lo = _mm_set1_epi8('\t' - 1);
+    const __m128i cr_hi = _mm_set1_epi8('\r' + 1);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                  _mm_and_si128(_mm_cmpgt_epi8(v, tab_lo), _mm_cmplt_epi8(v, cr_hi)));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && IsSpace(static_cast<unsigned char>(*p))) {
+        ++p;
+    }
+    return p;
+}
+
+size_t DigitRun(const char *p, const char *end) {
+    const char *start = p;
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi8('0' - 1);
+    const __m128i hi = _mm_set1_epi8('9' + 1);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(digits)) & 0xFFFFu;
+        if (mask) {
+            return static_cast<size_t>(p - start) + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && IsDigit(static_cast<unsigned char>(*p))) {
+        ++p;
+    }
+    return static_cast<size_t>(p - start);
+}
+
+// Converts len (1..8) digits starting at p. Reads 8 bytes, so the caller must
+// make sure they are inside the buffer.
+uint32_t ParseDigitsSwar(const char *p, size_t len) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    v -= 0x3030303030303030ull;
+    v <<= 8 * (8 - len);
+    v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFull;
+    v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFull;
+    v = (v * 10000 + (v >> 32)) & 0x00000000FFFFFFFFull;
+    return static_cast<uint32_t>(v);
+}
+
+uint64_t ParseDigits(const char *p, size_t len, const char *end) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (len <= 16 && end - p >= 16) {
+        if (len <= 8) {
+            return ParseDigitsSwar(p, len);
+        }
+        return ParseDigitsSwar(p, len - 8) * 100000000ull + ParseDigitsSwar(p + len - 8, 8);
+    }
+#endif
+    // Long runs saturate like strtol does before fscanf narrows to int.
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        uint64_t digit = static_cast<uint64_t>(p[i] - '0');
+        if (value > (static_cast<uint64_t>(INT64_MAX) - digit) / 10) {
+            return static_cast<uint64_t>(INT64_MAX) + 1;
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+int NarrowLikeScanf(uint64_t magnitude, bool negative) {
+    int64_t value;
+    if (magnitude > static_cast<uint64_t>(INT64_MAX)) {
+        value = negative ? INT64_MIN : INT64_MAX;
+    } else {
+        value = negative ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+    }
+    return static_cast<int>(static_cast<uint32_t>(static_cast<uint64_t>(value)));
+}
+
+}  // namespace
+
+NumberScanner::NumberScanner(const char *begin, const char *end)
+    : begin_(begin), pos_(begin), end_(end), done_(begin == end) {}
+
+size_t NumberScanner::Next(int *out, size_t max) {
+    size_t n = 0;
+    while (n < max && !done_) {
+        const char *p = SkipSpaces(pos_, end_);
+        bool negative = false;
+        if (p < end_ && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            ++p;
+        }
+
+        size_t len = DigitRun(p, end_);
+        if (len == 0) {
+            pos_ = p;
+            done_ = true;
+            break;
+        }
+
+        out[n++] = NarrowLikeScanf(ParseDigits(p, len, end_), negative);
+        pos_ = p + len;
+    }
+    return n;
+}
+
+bool MapFile(int fd, MappedFile &file) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat input");
+        return false;
+    }
+
+    file.size = static_cast<size_t>(st.st_size);
+    if (file.size == 0) {
+        file.data = nullptr;
+        return true;
+    }
+
+    void *addr = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap input");
+        return false;
+    }
+    madvise(addr, file.size, MADV_SEQUENTIAL);
+    file.data = static_cast<const char *>(addr);
+    return true;
+}
+
+void UnmapFile(MappedFile &file) {
+    if (file.data) {
+        munmap(const_cast<char *>(file.data), file.size);
+    }
+    file.data = nullptr;
+    file.size = 0;
+}
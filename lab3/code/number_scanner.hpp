@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+
+// Parses whitespace-separated decimal ints from an in-memory buffer (usually a
+// read-only mapping of the input file) with the same rules as fscanf("%d"):
+// optional sign, digits, stop at the first token that is not a number.
+//
+// Whitespace and digit runs are located 16 bytes at a time with SSE2 where
+// available, and runs of up to 8 digits are converted with one SWAR multiply
+// chain instead of a loop per character.
+class NumberScanner {
+public:
+    NumberScanner(const char *begin, const char *end);
+
+    // Writes up to max numbers to out and returns how many were written.
+    // Returns less than max only when the input is exhausted.
+    size_t Next(int *out, size_t max);
+
+    bool Done() const { return done_; }
+    size_t Offset() const { return static_cast<size_t>(pos_ - begin_); }
+
+private:
+    const char *begin_;
+    const char *pos_;
+    const char *end_;
+    bool done_;
+};
+
+// Read-only mapping of a whole input file.
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+};
+
+bool MapFile(int fd, MappedFile &file);
+void UnmapFile(MappedFile &file);
@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "number_scanner.hpp"
+
+// Usage: parse_bench <file> [-g megabytes] [-s]
+//   -g  (re)generate <file> with random ints until it reaches the given size
+//   -s  also time the fscanf("%d") path the parent uses without -m
+
+static bool Generate(const char *path, size_t megabytes) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("fopen");
+        return false;
+    }
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dis(0, 1000000000);
+    size_t target = megabytes << 20;
+    size_t written = 0;
+    char line[32];
+    while (written < target) {
+        int n = snprintf(line, sizeof(line), "%d\n", dis(gen));
+        fwrite(line, 1, static_cast<size_t>(n), f);
+        written += static_cast<size_t>(n);
+    }
+    fclose(f);
+    return true;
+}
+
+static void Report(const char *name, size_t numbers, size_t bytes, double seconds, long long checksum) {
+    std::cout << name << ": " << numbers << " numbers in " << seconds << " s | "
+              << numbers / seconds / 1e6 << " M numbers/s | "
+              << bytes / seconds / (1 << 20) << " MiB/s | checksum " << checksum << "\n";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <file> [-g megabytes] [-s]\n";
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[1];
+    size_t generate_mb = 0;
+    bool with_stdio = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-g" && i + 1 < argc) {
+            generate_mb = static_cast<size_t>(atoll(argv[++i]));
+        } else if (arg == "-s") {
+            with_stdio = true;
+        }
+    }
+
+    if (generate_mb > 0 && !Generate(path, generate_mb)) {
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int> block(1024);
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile mapped;
+    if (!MapFile(fd, mapped)) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    NumberScanner scanner(mapped.data, mapped.data + mapped.size);
+    size_t total = 0;
+    long long checksum = 0;
+    while (!scanner.Done()) {
+        size_t n = scanner.Next(block.data(), block.size());
+        for (size_t i = 0; i < n; ++i) {
+            checksum += block[i];
+        }
+        total += n;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Report("mmap scanner", total, mapped.size, elapsed.count(), checksum);
+    size_t bytes = mapped.size;
+    UnmapFile(mapped);
+
+    if (with_stdio) {
+        lseek(fd, 0, SEEK_SET);
+        FILE *f = fdopen(fd, "r");
+        start = std::chrono::steady_clock::now();
+        total = 0;
+        checksum = 0;
+        int x;
+        while (fscanf(f, "%d", &x) == 1) {
+            checksum += x;
+            ++total;
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        Report("fscanf", total, bytes, elapsed.count(), checksum);
+        fclose(f);
+    } else {
+        close(fd);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+#include "shared_queue.hpp"
+#include <new>
+#include <sched.h>
+#include <time.h>
+
+size_t QueueRegionSize(int children) {
+    return sizeof(QueueRegion) + static_cast<size_t>(children) * sizeof(OutRing);
+}
+
+QueueRegion* InitQueueRegion(void* addr, int children) {
+    QueueRegion* region = new (addr) QueueRegion;
+    region->enqueue_pos.store(0, std::memory_order_relaxed);
+    region->dequeue_pos.store(0, std::memory_order_relaxed);
+    region->cancel_index.store(kNoCancel, std::memory_order_relaxed);
+    region->closed.store(0, std::memory_order_relaxed);
+    region->shutdown.store(0, std::memory_order_relaxed);
+    region->children = static_cast<uint32_t>(children);
+    for (uint64_t i = 0; i < kQueueCapacity; ++i) {
+        region->cells[i].turn.store(i, std::memory_order_relaxed);
+    }
+    for (int c = 0; c < children; ++c) {
+        OutRing* ring = new (ChildRing(region, c)) OutRing;
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    return region;
+}
+
+OutRing* ChildRing(QueueRegion* region, int child) {
+    return reinterpret_cast<OutRing*>(region + 1) + child;
+}
+
+Batch* TryBeginEnqueue(QueueRegion* region, uint64_t& pos) {
+    pos = region->enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        QueueCell& cell = region->cells[pos & (kQueueCapacity - 1)];
+        uint64_t turn = cell.turn.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(turn - pos);
+        if (diff == 0) {
+            if (region->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return &cell.batch;
+            }
+        } else if (diff < 0) {
+            return nullptr;
+        } else {
+            pos = region->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void FinishEnqueue(QueueRegion* region, uint64_t pos) {
+    region->cells[pos & (kQueueCapacity - 1)].turn.store(pos + 1, std::memory_order_release);
+}
+
+Batch* TryBeginDequeue(QueueRegion* region, uint64_t& pos) {
+    pos = region->dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        QueueCell& cell = region->cells[pos & (kQueueCapacity - 1)];
+        uint64_t turn = cell.turn.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(turn - (pos + 1));
+        if (diff == 0) {
+            if (region->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return &cell.batch;
+            }
+        } else if (diff < 0) {
+            return nullptr;
+        } else {
+            pos = region->dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void FinishDequeue(QueueRegion* region, uint64_t pos) {
+    region->cells[pos & (kQueueCapacity - 1)].turn.store(pos + kQueueCapacity, std::memory_order_release);
+}
+
+bool QueueDrained(QueueRegion* region) {
+    return region->dequeue_pos.load(std::memory_order_acquire) >=
+           region->enqueue_pos.load(std::memory_order_acquire);
+}
+
+bool TryPushRecord(OutRing* ring, const OutRecord& rec) {
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == kOutCapacity) {
+        return false;
+    }
+    ring->records[head & (kOutCapacity - 1)] = rec;
+    ring->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool PeekRecord(OutRing* ring, OutRecord& rec) {
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail == ring->head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    rec = ring->records[tail & (kOutCapacity - 1)];
+    return true;
+}
+
+void PopRecord(OutRing* ring) {
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void CancelAt(QueueRegion* region, int64_t index) {
+    int64_t cur = region->cancel_index.load(std::memory_order_relaxed);
+    while (index < cur &&
+           !region->cancel_index.compare_exchange_weak(cur, index, std::memory_order_acq_rel)) {
+    }
+}
+
+bool IsPrime(int x) {
+    for (int d = 2; 1ll * d * d <= x; ++d) {
+        if (x % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Backoff(unsigned& spins) {
+    ++spins;
+    if (spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (spins < 128) {
+        sched_yield();
+    } else {
+        timespec ts{0, 50000};
+        nanosleep(&ts, nullptr);
+    }
+}
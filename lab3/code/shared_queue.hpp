@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of mapping.bin in multi-child mode (parent -j N).
+//
+// The parent is the only producer: it fills batches of numbers straight into
+// queue cells. Children claim cells from a bounded lock-free MPMC queue
+// (Vyukov's sequence-per-cell scheme), test the numbers in place and report
+// composites into their own SPSC output ring. The parent merges the rings back
+// in batch order, so the output is the same as with a single child.
+//
+// cancel_index is the shared cancellation point: the lowest input index that
+// holds a prime or a negative number seen so far. Batches that start past it
+// are skipped, and the parent stops reading input once it is set.
+
+constexpr uint32_t kBatchSize = 1024;
+constexpr uint64_t kQueueCapacity = 64;
+constexpr uint64_t kOutCapacity = 4096;
+constexpr int kMaxChildren = 256;
+constexpr int64_t kNoCancel = INT64_MAX;
+
+static_assert((kQueueCapacity & (kQueueCapacity - 1)) == 0, "queue capacity must be a power of two");
+static_assert((kOutCapacity & (kOutCapacity - 1)) == 0, "ring capacity must be a power of two");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+enum RecordKind : int32_t {
+    kComposite = 0,
+    kBatchEnd = 1,
+    kBatchStop = 2,
+};
+
+struct Batch {
+    uint64_t id;
+    uint64_t first;
+    uint32_t count;
+    int numbers[kBatchSize];
+};
+
+struct alignas(64) QueueCell {
+    std::atomic<uint64_t> turn;
+    Batch batch;
+};
+
+struct OutRecord {
+    uint64_t batch;
+    int32_t value;
+    int32_t kind;
+};
+
+struct alignas(64) OutRing {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    OutRecord records[kOutCapacity];
+};
+
+struct alignas(64) QueueRegion {
+    alignas(64) std::atomic<uint64_t> enqueue_pos;
+    alignas(64) std::atomic<uint64_t> dequeue_pos;
+    alignas(64) std::atomic<int64_t> cancel_index;
+    std::atomic<uint32_t> closed;
+    std::atomic<uint32_t> shutdown;
+    uint32_t children;
+    QueueCell cells[kQueueCapacity];
+};
+
+size_t QueueRegionSize(int children);
+QueueRegion* InitQueueRegion(void* addr, int children);
+OutRing* ChildRing(QueueRegion* region, int child);
+
+Batch* TryBeginEnqueue(QueueRegion* region, uint64_t& pos);
+void FinishEnqueue(QueueRegion* region, uint64_t pos);
+Batch* TryBeginDequeue(QueueRegion* region, uint64_t& pos);
+void FinishDequeue(QueueRegion* region, uint64_t pos);
+bool QueueDrained(QueueRegion* region);
+
+bool TryPushRecord(OutRing* ring, const OutRecord& rec);
+bool PeekRecord(OutRing* ring, OutRecord& rec);
+void PopRecord(OutRing* ring);
+
+void CancelAt(QueueRegion* region, int64_t index);
+bool IsPrime(int x);
+void Backoff(unsigned& spins);
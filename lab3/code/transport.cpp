@@ -0,0 +1,314 @@
+#include "transport.hpp"
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include "shared_queue.hpp"
+#include "trace.hpp"
+
+using fd_t = int;
+
+struct SharedData {
+    int number;
+    int state;
+};
+
+bool OpenInput(fd_t fd, bool use_mmap, NumberInput &input) {
+    if (use_mmap) {
+        bool ok = MapFile(fd, input.mapped);
+        close(fd);
+        if (!ok) {
+            return false;
+        }
+        input.scanner = NumberScanner(input.mapped.data, input.mapped.data + input.mapped.size);
+        return true;
+    }
+
+    input.file = fdopen(fd, "r");
+    if (!input.file) {
+        perror("fdopen");
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+void CloseInput(NumberInput &input) {
+    if (input.file) {
+        fclose(input.file);
+        input.file = nullptr;
+    }
+    UnmapFile(input.mapped);
+}
+
+void DropInputInChild(NumberInput &input) {
+    if (input.file) {
+        close(fileno(input.file));
+    }
+}
+
+struct BatchTiming {
+    uint64_t start_ns;
+    uint32_t count;
+};
+
+struct Merger {
+    uint64_t next_batch = 0;
+    int current = -1;
+    bool stopped = false;
+    LatencyHistogram *latency = nullptr;
+    std::vector<BatchTiming> timings;
+};
+
+// Emits finished batches in input order. Returns once the next batch is not
+// (fully) available yet.
+static void DrainOutputs(QueueRegion *region, Merger &m, uint64_t published) {
+    int children = static_cast<int>(region->children);
+    while (!m.stopped && m.next_batch < published) {
+        OutRecord rec;
+        if (m.current < 0) {
+            for (int c = 0; c < children; ++c) {
+                if (PeekRecord(ChildRing(region, c), rec) && rec.batch == m.next_batch) {
+                    m.current = c;
+                    break;
+                }
+            }
+            if (m.current < 0) {
+                return;
+            }
+        }
+
+        TRACE_SCOPE("emit_batch");
+        OutRing *ring = ChildRing(region, m.current);
+        while (PeekRecord(ring, rec)) {
+            PopRecord(ring);
+            if (rec.kind == kComposite) {
+                std::cout << rec.value << '\n';
+                continue;
+            }
+            if (rec.kind == kBatchStop) {
+                m.stopped = true;
+            }
+            if (m.latency) {
+                const BatchTiming &t = m.timings[m.next_batch];
+                m.latency->Record(NowNs() - t.start_ns, t.count);
+            }
+            ++m.next_batch;
+            m.current = -1;
+            break;
+        }
+        if (m.current >= 0) {
+            return;
+        }
+    }
+}
+
+int RunQueueTransport(NumberInput &input, int children, LatencyHistogram *latency) {
+    const char *map_filename = "mapping.bin";
+    size_t size = QueueRegionSize(children);
+
+    fd_t map_fd = open(map_filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (map_fd == -1) {
+        perror("open map");
+        return EXIT_FAILURE;
+    }
+
+    if (ftruncate(map_fd, static_cast<off_t>(size)) == -1) {
+        perror("ftruncate");
+        close(map_fd);
+        return EXIT_FAILURE;
+    }
+
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        close(map_fd);
+        return EXIT_FAILURE;
+    }
+
+    QueueRegion *region = InitQueueRegion(addr, children);
+
+    std::vector<pid_t> pids;
+    for (int c = 0; c < children; ++c) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            break;
+        }
+        if (pid == 0) {
+            DropInputInChild(input);
+            munmap(addr, size);
+            close(map_fd);
+            std::string id = std::to_string(c);
+            execl("./child", "child", map_filename, id.c_str(), (char *)nullptr);
+            perror("execl");
+            _exit(EXIT_FAILURE);
+        }
+        pids.push_back(pid);
+    }
+
+    Merger merger;
+    merger.latency = latency;
+    uint64_t published = 0;
+    uint64_t next_index = 0;
+    bool input_done = pids.empty();
+    unsigned spins = 0;
+
+    while (!input_done) {
+        if (region->cancel_index.load(std::memory_order_acquire) != kNoCancel) {
+            break;
+        }
+
+        uint64_t pos;
+        Batch *batch = TryBeginEnqueue(region, pos);
+        if (!batch) {
+            DrainOutputs(region, merger, published);
+            Backoff(spins);
+            continue;
+        }
+        spins = 0;
+        TRACE_SCOPE("fill_batch");
+
+        batch->id = published;
+        batch->first = next_index;
+        batch->count = static_cast<uint32_t>(input.Read(batch->numbers, kBatchSize));
+        if (batch->count < kBatchSize) {
+            input_done = true;
+        }
+        next_index += batch->count;
+
+        if (latency) {
+            merger.timings.push_back(BatchTiming{NowNs(), batch->count});
+        }
+        FinishEnqueue(region, pos);
+        ++published;
+        DrainOutputs(region, merger, published);
+    }
+
+    region->closed.store(1, std::memory_order_release);
+
+    spins = 0;
+    while (!merger.stopped && merger.next_batch < published) {
+        DrainOutputs(region, merger, published);
+        Backoff(spins);
+    }
+    std::cout.flush();
+
+    region->shutdown.store(1, std::memory_order_release);
+
+    int rc = EXIT_SUCCESS;
+    for (pid_t pid : pids) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) == -1) {
+            perror("waitpid");
+            rc = EXIT_FAILURE;
+        }
+    }
+    if (pids.empty()) {
+        rc = EXIT_FAILURE;
+    }
+
+    CloseInput(input);
+    munmap(addr, size);
+    close(map_fd);
+    unlink(map_filename);
+    return rc;
+}
+
+int RunSlotTransport(NumberInput &input, LatencyHistogram *latency) {
+    const char *map_filename = "mapping.bin";
+    fd_t map_fd = open(map_filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (map_fd == -1) {
+        perror("open map");
+        CloseInput(input);
+        return EXIT_FAILURE;
+    }
+
+    if (ftruncate(map_fd, sizeof(SharedData)) == -1) {
+        perror("ftruncate");
+        CloseInput(input);
+        close(map_fd);
+        return EXIT_FAILURE;
+    }
+
+    void *addr = mmap(nullptr, sizeof(SharedData), PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        CloseInput(input);
+        close(map_fd);
+        return EXIT_FAILURE;
+    }
+
+    SharedData *shared = static_cast<SharedData *>(addr);
+    shared->number = 0;
+    shared->state = 0;
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        munmap(addr, sizeof(SharedData));
+        CloseInput(input);
+        close(map_fd);
+        return EXIT_FAILURE;
+    }
+
+    if (pid == 0) {
+        DropInputInChild(input);
+        munmap(addr, sizeof(SharedData));
+        close(map_fd);
+        execl("./child", "child", map_filename, (char *)nullptr);
+        perror("execl");
+        _exit(EXIT_FAILURE);
+    }
+
+    int x;
+    bool stop = false;
+
+    while (!stop && input.Read(&x, 1) == 1) {
+        TRACE_SCOPE("exchange");
+        while (shared->state == 1) {
+            usleep(1000);
+        }
+
+        shared->number = x;
+        uint64_t start_ns = latency ? NowNs() : 0;
+        shared->state = 1;
+
+        while (shared->state == 1) {
+            usleep(1000);
+        }
+        if (latency) {
+            latency->Record(NowNs() - start_ns);
+        }
+
+        if (shared->state == 2) {
+            stop = true;
+        }
+    }
+
+    if (!stop) {
+        while (shared->state == 1) {
+            usleep(1000);
+        }
+        shared->state = 2;
+    }
+
+    CloseInput(input);
+    munmap(addr, sizeof(SharedData));
+    close(map_fd);
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return EXIT_FAILURE;
+    }
+
+    unlink(map_filename);
+    return EXIT_SUCCESS;
+}
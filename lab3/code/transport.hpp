@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include "latency_histogram.hpp"
+#include "number_scanner.hpp"
+
+// Numbers come either from stdio (default) or, with -m, from a read-only
+// mapping of the input file parsed by NumberScanner.
+struct NumberInput {
+    FILE *file = nullptr;
+    MappedFile mapped;
+    NumberScanner scanner{nullptr, nullptr};
+
+    size_t Read(int *out, size_t max) {
+        if (!file) {
+            return scanner.Next(out, max);
+        }
+        size_t n = 0;
+        while (n < max && fscanf(file, "%d", &out[n]) == 1) {
+            ++n;
+        }
+        return n;
+    }
+};
+
+// Takes ownership of fd.
+bool OpenInput(int fd, bool use_mmap, NumberInput &input);
+void CloseInput(NumberInput &input);
+// fclose() in a forked child could move the file offset it shares with the parent.
+void DropInputInChild(NumberInput &input);
+
+// Both transports exec ./child over mapping.bin, consume and close input and
+// return EXIT_SUCCESS / EXIT_FAILURE. When latency is set, the time from
+// handing a number over to getting its verdict back is recorded per number
+// (per batch, weighted by its size, in queue mode).
+
+// One number per round trip through a {number, state} slot, polled with usleep.
+int RunSlotTransport(NumberInput &input, LatencyHistogram *latency);
+// Batches through the MPMC queue of shared_queue.hpp with the given number of children.
+int RunQueueTransport(NumberInput &input, int children, LatencyHistogram *latency);
@@ -0,0 +1,76 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "batch_driver.h"
+#include "fast_io.h"
+#include "plugin_registry.h"
+
+struct TuneOptions {
+    // File name of the library whose results count as correct; empty means
+    // the first one in file name order.
+    std::string reference;
+    // Largest accepted |result - reference| / max(1, |reference|).
+    double tolerance = 1e-9;
+    // Timing cache. Libraries whose size and mtime match an entry are not
+    // measured again. Empty disables the cache.
+    std::string profile;
+};
+
+// Arguments the implementations are measured and checked on.
+struct TuneSample {
+    std::vector<int> x;
+    std::vector<double> a;
+    std::vector<double> b;
+};
+
+// Takes the E and Area arguments from the command lines in text and repeats
+// them up to size values each. A command type that does not occur in text
+// gets synthetic arguments.
+TuneSample BuildSample(std::string_view text, size_t size);
+
+// Measures E and Area of every library in a registry and routes each of them
+// to the fastest library whose results stay within the tolerance of the
+// reference on the sample.
+class AutoTuner {
+public:
+    AutoTuner(TuneOptions options, TuneSample sample);
+
+    // Call again after the registry changed; only new or rebuilt libraries
+    // are measured. Loads every library the registry has not opened yet.
+    void Tune(PluginRegistry& registry);
+    // Valid until the next Tune(). Null entry points if no library loaded.
+    BatchApi api() const;
+    void Report(OutputBuffer& out) const;
+
+private:
+    struct Timing {
+        long long size;
+        long long mtime;
+        double e_ns;
+        double area_ns;
+    };
+
+    struct Entry {
+        std::string file;
+        std::shared_ptr<const Plugin> plugin;
+        Timing timing;
+        bool cached;
+        double e_error;
+        double area_error;
+    };
+
+    void Measure(const Plugin& plugin, Timing& timing);
+    void LoadProfile();
+    void SaveProfile() const;
+
+    TuneOptions options_;
+    TuneSample sample_;
+    std::map<std::string, Timing> profile_;
+    std::vector<Entry> entries_;
+    size_t reference_;
+    size_t e_choice_;
+    size_t area_choice_;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "fast_io.h"
+
+using e_batch_func_t = void (*)(const int*, double*, size_t);
+using area_batch_func_t = void (*)(const double*, const double*, double*, size_t);
+
+struct BatchApi {
+    e_batch_func_t e_batch;
+    area_batch_func_t area_batch;
+};
+
+// Collects a run of consecutive commands of one type and evaluates it with a
+// single batch call. Results keep input order and are appended to out. Flush()
+// before printing anything else; SetApi() flushes itself. Writing out to the
+// descriptor is left to the caller.
+class BatchDriver {
+public:
+    explicit BatchDriver(OutputBuffer& out, size_t max_batch = 4096);
+
+    void SetApi(const BatchApi& api);
+    void AddE(int x);
+    void AddArea(double a, double b);
+    void Flush();
+
+private:
+    enum class Kind { None, E, Area };
+
+    void Begin(Kind kind);
+
+    OutputBuffer& out_;
+    size_t max_batch_;
+    BatchApi api_;
+    Kind kind_;
+    std::vector<int> x_;
+    std::vector<double> a_;
+    std::vector<double> b_;
+    std::vector<double> results_;
+};
+
+// Parses one command line. Commands 1 and 2 are queued on driver, a malformed
+// argument list flushes it and appends "error". Returns the command number,
+// or -1 if the line does not start with one.
+int RunCommand(std::string_view line, BatchDriver& driver, OutputBuffer& out);
@@ -1,4 +1,9 @@
 #pragma once
+#include <cstddef>
 
 extern "C" double E(int x);
 extern "C" double Area(double a, double b);
+
+// Batch forms: out[i] is bit-identical to the scalar call on element i.
+extern "C" void E_batch(const int* x, double* out, size_t n);
+extern "C" void Area_batch(const double* a, const double* b, double* out, size_t n);
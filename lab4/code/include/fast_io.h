@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Hands out input lines (without '\n') from a file descriptor. Regular files
+// are mapped whole; anything else is read in large blocks.
+class LineReader {
+public:
+    explicit LineReader(int fd, size_t block_size = 1 << 20);
+    ~LineReader();
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    // Returns false at end of input.
+    bool Next(std::string_view& line);
+    // True if Next() can return without blocking on read(). Reads whatever
+    // is ready on the descriptor before giving up.
+    bool HasLine();
+    // Input that is buffered but not consumed yet. Waits for the first block
+    // if nothing is buffered.
+    std::string_view Peek();
+
+private:
+    bool Fill();
+
+    int fd_;
+    const char* map_;
+    size_t map_size_;
+    std::vector<char> buf_;
+    const char* pos_;
+    const char* end_;
+    const char* newline_;
+    bool eof_;
+};
+
+// Collects output and writes it in large chunks. Without a descriptor it only
+// collects: the buffer grows and Flush() does nothing.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(int fd = -1, size_t capacity = 1 << 16);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void Append(std::string_view s);
+    // Same text as std::fixed with precision 10, followed by '\n'.
+    void AppendFixedLine(double value);
+    void Flush();
+
+    std::string_view data() const { return std::string_view(buf_.data(), used_); }
+
+private:
+    void Reserve(size_t n);
+
+    int fd_;
+    std::vector<char> buf_;
+    size_t used_;
+};
+
+// Token parsers with the rules of std::istream >> int / >> double in the
+// "C" locale: leading whitespace is skipped, a token the stream would reject
+// (out of range, "1e", "inf", ...) fails. On success p is moved past the token.
+bool ParseInt(const char*& p, const char* end, int& value);
+bool ParseDouble(const char*& p, const char* end, double& value);
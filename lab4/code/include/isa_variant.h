@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// The implementation libraries are also built for wider instruction sets and
+// placed next to the baseline ones as variants/lib<name>.<isa>.so. On x86-64
+// these are "avx512" and "avx2"; other targets have none (NEON is already
+// part of the aarch64 baseline).
+
+// Every variant name the build knows about, best first.
+const std::vector<std::string>& KnownIsaVariants();
+bool CpuSupports(const std::string& isa);
+// Variants to try on this CPU, best first. IMPL_ISA=<isa> in the environment
+// restricts the list to that variant, IMPL_ISA=baseline empties it.
+std::vector<std::string> UsableIsaVariants();
+// dir/variants/<file without .so>.<isa>.so
+std::string VariantPath(const std::string& dir, const std::string& file, const std::string& isa);
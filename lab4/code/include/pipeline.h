@@ -0,0 +1,59 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batch_driver.h"
+#include "fast_io.h"
+
+// Evaluates command lines on a pool of worker threads while a writer thread
+// appends the results to out in submission order. The caller cuts the input
+// into chunks of whole lines and submits each with the implementation to use,
+// so a switch between two chunks applies exactly at that point. The libraries
+// behind a submitted api must stay loaded until Drain() returns.
+class Pipeline {
+public:
+    Pipeline(OutputBuffer& out, size_t workers);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Blocks while too many chunks are in flight.
+    void Submit(std::string lines, const BatchApi& api);
+    // Output that is already known, e.g. "switched".
+    void SubmitText(std::string text);
+    // Waits until everything submitted so far has been appended to out.
+    // out may be used by the caller until the next Submit.
+    void Drain();
+
+private:
+    struct Chunk {
+        std::string lines;
+        BatchApi api;
+        OutputBuffer result;
+        bool done = false;
+    };
+
+    void Enqueue(std::shared_ptr<Chunk> chunk);
+    void WorkerLoop();
+    void WriterLoop();
+
+    OutputBuffer& out_;
+    size_t max_in_flight_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::condition_variable space_cv_;
+    std::deque<std::shared_ptr<Chunk>> pending_;
+    std::deque<std::shared_ptr<Chunk>> in_order_;
+    size_t submitted_;
+    size_t written_;
+    bool stop_;
+    std::vector<std::thread> workers_;
+    std::thread writer_;
+};
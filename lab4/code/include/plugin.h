@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "contracts.h"
+
+// Bump when ImplPlugin changes layout or meaning; program2 skips libraries
+// built against another version.
+constexpr uint32_t kImplPluginAbiVersion = 1;
+
+// The one symbol program2 looks up in an implementation library.
+struct ImplPlugin {
+    uint32_t abi_version;
+    const char* name;
+    double (*e)(int);
+    double (*area)(double, double);
+    void (*e_batch)(const int*, double*, size_t);
+    void (*area_batch)(const double*, const double*, double*, size_t);
+};
+
+extern "C" const ImplPlugin impl_plugin;
+
+#define IMPL_PLUGIN_SYMBOL "impl_plugin"
@@ -0,0 +1,86 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "batch_driver.h"
+#include "plugin.h"
+
+// An implementation library. The first load of a path opens the file itself;
+// a reload of the same path opens a private copy when it can, so glibc does
+// not return the handle of the previous build and a rebuild that rewrites the
+// .so in place cannot change code that is still running. The library is
+// dlclosed when the last shared_ptr goes away, i.e. once nobody can be calling
+// into it any more.
+class Plugin {
+public:
+    // dlopen_flags: RTLD_LAZY or RTLD_NOW; RTLD_LOCAL is always added.
+    static std::shared_ptr<const Plugin> Load(const std::string& path, int dlopen_flags);
+    ~Plugin();
+
+    Plugin(const Plugin&) = delete;
+    Plugin& operator=(const Plugin&) = delete;
+
+    const ImplPlugin& api() const { return *api_; }
+    const std::string& path() const { return path_; }
+    BatchApi batch() const { return BatchApi{api_->e_batch, api_->area_batch}; }
+
+private:
+    Plugin(void* handle, const ImplPlugin* api, std::string path);
+
+    void* handle_;
+    const ImplPlugin* api_;
+    std::string path_;
+};
+
+// Every *.so in a directory that exports a matching ImplPlugin, ordered by
+// file name. With Watch() enabled, Refresh() picks up libraries that were
+// added, rebuilt or removed since the last call. A reload swaps the slot's
+// pointer atomically; callers holding the previous snapshot keep using the
+// old library until they drop it. A slot is loaded from the best ISA variant
+// of its file that this CPU runs (see isa_variant.h), so Plugin::path() may
+// point into dir/variants.
+//
+// LoadMode::Eager opens every library in Scan() and on every change. Lazy and
+// Now only list the files and open one on its first Get(), with RTLD_LAZY or
+// RTLD_NOW respectively; a library that fails to load then leaves a slot that
+// Get() returns nullptr for.
+enum class LoadMode { Eager, Lazy, Now };
+
+class PluginRegistry {
+public:
+    explicit PluginRegistry(std::string dir, LoadMode mode = LoadMode::Eager);
+    ~PluginRegistry();
+
+    PluginRegistry(const PluginRegistry&) = delete;
+    PluginRegistry& operator=(const PluginRegistry&) = delete;
+
+    void Scan();
+    bool Watch();
+    // Non-blocking. Returns true if any slot changed.
+    bool Refresh();
+
+    size_t Size() const { return slots_.size(); }
+    // Loads the library first if the mode defers that.
+    std::shared_ptr<const Plugin> Get(size_t index);
+    const std::string& FileName(size_t index) const { return slots_[index].file; }
+    // Index of the slot loaded from file, or Size() if there is none.
+    size_t Find(const std::string& file) const;
+
+private:
+    struct Slot {
+        std::string file;
+        std::shared_ptr<const Plugin> plugin;
+        bool failed;
+    };
+
+    std::shared_ptr<const Plugin> Open(const std::string& file) const;
+    void LoadFile(const std::string& file);
+    void RemoveFile(const std::string& file);
+
+    std::string dir_;
+    LoadMode mode_;
+    std::vector<std::string> isa_variants_;
+    std::vector<Slot> slots_;
+    int inotify_fd_;
+    int variants_wd_;
+};
@@ -0,0 +1,235 @@
+#include "auto_tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sys/stat.h>
+
+static constexpr int kRounds = 5;
+static constexpr int kRepeats = 8;
+
+// Repeats the first values up to size, or fills with synthetic ones if there
+// are none.
+template <typename T, typename Gen>
+static void top_up(std::vector<T>& v, size_t size, Gen gen) {
+    size_t have = v.size();
+    for (size_t i = have; i < size; ++i) {
+        v.push_back(have > 0 ? v[i % have] : gen(i));
+    }
+}
+
+TuneSample BuildSample(std::string_view text, size_t size) {
+    TuneSample sample;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end && (sample.x.size() < size || sample.a.size() < size)) {
+        auto nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!nl) {
+            break;
+        }
+        const char* q = p;
+        p = nl + 1;
+        int cmd;
+        if (!ParseInt(q, nl, cmd)) {
+            continue;
+        }
+        int x;
+        double a;
+        double b;
+        if (cmd == 1 && sample.x.size() < size && ParseInt(q, nl, x)) {
+            sample.x.push_back(x);
+        } else if (cmd == 2 && sample.a.size() < size && ParseDouble(q, nl, a) && ParseDouble(q, nl, b)) {
+            sample.a.push_back(a);
+            sample.b.push_back(b);
+        }
+    }
+
+    unsigned state = 12345;
+    auto next = [&state]() {
+        state = state * 1103515245u + 12345u;
+        return (state >> 8) & 0xffff;
+    };
+    top_up(sample.x, size, [&](size_t) { return static_cast<int>(1 + next() % 1000); });
+    top_up(sample.a, size, [&](size_t) { return next() / 655.36; });
+    top_up(sample.b, size, [&](size_t) { return next() / 655.36; });
+    return sample;
+}
+
+// Best of kRounds, in nanoseconds per element.
+template <typename F>
+static double ns_per_call(F call, size_t n) {
+    double best = std::numeric_limits<double>::infinity();
+    call();
+    for (int r = 0; r < kRounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kRepeats; ++i) {
+            call();
+        }
+        std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    return best / (kRepeats * static_cast<double>(n));
+}
+
+static double max_error(const std::vector<double>& got, const std::vector<double>& ref) {
+    double worst = 0.0;
+    for (size_t i = 0; i < got.size(); ++i) {
+        if (got[i] == ref[i]) {
+            continue;
+        }
+        double err = std::fabs(got[i] - ref[i]) / std::max(1.0, std::fabs(ref[i]));
+        if (std::isnan(err)) {
+            err = std::numeric_limits<double>::infinity();
+        }
+        worst = std::max(worst, err);
+    }
+    return worst;
+}
+
+AutoTuner::AutoTuner(TuneOptions options, TuneSample sample)
+    : options_(std::move(options)), sample_(std::move(sample)), reference_(0), e_choice_(0), area_choice_(0) {
+    LoadProfile();
+}
+
+void AutoTuner::Measure(const Plugin& plugin, Timing& timing) {
+    const ImplPlugin& api = plugin.api();
+    std::vector<double> out(std::max(sample_.x.size(), sample_.a.size()));
+    timing.e_ns = ns_per_call([&] { api.e_batch(sample_.x.data(), out.data(), sample_.x.size()); },
+                              sample_.x.size());
+    timing.area_ns = ns_per_call(
+        [&] { api.area_batch(sample_.a.data(), sample_.b.data(), out.data(), sample_.a.size()); },
+        sample_.a.size());
+}
+
+void AutoTuner::Tune(PluginRegistry& registry) {
+    entries_.clear();
+    reference_ = 0;
+    e_choice_ = 0;
+    area_choice_ = 0;
+    bool measured = false;
+
+    for (size_t i = 0; i < registry.Size(); ++i) {
+        Entry entry{registry.FileName(i), registry.Get(i), Timing{}, false, 0.0, 0.0};
+        if (!entry.plugin) {
+            continue;
+        }
+        struct stat st;
+        if (stat(entry.plugin->path().c_str(), &st) == 0) {
+            entry.timing.size = static_cast<long long>(st.st_size);
+            entry.timing.mtime = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        }
+        auto it = profile_.find(entry.file);
+        if (it != profile_.end() && it->second.size == entry.timing.size &&
+            it->second.mtime == entry.timing.mtime) {
+            entry.timing = it->second;
+            entry.cached = true;
+        } else {
+            Measure(*entry.plugin, entry.timing);
+            profile_[entry.file] = entry.timing;
+            measured = true;
+        }
+        if (entry.file == options_.reference) {
+            reference_ = entries_.size();
+        }
+        entries_.push_back(std::move(entry));
+    }
+    if (entries_.empty()) {
+        return;
+    }
+    if (!options_.reference.empty() && entries_[reference_].file != options_.reference) {
+        std::cerr << "reference " << options_.reference << " not loaded, using "
+                  << entries_[reference_].file << std::endl;
+    }
+
+    // Accuracy is cheap to check and depends on the sample, so it is not cached.
+    std::vector<double> ref_e(sample_.x.size());
+    std::vector<double> ref_area(sample_.a.size());
+    const ImplPlugin& ref = entries_[reference_].plugin->api();
+    ref.e_batch(sample_.x.data(), ref_e.data(), ref_e.size());
+    ref.area_batch(sample_.a.data(), sample_.b.data(), ref_area.data(), ref_area.size());
+
+    std::vector<double> got_e(ref_e.size());
+    std::vector<double> got_area(ref_area.size());
+    e_choice_ = reference_;
+    area_choice_ = reference_;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        Entry& entry = entries_[i];
+        const ImplPlugin& api = entry.plugin->api();
+        api.e_batch(sample_.x.data(), got_e.data(), got_e.size());
+        api.area_batch(sample_.a.data(), sample_.b.data(), got_area.data(), got_area.size());
+        entry.e_error = max_error(got_e, ref_e);
+        entry.area_error = max_error(got_area, ref_area);
+        if (entry.e_error <= options_.tolerance && entry.timing.e_ns < entries_[e_choice_].timing.e_ns) {
+            e_choice_ = i;
+        }
+        if (entry.area_error <= options_.tolerance &&
+            entry.timing.area_ns < entries_[area_choice_].timing.area_ns) {
+            area_choice_ = i;
+        }
+    }
+
+    if (measured) {
+        SaveProfile();
+    }
+}
+
+BatchApi AutoTuner::api() const {
+    if (entries_.empty()) {
+        return BatchApi{nullptr, nullptr};
+    }
+    return BatchApi{entries_[e_choice_].plugin->api().e_batch, entries_[area_choice_].plugin->api().area_batch};
+}
+
+void AutoTuner::Report(OutputBuffer& out) const {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-24s %12s %10s %12s %10s\n", "library", "E ns/call", "E error",
+                  "Area ns/call", "Area error");
+    out.Append(line);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& entry = entries_[i];
+        std::string name = entry.file + (i == reference_ ? " (ref)" : "");
+        std::snprintf(line, sizeof(line), "%-24s %12.3f %10.3g %12.3f %10.3g%s\n", name.c_str(),
+                      entry.timing.e_ns, entry.e_error, entry.timing.area_ns, entry.area_error,
+                      entry.cached ? " cached" : "");
+        out.Append(line);
+    }
+    if (entries_.empty()) {
+        return;
+    }
+    std::snprintf(line, sizeof(line), "E -> %s\nArea -> %s\n", entries_[e_choice_].file.c_str(),
+                  entries_[area_choice_].file.c_str());
+    out.Append(line);
+}
+
+// One line per library: file size mtime e_ns area_ns
+void AutoTuner::LoadProfile() {
+    if (options_.profile.empty()) {
+        return;
+    }
+    std::ifstream in(options_.profile);
+    std::string file;
+    Timing timing;
+    while (in >> file >> timing.size >> timing.mtime >> timing.e_ns >> timing.area_ns) {
+        profile_[file] = timing;
+    }
+}
+
+void AutoTuner::SaveProfile() const {
+    if (options_.profile.empty()) {
+        return;
+    }
+    std::ofstream out(options_.profile);
+    if (!out) {
+        std::perror(options_.profile.c_str());
+        return;
+    }
+    out.precision(17);
+    for (const auto& [file, timing] : profile_) {
+        out << file << ' ' << timing.size << ' ' << timing.mtime << ' ' << timing.e_ns << ' ' << timing.area_ns
+            << '\n';
+    }
+}
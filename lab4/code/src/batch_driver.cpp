@@ -0,0 +1,90 @@
+#include "batch_driver.h"
+#include "trace.hpp"
+
+BatchDriver::BatchDriver(OutputBuffer& out, size_t max_batch)
+    : out_(out), max_batch_(max_batch), api_{nullptr, nullptr}, kind_(Kind::None) {
+    x_.reserve(max_batch_);
+    a_.reserve(max_batch_);
+    b_.reserve(max_batch_);
+    results_.resize(max_batch_);
+}
+
+void BatchDriver::SetApi(const BatchApi& api) {
+    Flush();
+    api_ = api;
+}
+
+void BatchDriver::Begin(Kind kind) {
+    if (kind_ != kind) {
+        Flush();
+        kind_ = kind;
+    }
+}
+
+void BatchDriver::AddE(int x) {
+    Begin(Kind::E);
+    x_.push_back(x);
+    if (x_.size() == max_batch_) {
+        Flush();
+    }
+}
+
+void BatchDriver::AddArea(double a, double b) {
+    Begin(Kind::Area);
+    a_.push_back(a);
+    b_.push_back(b);
+    if (a_.size() == max_batch_) {
+        Flush();
+    }
+}
+
+void BatchDriver::Flush() {
+    if (kind_ == Kind::None) {
+        return;
+    }
+    TRACE_SCOPE("dispatch");
+    size_t n = 0;
+    if (kind_ == Kind::E) {
+        n = x_.size();
+        api_.e_batch(x_.data(), results_.data(), n);
+        x_.clear();
+    } else if (kind_ == Kind::Area) {
+        n = a_.size();
+        api_.area_batch(a_.data(), b_.data(), results_.data(), n);
+        a_.clear();
+        b_.clear();
+    }
+    kind_ = Kind::None;
+
+    for (size_t i = 0; i < n; ++i) {
+        out_.AppendFixedLine(results_[i]);
+    }
+}
+
+int RunCommand(std::string_view line, BatchDriver& driver, OutputBuffer& out) {
+    const char* p = line.data();
+    const char* end = p + line.size();
+    int cmd;
+    if (!ParseInt(p, end, cmd)) {
+        return -1;
+    }
+    if (cmd == 1) {
+        int x;
+        if (!ParseInt(p, end, x)) {
+            driver.Flush();
+            out.Append("error\n");
+            return cmd;
+        }
+        driver.AddE(x);
+    } else if (cmd == 2) {
+        double a;
+        double b;
+        if (!ParseDouble(p, end, a) || !ParseDouble(p, end, b)) {
+            driver.Flush();
+            out.Append("error\n");
+            return cmd;
+        }
+        driver.AddArea(a, b);
+    }
+    return cmd;
+}
@@ -0,0 +1,266 @@
+#include "fast_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+LineReader::LineReader(int fd, size_t block_size)
+    : fd_(fd), map_(nullptr), map_size_(0), pos_(nullptr), end_(nullptr), newline_(nullptr), eof_(false) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            map_ = static_cast<const char*>(addr);
+            map_size_ = static_cast<size_t>(st.st_size);
+            off_t offset = lseek(fd, 0, SEEK_CUR);
+            if (offset < 0 || static_cast<size_t>(offset) > map_size_) {
+                offset = 0;
+            }
+            pos_ = map_ + offset;
+            end_ = map_ + map_size_;
+            eof_ = true;
+            return;
+        }
+    }
+    buf_.resize(block_size);
+    pos_ = end_ = buf_.data();
+}
+
+LineReader::~LineReader() {
+    if (map_) {
+        munmap(const_cast<char*>(map_), map_size_);
+    }
+}
+
+bool LineReader::HasLine() {
+    while (true) {
+        if (newline_ || eof_) {
+            return true;
+        }
+        newline_ = static_cast<const char*>(std::memchr(pos_, '\n', static_cast<size_t>(end_ - pos_)));
+        if (newline_) {
+            return true;
+        }
+        pollfd pfd{fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 0) <= 0) {
+            return false;
+        }
+        Fill();
+    }
+}
+
+std::string_view LineReader::Peek() {
+    if (pos_ == end_ && !eof_) {
+        Fill();
+    }
+    return std::string_view(pos_, static_cast<size_t>(end_ - pos_));
+}
+
+bool LineReader::Next(std::string_view& line) {
+    while (true) {
+        if (!newline_ && pos_ < end_) {
+            newline_ = static_cast<const char*>(std::memchr(pos_, '\n', static_cast<size_t>(end_ - pos_)));
+        }
+        if (newline_) {
+            line = std::string_view(pos_, static_cast<size_t>(newline_ - pos_));
+            pos_ = newline_ + 1;
+            newline_ = nullptr;
+            return true;
+        }
+        if (eof_) {
+            if (pos_ < end_) {
+                line = std::string_view(pos_, static_cast<size_t>(end_ - pos_));
+                pos_ = end_;
+                return true;
+            }
+            return false;
+        }
+        Fill();
+    }
+}
+
+bool LineReader::Fill() {
+    size_t rest = static_cast<size_t>(end_ - pos_);
+    if (pos_ != buf_.data()) {
+        std::memmove(buf_.data(), pos_, rest);
+    }
+    if (rest == buf_.size()) {
+        buf_.resize(buf_.size() * 2);
+    }
+    while (true) {
+        ssize_t n = read(fd_, buf_.data() + rest, buf_.size() - rest);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        pos_ = buf_.data();
+        end_ = pos_ + rest + (n > 0 ? n : 0);
+        if (n <= 0) {
+            eof_ = true;
+            return false;
+        }
+        return true;
+    }
+}
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity) : fd_(fd), buf_(capacity), used_(0) {}
+
+OutputBuffer::~OutputBuffer() {
+    Flush();
+}
+
+void OutputBuffer::Reserve(size_t n) {
+    if (used_ + n <= buf_.size()) {
+        return;
+    }
+    if (fd_ < 0) {
+        buf_.resize(std::max(buf_.size() * 2, used_ + n));
+        return;
+    }
+    Flush();
+    if (n > buf_.size()) {
+        buf_.resize(n);
+    }
+}
+
+void OutputBuffer::Append(std::string_view s) {
+    Reserve(s.size());
+    std::memcpy(buf_.data() + used_, s.data(), s.size());
+    used_ += s.size();
+}
+
+void OutputBuffer::AppendFixedLine(double value) {
+    // DBL_MAX in fixed notation is 309 digits, plus sign, point and 10 decimals.
+    constexpr size_t kMaxFixed = 330;
+    Reserve(kMaxFixed + 1);
+    char* first = buf_.data() + used_;
+    auto res = std::to_chars(first, first + kMaxFixed, value, std::chars_format::fixed, 10);
+    *res.ptr = '\n';
+    used_ += static_cast<size_t>(res.ptr - first) + 1;
+}
+
+void OutputBuffer::Flush() {
+    if (fd_ < 0) {
+        return;
+    }
+    const char* p = buf_.data();
+    size_t left = used_;
+    while (left > 0) {
+        ssize_t n = write(fd_, p, left);
+        if (n > 0) {
+            p += n;
+            left -= static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        break;
+    }
+    used_ = 0;
+}
+
+bool ParseInt(const char*& p, const char* end, int& value) {
+    const char* q = skip_spaces(p, end);
+    bool negative = false;
+    if (q < end && (*q == '+' || *q == '-')) {
+        negative = *q == '-';
+        ++q;
+    }
+    if (q == end || !is_digit(*q)) {
+        return false;
+    }
+    unsigned long long magnitude = 0;
+    auto res = std::from_chars(q, end, magnitude);
+    if (res.ec != std::errc()) {
+        return false;
+    }
+    if (negative) {
+        if (magnitude > static_cast<unsigned long long>(INT_MAX) + 1) {
+            return false;
+        }
+        value = static_cast<int>(-static_cast<long long>(magnitude));
+    } else {
+        if (magnitude > static_cast<unsigned long long>(INT_MAX)) {
+            return false;
+        }
+        value = static_cast<int>(magnitude);
+    }
+    p = res.ptr;
+    return true;
+}
+
+bool ParseDouble(const char*& p, const char* end, double& value) {
+    // Find the token the stream would accumulate: sign, digits, '.', digits,
+    // then an exponent only after a mantissa digit.
+    const char* start = skip_spaces(p, end);
+    const char* q = start;
+    if (q < end && (*q == '+' || *q == '-')) {
+        ++q;
+    }
+    bool mantissa = false;
+    while (q < end && is_digit(*q)) {
+        ++q;
+        mantissa = true;
+    }
+    if (q < end && *q == '.') {
+        ++q;
+        while (q < end && is_digit(*q)) {
+            ++q;
+            mantissa = true;
+        }
+    }
+    if (!mantissa) {
+        return false;
+    }
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        ++q;
+        if (q < end && (*q == '+' || *q == '-')) {
+            ++q;
+        }
+        const char* exponent = q;
+        while (q < end && is_digit(*q)) {
+            ++q;
+        }
+        if (q == exponent) {
+            return false;
+        }
+    }
+
+    const char* first = *start == '+' ? start + 1 : start;
+    auto res = std::from_chars(first, q, value, std::chars_format::general);
+    if (res.ec != std::errc() || res.ptr != q) {
+        // Overflow fails like in the stream; underflow keeps strtod's result.
+        std::string token(start, q);
+        double v = std::strtod(token.c_str(), nullptr);
+        if (std::isinf(v)) {
+            return false;
+        }
+        value = v;
+    }
+    p = q;
+    return true;
+}
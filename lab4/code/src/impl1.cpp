@@ -1,7 +1,8 @@
 #include "contracts.h"
+#include "plugin.h"
 #include <cmath>
 
-extern "C" double E(int x) {
+static inline double EValue(int x) {
     if (x <= 0) {
         return 0.0;
     }
@@ -9,6 +10,28 @@ extern "C" double E(int x) {
     return std::pow(base, static_cast<double>(x));
 }
 
+extern "C" double E(int x) {
+    return EValue(x);
+}
+
 extern "C" double Area(double a, double b) {
     return a * b;
 }
+
+extern "C" void E_batch(const int* x, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = EValue(x[i]);
+    }
+}
+
+extern "C" void Area_batch(const double* __restrict a, const double* __restrict b,
+                           double* __restrict out, size_t n) {
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = a[i] * b[i];
+    }
+}
+
+extern "C" const ImplPlugin impl_plugin = {
+    kImplPluginAbiVersion, "first", E, Area, E_batch, Area_batch,
+};
@@ -1,20 +1,74 @@
 #include "contracts.h"
+#include "plugin.h"
 
-extern "C" double E(int x) {
-    if (x < 0) {
-        return 0.0;
-    }
+namespace {
+
+// E(x) is the sum of 1/n! for n = 0..x. Terms only shrink, so once adding one
+// no longer changes the double sum, no later term does either: the sums are
+// tabulated at compile time up to that point and larger x reuse the last one.
+// The table is built with the same operations in the same order as the
+// running sum, so the results are bit-identical to it.
+constexpr int kTableCapacity = 64;
+
+struct ETable {
+    double values[kTableCapacity];
+    int saturated;
+};
+
+constexpr ETable BuildTable() {
+    ETable table{};
+    table.saturated = kTableCapacity;
     double result = 0.0;
     double term = 1.0;
-    for (int n = 0; n <= x; ++n) {
+    for (int n = 0; n < kTableCapacity; ++n) {
         if (n > 0) {
             term /= static_cast<double>(n);
         }
-        result += term;
+        double next = result + term;
+        if (n > 0 && next == result && table.saturated == kTableCapacity) {
+            table.saturated = n - 1;
+        }
+        result = next;
+        table.values[n] = result;
     }
-    return result;
+    return table;
+}
+
+constexpr ETable kTable = BuildTable();
+static_assert(kTable.saturated < kTableCapacity, "E(x) must saturate inside the table");
+
+inline double EValue(int x) {
+    if (x < 0) {
+        return 0.0;
+    }
+    return kTable.values[x < kTable.saturated ? x : kTable.saturated];
+}
+
+}  // namespace
+
+extern "C" double E(int x) {
+    return EValue(x);
 }
 
 extern "C" double Area(double a, double b) {
     return a * b / 2.0;
 }
+
+extern "C" void E_batch(const int* __restrict x, double* __restrict out, size_t n) {
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = EValue(x[i]);
+    }
+}
+
+extern "C" void Area_batch(const double* __restrict a, const double* __restrict b,
+                           double* __restrict out, size_t n) {
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = a[i] * b[i] / 2.0;
+    }
+}
+
+extern "C" const ImplPlugin impl_plugin = {
+    kImplPluginAbiVersion, "second", E, Area, E_batch, Area_batch,
+};
@@ -0,0 +1,40 @@
+#include "isa_variant.h"
+#include <cstdlib>
+
+const std::vector<std::string>& KnownIsaVariants() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const std::vector<std::string> variants = {"avx512", "avx2"};
+#else
+    static const std::vector<std::string> variants;
+#endif
+    return variants;
+}
+
+bool CpuSupports(const std::string& isa) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (isa == "avx512") {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+               __builtin_cpu_supports("avx512vl");
+    }
+    if (isa == "avx2") {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#endif
+    return isa == "baseline";
+}
+
+std::vector<std::string> UsableIsaVariants() {
+    const char* forced = std::getenv("IMPL_ISA");
+    std::vector<std::string> usable;
+    for (const auto& isa : KnownIsaVariants()) {
+        if ((!forced || isa == forced) && CpuSupports(isa)) {
+            usable.push_back(isa);
+        }
+    }
+    return usable;
+}
+
+std::string VariantPath(const std::string& dir, const std::string& file, const std::string& isa) {
+    return dir + "/variants/" + file.substr(0, file.size() - 3) + "." + isa + ".so";
+}
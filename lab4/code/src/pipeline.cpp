@@ -0,0 +1,118 @@
+#include "pipeline.h"
+#include <cstring>
+#include "trace.hpp"
+
+Pipeline::Pipeline(OutputBuffer& out, size_t workers)
+    : out_(out), max_in_flight_(workers * 4), submitted_(0), written_(0), stop_(false) {
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back(&Pipeline::WorkerLoop, this);
+    }
+    writer_ = std::thread(&Pipeline::WriterLoop, this);
+}
+
+Pipeline::~Pipeline() {
+    Drain();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    done_cv_.notify_all();
+    for (auto& t : workers_) {
+        t.join();
+    }
+    writer_.join();
+}
+
+void Pipeline::Submit(std::string lines, const BatchApi& api) {
+    auto chunk = std::make_shared<Chunk>();
+    chunk->lines = std::move(lines);
+    chunk->api = api;
+    Enqueue(std::move(chunk));
+}
+
+void Pipeline::SubmitText(std::string text) {
+    auto chunk = std::make_shared<Chunk>();
+    chunk->result.Append(text);
+    chunk->done = true;
+    Enqueue(std::move(chunk));
+}
+
+void Pipeline::Enqueue(std::shared_ptr<Chunk> chunk) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [this] { return in_order_.size() < max_in_flight_; });
+    ++submitted_;
+    in_order_.push_back(chunk);
+    if (chunk->done) {
+        done_cv_.notify_one();
+    } else {
+        pending_.push_back(std::move(chunk));
+        work_cv_.notify_one();
+    }
+}
+
+void Pipeline::Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [this] { return written_ == submitted_; });
+}
+
+void Pipeline::WorkerLoop() {
+    TRACE_THREAD_NAME("pipeline worker");
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                return;
+            }
+            chunk = std::move(pending_.front());
+            pending_.pop_front();
+        }
+
+        TRACE_SCOPE("chunk");
+        BatchDriver driver(chunk->result);
+        driver.SetApi(chunk->api);
+        const char* p = chunk->lines.data();
+        const char* end = p + chunk->lines.size();
+        while (p < end) {
+            auto nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!nl) {
+                nl = end;
+            }
+            RunCommand(std::string_view(p, static_cast<size_t>(nl - p)), driver, chunk->result);
+            p = nl + 1;
+        }
+        driver.Flush();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunk->done = true;
+        }
+        done_cv_.notify_one();
+    }
+}
+
+void Pipeline::WriterLoop() {
+    TRACE_THREAD_NAME("pipeline writer");
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cv_.wait(lock, [this] { return stop_ || (!in_order_.empty() && in_order_.front()->done); });
+            if (in_order_.empty() || !in_order_.front()->done) {
+                return;
+            }
+            chunk = std::move(in_order_.front());
+            in_order_.pop_front();
+        }
+
+        out_.Append(chunk->result.data());
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++written_;
+        }
+        space_cv_.notify_all();
+    }
+}
@@ -0,0 +1,282 @@
+#include "plugin_registry.h"
+#include "isa_variant.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool is_library_name(const std::string& name) {
+    return name.size() > 3 && name.compare(name.size() - 3, 3, ".so") == 0;
+}
+
+// Copies the library to a uniquely named temporary file, tmp, a mkstemps
+// template with suffix_len suffix characters. dlopen of the copy never matches
+// an already loaded name or inode, so glibc does not hand back a stale handle
+// for a library rebuilt under the same name, and later writes to the original
+// cannot touch mapped code of the reload. Returns an empty string on failure.
+static std::string copy_to_temp(const std::string& path, std::string tmp, int suffix_len) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return "";
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return "";
+    }
+    int out = mkstemps(&tmp[0], suffix_len);
+    if (out < 0) {
+        close(fd);
+        return "";
+    }
+    off_t left = st.st_size;
+    while (left > 0) {
+        ssize_t n = sendfile(out, fd, nullptr, static_cast<size_t>(left));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        left -= n;
+    }
+    close(fd);
+    close(out);
+    if (left > 0) {
+        unlink(tmp.c_str());
+        return "";
+    }
+    return tmp;
+}
+
+Plugin::Plugin(void* handle, const ImplPlugin* api, std::string path)
+    : handle_(handle), api_(api), path_(std::move(path)) {}
+
+Plugin::~Plugin() {
+    dlclose(handle_);
+}
+
+// dlopens a private copy of path made from template tmp; nullptr on failure.
+static void* open_copy(const std::string& path, const std::string& tmp, int suffix_len, int flags) {
+    std::string copy = copy_to_temp(path, tmp, suffix_len);
+    if (copy.empty()) {
+        return nullptr;
+    }
+    void* handle = dlopen(copy.c_str(), flags);
+    unlink(copy.c_str());
+    return handle;
+}
+
+// True the first time path is seen.
+static bool first_load(const std::string& path) {
+    static std::mutex mutex;
+    static std::set<std::string> loaded;
+    std::lock_guard<std::mutex> lock(mutex);
+    return loaded.insert(path).second;
+}
+
+std::shared_ptr<const Plugin> Plugin::Load(const std::string& path, int dlopen_flags) {
+    // Only a reload needs the copy; the first load opens the file in place,
+    // so startup copies nothing. A copy in TMPDIR fails to map if that is
+    // mounted noexec; the next try is next to the library, under a name that
+    // is not *.so so Refresh() ignores it. Failing both, the reload opens the
+    // file itself, and glibc returns the previous build while that is loaded.
+    int flags = dlopen_flags | RTLD_LOCAL;
+    void* handle = nullptr;
+    if (!first_load(path)) {
+        const char* tmpdir = getenv("TMPDIR");
+        handle = open_copy(path, std::string(tmpdir ? tmpdir : "/tmp") + "/impl_plugin_XXXXXX.so", 3, flags);
+        if (!handle) {
+            size_t slash = path.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+            handle = open_copy(path, dir + "/.impl_plugin_XXXXXX", 0, flags);
+        }
+    }
+    if (!handle) {
+        handle = dlopen(path.c_str(), flags);
+    }
+    if (!handle) {
+        std::cerr << path << ": " << dlerror() << std::endl;
+        return nullptr;
+    }
+
+    dlerror();
+    auto api = static_cast<const ImplPlugin*>(dlsym(handle, IMPL_PLUGIN_SYMBOL));
+    const char* err = dlerror();
+    if (err || !api) {
+        std::cerr << path << ": no " IMPL_PLUGIN_SYMBOL " descriptor" << std::endl;
+        dlclose(handle);
+        return nullptr;
+    }
+    if (api->abi_version != kImplPluginAbiVersion) {
+        std::cerr << path << ": plugin ABI " << api->abi_version << ", expected "
+                  << kImplPluginAbiVersion << std::endl;
+        dlclose(handle);
+        return nullptr;
+    }
+    return std::shared_ptr<const Plugin>(new Plugin(handle, api, path));
+}
+
+PluginRegistry::PluginRegistry(std::string dir, LoadMode mode)
+    : dir_(std::move(dir)), mode_(mode), isa_variants_(UsableIsaVariants()), inotify_fd_(-1), variants_wd_(-1) {}
+
+PluginRegistry::~PluginRegistry() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+void PluginRegistry::Scan() {
+    DIR* d = opendir(dir_.c_str());
+    if (!d) {
+        std::perror(("opendir(" + dir_ + ")").c_str());
+        return;
+    }
+    std::vector<std::string> files;
+    while (dirent* ent = readdir(d)) {
+        std::string name = ent->d_name;
+        if (is_library_name(name)) {
+            files.push_back(name);
+        }
+    }
+    closedir(d);
+
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files) {
+        LoadFile(file);
+    }
+}
+
+bool PluginRegistry::Watch() {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        std::perror("inotify_init1");
+        return false;
+    }
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+    if (inotify_add_watch(inotify_fd_, dir_.c_str(), mask) < 0) {
+        std::perror(("inotify_add_watch(" + dir_ + ")").c_str());
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+        return false;
+    }
+    // Optional: rebuilt variants reload their baseline slot.
+    variants_wd_ = inotify_add_watch(inotify_fd_, (dir_ + "/variants").c_str(), mask);
+    return true;
+}
+
+bool PluginRegistry::Refresh() {
+    if (inotify_fd_ < 0) {
+        return false;
+    }
+    bool changed = false;
+    alignas(inotify_event) char buf[4096];
+    while (true) {
+        ssize_t n = read(inotify_fd_, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (char* p = buf; p < buf + n;) {
+            auto* ev = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+            if (ev->len == 0) {
+                continue;
+            }
+            std::string name = ev->name;
+            if (!is_library_name(name)) {
+                continue;
+            }
+            if (ev->wd == variants_wd_) {
+                // lib<name>.<isa>.so -> lib<name>.so, if that one is loaded
+                std::string stem = name.substr(0, name.size() - 3);
+                size_t dot = stem.rfind('.');
+                if (dot == std::string::npos || Find(stem.substr(0, dot) + ".so") == slots_.size()) {
+                    continue;
+                }
+                LoadFile(stem.substr(0, dot) + ".so");
+                changed = true;
+                continue;
+            }
+            if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                LoadFile(name);
+            } else {
+                RemoveFile(name);
+            }
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+std::shared_ptr<const Plugin> PluginRegistry::Get(size_t index) {
+    Slot& slot = slots_[index];
+    auto plugin = std::atomic_load(&slot.plugin);
+    if (!plugin && !slot.failed) {
+        plugin = Open(slot.file);
+        slot.failed = !plugin;
+        std::atomic_store(&slot.plugin, plugin);
+    }
+    return plugin;
+}
+
+size_t PluginRegistry::Find(const std::string& file) const {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (slots_[i].file == file) {
+            return i;
+        }
+    }
+    return slots_.size();
+}
+
+// The best variant for this CPU if it was built, else the baseline.
+std::shared_ptr<const Plugin> PluginRegistry::Open(const std::string& file) const {
+    int flags = mode_ == LoadMode::Now ? RTLD_NOW : RTLD_LAZY;
+    for (const auto& isa : isa_variants_) {
+        std::string path = VariantPath(dir_, file, isa);
+        if (access(path.c_str(), R_OK) == 0) {
+            if (auto plugin = Plugin::Load(path, flags)) {
+                return plugin;
+            }
+        }
+    }
+    return Plugin::Load(dir_ + "/" + file, flags);
+}
+
+void PluginRegistry::LoadFile(const std::string& file) {
+    // Deferred modes drop a changed library and reopen it on the next Get().
+    std::shared_ptr<const Plugin> plugin;
+    if (mode_ == LoadMode::Eager) {
+        plugin = Open(file);
+        if (!plugin) {
+            return;
+        }
+    }
+    size_t i = Find(file);
+    if (i < slots_.size()) {
+        slots_[i].failed = false;
+        std::atomic_store(&slots_[i].plugin, plugin);
+        return;
+    }
+    auto pos = std::lower_bound(slots_.begin(), slots_.end(), file,
+                                [](const Slot& s, const std::string& f) { return s.file < f; });
+    slots_.insert(pos, Slot{file, plugin, false});
+}
+
+void PluginRegistry::RemoveFile(const std::string& file) {
+    size_t i = Find(file);
+    if (i < slots_.size()) {
+        slots_.erase(slots_.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+}
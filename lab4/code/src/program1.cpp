@@ -1,45 +1,86 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <unistd.h>
+#include "batch_driver.h"
 #include "contracts.h"
+#include "fast_io.h"
+#include "pipeline.h"
 
-int main() {
-    std::ios::sync_with_stdio(false);
-    std::cin.tie(nullptr);
+static constexpr size_t kChunkBytes = 128 * 1024;
 
-    std::string line;
-    while (std::getline(std::cin, line)) {
-        if (line.empty()) {
-            continue;
+static void run_serial(LineReader& reader, OutputBuffer& out) {
+    BatchDriver driver(out);
+    driver.SetApi(BatchApi{E_batch, Area_batch});
+
+    std::string_view line;
+    while (true) {
+        // Do not sit on results while waiting for more input.
+        if (!reader.HasLine()) {
+            driver.Flush();
+            out.Flush();
         }
-        std::istringstream iss(line);
-        int cmd;
-        if (!(iss >> cmd)) {
-            continue;
+        if (!reader.Next(line)) {
+            break;
         }
-        if (cmd == 1) {
-            int x;
-            if (!(iss >> x)) {
-                std::cout << "error" << std::endl;
-                continue;
-            }
-            double value = E(x);
-            std::cout.setf(std::ios::fixed);
-            std::cout.precision(10);
-            std::cout << value << std::endl;
-        } else if (cmd == 2) {
-            double a;
-            double b;
-            if (!(iss >> a >> b)) {
-                std::cout << "error" << std::endl;
-                continue;
+        RunCommand(line, driver, out);
+    }
+    driver.Flush();
+}
+
+static void run_pipelined(LineReader& reader, OutputBuffer& out, size_t jobs) {
+    const BatchApi api{E_batch, Area_batch};
+    Pipeline pipeline(out, jobs);
+    std::string chunk;
+    std::string_view line;
+    while (true) {
+        if (!reader.HasLine()) {
+            if (!chunk.empty()) {
+                pipeline.Submit(std::move(chunk), api);
+                chunk.clear();
             }
-            double value = Area(a, b);
-            std::cout.setf(std::ios::fixed);
-            std::cout.precision(10);
-            std::cout << value << std::endl;
+            pipeline.Drain();
+            out.Flush();
+        }
+        if (!reader.Next(line)) {
+            break;
+        }
+        chunk.append(line);
+        chunk.push_back('\n');
+        if (chunk.size() >= kChunkBytes) {
+            pipeline.Submit(std::move(chunk), api);
+            chunk.clear();
         }
     }
+    if (!chunk.empty()) {
+        pipeline.Submit(std::move(chunk), api);
+    }
+}
+
+// Usage: program1 [-j workers]
+// With -j the commands are evaluated in chunks on that many threads; the
+// output is the same as without.
+int main(int argc, char** argv) {
+    size_t jobs = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = static_cast<size_t>(std::atoi(argv[++i]));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [-j workers]" << std::endl;
+            return 1;
+        }
+    }
+
+    LineReader reader(STDIN_FILENO);
+    OutputBuffer out(STDOUT_FILENO);
+    if (jobs > 0) {
+        run_pipelined(reader, out, jobs);
+    } else {
+        run_serial(reader, out);
+    }
+    out.Flush();
 
     return 0;
 }
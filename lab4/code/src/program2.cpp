@@ -1,104 +1,212 @@
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <string>
-#include <dlfcn.h>
-#include "contracts.h"
+#include <string_view>
+#include <unistd.h>
+#include "auto_tuner.h"
+#include "batch_driver.h"
+#include "fast_io.h"
+#include "pipeline.h"
+#include "plugin_registry.h"
 
-using e_func_t = double (*)(int);
-using area_func_t = double (*)(double, double);
+static constexpr size_t kSampleSize = 4096;
+static constexpr size_t kChunkBytes = 128 * 1024;
 
-struct Library {
-    void* handle;
-    e_func_t e;
-    area_func_t area;
-};
-
-bool load_library(const char* path, Library& lib) {
-    lib.handle = dlopen(path, RTLD_LAZY);
-    if (!lib.handle) {
-        std::cerr << dlerror() << std::endl;
-        return false;
-    }
-    dlerror();
-    lib.e = reinterpret_cast<e_func_t>(dlsym(lib.handle, "E"));
-    const char* err1 = dlerror();
-    if (err1) {
-        std::cerr << err1 << std::endl;
-        dlclose(lib.handle);
-        lib.handle = nullptr;
-        return false;
-    }
-    lib.area = reinterpret_cast<area_func_t>(dlsym(lib.handle, "Area"));
-    const char* err2 = dlerror();
-    if (err2) {
-        std::cerr << err2 << std::endl;
-        dlclose(lib.handle);
-        lib.handle = nullptr;
-        return false;
+// Usage: program2 [plugin_dir] [-j workers] [--load=lazy|now|eager] [--auto]
+//                 [--reference=FILE] [--tolerance=T] [--profile=FILE]
+// Loads every implementation library found in plugin_dir (default ".") and
+// reloads them when they change on disk. Command 0 moves to the next one in
+// file name order. A library is opened when it is first selected (--load,
+// see LoadMode). With --auto there is one more entry after the libraries,
+// selected at start: E and Area each go to the fastest library that agrees
+// with the reference within the tolerance (see AutoTuner). Command 3 prints
+// the measurements behind that choice. -j evaluates the commands on worker
+// threads (see Pipeline) with the same output.
+int main(int argc, char** argv) {
+    std::string dir = ".";
+    size_t jobs = 0;
+    bool auto_mode = false;
+    LoadMode load_mode = LoadMode::Lazy;
+    TuneOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            jobs = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--load=eager") {
+            load_mode = LoadMode::Eager;
+        } else if (arg == "--load=lazy") {
+            load_mode = LoadMode::Lazy;
+        } else if (arg == "--load=now") {
+            load_mode = LoadMode::Now;
+        } else if (arg == "--auto") {
+            auto_mode = true;
+        } else if (arg.rfind("--reference=", 0) == 0) {
+            options.reference = arg.substr(12);
+        } else if (arg.rfind("--tolerance=", 0) == 0) {
+            options.tolerance = std::atof(arg.c_str() + 12);
+        } else if (arg.rfind("--profile=", 0) == 0) {
+            options.profile = arg.substr(10);
+        } else {
+            dir = arg;
+        }
     }
-    return true;
-}
 
-int main() {
-    std::ios::sync_with_stdio(false);
-    std::cin.tie(nullptr);
+    PluginRegistry registry(dir, load_mode);
+    registry.Scan();
+    if (registry.Size() == 0) {
+        std::cerr << "no implementation libraries found" << std::endl;
+        return 1;
+    }
 
-    Library lib1{};
-    Library lib2{};
+    LineReader reader(STDIN_FILENO);
+    OutputBuffer out(STDOUT_FILENO);
+    BatchDriver driver(out);
 
-    if (!load_library("./libimpl_first.so", lib1)) {
-        return 1;
+    std::unique_ptr<AutoTuner> tuner;
+    if (auto_mode) {
+        tuner = std::make_unique<AutoTuner>(options, BuildSample(reader.Peek(), kSampleSize));
+        tuner->Tune(registry);
     }
-    if (!load_library("./libimpl_second.so", lib2)) {
-        dlclose(lib1.handle);
+
+    // index == registry.Size() is the tuned entry; current_file is empty then
+    // and the tuner keeps the libraries in use alive. Libraries are only
+    // replaced or unloaded by Refresh/Tune, i.e. while no chunk is in flight.
+    size_t index = 0;
+    std::string current_file;
+    std::shared_ptr<const Plugin> current;
+    BatchApi api{nullptr, nullptr};
+    // false if there is nothing to run the commands on: neither the tuner
+    // nor any library loaded.
+    auto select = [&](size_t i) {
+        index = i;
+        if (index == registry.Size()) {
+            api = tuner->api();
+            if (api.e_batch) {
+                driver.SetApi(api);
+                current_file.clear();
+                current = nullptr;
+                return true;
+            }
+            index = 0;
+        }
+        // A library that fails to load on first use is skipped.
+        std::shared_ptr<const Plugin> next;
+        for (size_t tries = 0; tries < registry.Size() && !(next = registry.Get(index)); ++tries) {
+            index = (index + 1) % registry.Size();
+        }
+        if (!next) {
+            return api.e_batch != nullptr;
+        }
+        current_file = registry.FileName(index);
+        api = next->batch();
+        driver.SetApi(api);
+        current = std::move(next);
+        return true;
+    };
+    auto no_library = [] {
+        std::cerr << "no implementation library could be loaded" << std::endl;
         return 1;
+    };
+    if (!select(tuner ? registry.Size() : 0)) {
+        return no_library();
     }
 
-    Library* current = &lib1;
-
-    std::string line;
-    while (std::getline(std::cin, line)) {
-        if (line.empty()) {
-            continue;
+    std::unique_ptr<Pipeline> pipeline;
+    if (jobs > 0) {
+        pipeline = std::make_unique<Pipeline>(out, jobs);
+    }
+    // Pipelined mode: lines collected for the current api. Commands 0 and 3
+    // end the chunk, so every chunk runs on the implementation that was
+    // selected when its lines were read.
+    std::string chunk;
+    auto submit_chunk = [&] {
+        if (!chunk.empty()) {
+            pipeline->Submit(std::move(chunk), api);
+            chunk.clear();
         }
-        std::istringstream iss(line);
-        int cmd;
-        if (!(iss >> cmd)) {
-            continue;
+    };
+    auto emit = [&](std::string_view text) {
+        if (pipeline) {
+            pipeline->SubmitText(std::string(text));
+        } else {
+            driver.Flush();
+            out.Append(text);
         }
-        if (cmd == 0) {
-            if (current == &lib1) {
-                current = &lib2;
+    };
+
+    bool watching = false;
+    std::string_view line;
+    while (true) {
+        // Do not sit on results while waiting for more input, and pick up
+        // rebuilt libraries between input blocks.
+        if (!reader.HasLine()) {
+            if (pipeline) {
+                submit_chunk();
+                pipeline->Drain();
             } else {
-                current = &lib1;
+                driver.Flush();
             }
-            std::cout << "switched" << std::endl;
-        } else if (cmd == 1) {
-            int x;
-            if (!(iss >> x)) {
-                std::cout << "error" << std::endl;
+            out.Flush();
+            // The watch is set up the first time we wait: closing an inotify
+            // descriptor waits for an RCU grace period, several ms at exit
+            // that a run fed all of its input at once should not pay.
+            // Libraries changed before that point are not noticed.
+            if (!watching) {
+                watching = true;
+                registry.Watch();
+            } else if (registry.Refresh() && registry.Size() > 0) {
+                if (tuner) {
+                    tuner->Tune(registry);
+                }
+                size_t i = registry.Find(current_file);
+                if (i == registry.Size() && !(tuner && current_file.empty())) {
+                    i = 0;
+                }
+                if (!select(i)) {
+                    return no_library();
+                }
+            }
+        }
+        if (!reader.Next(line)) {
+            break;
+        }
+        int cmd;
+        if (pipeline) {
+            const char* p = line.data();
+            if (!ParseInt(p, p + line.size(), cmd)) {
                 continue;
             }
-            double value = current->e(x);
-            std::cout.setf(std::ios::fixed);
-            std::cout.precision(10);
-            std::cout << value << std::endl;
-        } else if (cmd == 2) {
-            double a;
-            double b;
-            if (!(iss >> a >> b)) {
-                std::cout << "error" << std::endl;
+            if (cmd != 0 && !(cmd == 3 && tuner)) {
+                chunk.append(line);
+                chunk.push_back('\n');
+                if (chunk.size() >= kChunkBytes) {
+                    submit_chunk();
+                }
                 continue;
             }
-            double value = current->area(a, b);
-            std::cout.setf(std::ios::fixed);
-            std::cout.precision(10);
-            std::cout << value << std::endl;
+            submit_chunk();
+        } else {
+            cmd = RunCommand(line, driver, out);
         }
-    }
 
-    dlclose(lib1.handle);
-    dlclose(lib2.handle);
+        if (cmd == 0) {
+            if (registry.Size() > 0 && !select((index + 1) % (registry.Size() + (tuner ? 1 : 0)))) {
+                return no_library();
+            }
+            emit("switched\n");
+        } else if (cmd == 3 && tuner) {
+            OutputBuffer report;
+            tuner->Report(report);
+            emit(report.data());
+        }
+    }
+    if (pipeline) {
+        submit_chunk();
+        pipeline->Drain();
+    }
+    driver.Flush();
+    out.Flush();
 
     return 0;
 }
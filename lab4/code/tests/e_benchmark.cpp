@@ -0,0 +1,132 @@
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <dlfcn.h>
+
+// Per-call cost of E(x) and E_batch across x ranges for each library.
+// Usage: e_benchmark [lib.so ...]   (default ./libimpl_first.so ./libimpl_second.so)
+
+using e_func_t = double (*)(int);
+using e_batch_func_t = void (*)(const int*, double*, size_t);
+
+struct Range {
+    const char* name;
+    int lo;
+    int hi;
+};
+
+static double series_reference(int x) {
+    double result = 0.0;
+    double term = 1.0;
+    for (int n = 0; n <= x; ++n) {
+        if (n > 0) {
+            term /= static_cast<double>(n);
+        }
+        result += term;
+    }
+    return result;
+}
+
+template<typename Func>
+double ns_per_call(size_t calls, Func&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / calls;
+}
+
+int main(int argc, char** argv) {
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; ++i) {
+        paths.push_back(argv[i]);
+    }
+    if (paths.empty()) {
+        paths = {"./libimpl_first.so", "./libimpl_second.so"};
+    }
+
+    const Range ranges[] = {
+        {"[0, 16)", 0, 15},
+        {"[16, 1e3)", 16, 999},
+        {"[1e3, 1e6)", 1000, 999999},
+        {"[1e6, INT_MAX]", 1000000, INT_MAX},
+    };
+    const size_t calls = 1 << 20;
+
+    std::cout << std::left << std::setw(24) << "library" << std::setw(16) << "x range"
+              << std::right << std::setw(12) << "E ns/call" << std::setw(14) << "batch ns/elem" << "\n";
+
+    for (const char* path : paths) {
+        void* handle = dlopen(path, RTLD_NOW);
+        if (!handle) {
+            std::cerr << dlerror() << std::endl;
+            return 1;
+        }
+        auto e = reinterpret_cast<e_func_t>(dlsym(handle, "E"));
+        auto e_batch = reinterpret_cast<e_batch_func_t>(dlsym(handle, "E_batch"));
+        if (!e || !e_batch) {
+            std::cerr << path << ": missing E or E_batch" << std::endl;
+            return 1;
+        }
+
+        for (const Range& r : ranges) {
+            std::mt19937 gen(42);
+            std::uniform_int_distribution<int> dis(r.lo, r.hi);
+            std::vector<int> xs(calls);
+            for (int& x : xs) {
+                x = dis(gen);
+            }
+            std::vector<double> out(calls);
+
+            volatile double sink = 0.0;
+            double scalar = ns_per_call(calls, [&]() {
+                double acc = 0.0;
+                for (int x : xs) {
+                    acc += e(x);
+                }
+                sink = acc;
+            });
+            double batch = ns_per_call(calls, [&]() {
+                e_batch(xs.data(), out.data(), calls);
+                sink = out[calls - 1];
+            });
+            (void)sink;
+
+            size_t mismatches = 0;
+            for (size_t i = 0; i < calls; ++i) {
+                double v = e(xs[i]);
+                if (std::memcmp(&v, &out[i], sizeof(v)) != 0) {
+                    ++mismatches;
+                }
+            }
+
+            std::cout << std::left << std::setw(24) << path << std::setw(16) << r.name << std::right
+                      << std::fixed << std::setprecision(2) << std::setw(12) << scalar
+                      << std::setw(14) << batch;
+            if (mismatches) {
+                std::cout << "  batch != scalar for " << mismatches << " x";
+            }
+            std::cout << "\n";
+        }
+
+        // The running series is what the table replaced; check it still agrees.
+        if (std::strstr(path, "second")) {
+            size_t mismatches = 0;
+            for (int x = -2; x <= 20000; ++x) {
+                double want = x < 0 ? 0.0 : series_reference(x);
+                double got = e(x);
+                if (std::memcmp(&want, &got, sizeof(got)) != 0) {
+                    ++mismatches;
+                }
+            }
+            std::cout << path << ": table vs running series for x in [-2, 20000]: "
+                      << (mismatches ? "MISMATCH" : "bit-identical") << "\n";
+        }
+
+        dlclose(handle);
+    }
+    return 0;
+}
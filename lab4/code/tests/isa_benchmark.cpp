@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+#include "isa_variant.h"
+#include "plugin_registry.h"
+
+// Compares the ISA variants of each implementation library: per-element cost
+// of the scalar and batch entry points, and whether the results are
+// bit-identical to the baseline build.
+// Usage: isa_benchmark [build_dir]   (default ".")
+
+template<typename Func>
+double ns_per_call(size_t calls, Func&& f) {
+    double best = 1e300;
+    for (int round = 0; round < 5; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / calls);
+    }
+    return best;
+}
+
+struct Results {
+    std::vector<double> e;
+    std::vector<double> area;
+};
+
+static size_t mismatches(const std::vector<double>& got, const std::vector<double>& want) {
+    size_t n = 0;
+    for (size_t i = 0; i < got.size(); ++i) {
+        if (std::memcmp(&got[i], &want[i], sizeof(double)) != 0) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char** argv) {
+    std::string dir = argc >= 2 ? argv[1] : ".";
+    const size_t calls = 1 << 20;
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> xdis(0, 100000);
+    std::uniform_real_distribution<double> ddis(0.0, 1000.0);
+    std::vector<int> xs(calls);
+    std::vector<double> as(calls);
+    std::vector<double> bs(calls);
+    for (size_t i = 0; i < calls; ++i) {
+        xs[i] = xdis(gen);
+        as[i] = ddis(gen);
+        bs[i] = ddis(gen);
+    }
+
+    std::cout << std::left << std::setw(20) << "library" << std::setw(10) << "isa" << std::right
+              << std::setw(10) << "E" << std::setw(10) << "E_batch" << std::setw(10) << "Area"
+              << std::setw(12) << "Area_batch" << "   (ns/elem)\n";
+
+    for (const char* file : {"libimpl_first.so", "libimpl_second.so"}) {
+        std::vector<std::string> isas = {"baseline"};
+        for (const auto& isa : KnownIsaVariants()) {
+            isas.push_back(isa);
+        }
+
+        Results baseline;
+        for (const auto& isa : isas) {
+            if (!CpuSupports(isa)) {
+                std::cout << std::left << std::setw(20) << file << std::setw(10) << isa
+                          << "not supported by this CPU\n";
+                continue;
+            }
+            std::string path = isa == "baseline" ? dir + "/" + file : VariantPath(dir, file, isa);
+            auto plugin = Plugin::Load(path, RTLD_NOW);
+            if (!plugin) {
+                return 1;
+            }
+            const ImplPlugin& api = plugin->api();
+
+            Results r;
+            r.e.resize(calls);
+            r.area.resize(calls);
+            double e_ns = ns_per_call(calls, [&]() {
+                for (size_t i = 0; i < calls; ++i) {
+                    r.e[i] = api.e(xs[i]);
+                }
+            });
+            double area_ns = ns_per_call(calls, [&]() {
+                for (size_t i = 0; i < calls; ++i) {
+                    r.area[i] = api.area(as[i], bs[i]);
+                }
+            });
+            std::vector<double> out(calls);
+            double e_batch_ns = ns_per_call(calls, [&]() { api.e_batch(xs.data(), out.data(), calls); });
+            size_t bad = mismatches(out, r.e);
+            double area_batch_ns = ns_per_call(calls, [&]() {
+                api.area_batch(as.data(), bs.data(), out.data(), calls);
+            });
+            bad += mismatches(out, r.area);
+
+            std::cout << std::left << std::setw(20) << file << std::setw(10) << isa << std::right
+                      << std::fixed << std::setprecision(3) << std::setw(10) << e_ns << std::setw(10)
+                      << e_batch_ns << std::setw(10) << area_ns << std::setw(12) << area_batch_ns;
+            if (bad) {
+                std::cout << "  batch != scalar for " << bad << " elements";
+            }
+            if (isa == "baseline") {
+                baseline = std::move(r);
+            } else {
+                size_t diff = mismatches(r.e, baseline.e) + mismatches(r.area, baseline.area);
+                std::cout << (diff ? "  DIFFERS from baseline" : "  bit-identical to baseline");
+            }
+            std::cout << "\n";
+        }
+    }
+    return 0;
+}
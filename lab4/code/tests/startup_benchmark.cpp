@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Time from fork+exec of program2 to the first byte of its output, and to its
+// exit, for each plugin loading mode. The input is a single E command, as in
+// a short-lived filter that never switches implementation.
+// Usage: startup_benchmark [program2] [plugin_dir] [runs]
+//        (default ./program2 . 200)
+
+struct Sample {
+    double first_output;
+    double exit;
+};
+
+static Sample run_once(const std::string& program, const std::string& dir, const char* mode) {
+    int in[2];
+    int out[2];
+    if (pipe(in) < 0 || pipe(out) < 0) {
+        std::perror("pipe");
+        std::exit(EXIT_FAILURE);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        std::exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        execl(program.c_str(), program.c_str(), dir.c_str(), mode, static_cast<char*>(nullptr));
+        std::perror("execl");
+        _exit(EXIT_FAILURE);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    const char command[] = "1 5\n";
+    if (write(in[1], command, sizeof(command) - 1) < 0) {
+        std::perror("write");
+    }
+    close(in[1]);
+
+    char c;
+    ssize_t n = read(out[0], &c, 1);
+    auto first = std::chrono::steady_clock::now();
+    if (n != 1) {
+        std::cerr << mode << ": no output" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    char rest[256];
+    while (read(out[0], rest, sizeof(rest)) > 0) {
+    }
+    close(out[0]);
+    waitpid(pid, nullptr, 0);
+    auto end = std::chrono::steady_clock::now();
+    return Sample{std::chrono::duration<double, std::micro>(first - start).count(),
+                  std::chrono::duration<double, std::micro>(end - start).count()};
+}
+
+static double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    return v[static_cast<size_t>(p * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+    std::string program = argc >= 2 ? argv[1] : "./program2";
+    std::string dir = argc >= 3 ? argv[2] : ".";
+    int runs = argc >= 4 ? std::atoi(argv[3]) : 200;
+
+    const char* modes[] = {"--load=eager", "--load=lazy", "--load=now"};
+
+    // Interleave the modes so that drift in machine load hits all of them.
+    std::vector<double> first[3];
+    std::vector<double> exit[3];
+    for (int i = 0; i <= runs; ++i) {
+        for (int m = 0; m < 3; ++m) {
+            Sample s = run_once(program, dir, modes[m]);
+            if (i > 0) {
+                first[m].push_back(s.first_output);
+                exit[m].push_back(s.exit);
+            }
+        }
+    }
+
+    std::cout << std::left << std::setw(16) << "mode" << std::right << std::setw(14) << "first p50 us"
+              << std::setw(14) << "first p90 us" << std::setw(14) << "exit p50 us" << std::setw(14)
+              << "exit p90 us" << "\n";
+    for (int m = 0; m < 3; ++m) {
+        std::cout << std::left << std::setw(16) << modes[m] << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << percentile(first[m], 0.5) << std::setw(14) << percentile(first[m], 0.9)
+                  << std::setw(14) << percentile(exit[m], 0.5) << std::setw(14) << percentile(exit[m], 0.9)
+                  << "\n";
+    }
+    return 0;
+}
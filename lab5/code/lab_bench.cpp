@@ -0,0 +1,649 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "perf_counters.hpp"
+#include "syscall_counter.hpp"
+
+// Runs the lab binaries on fixed synthetic inputs, collects perf_event_open
+// counters (median of --runs runs) and syscall counts (one ptrace-traced
+// run), and compares them with a stored baseline.
+//
+// Usage: lab_bench [--root DIR] [--build NAME] [--baseline FILE] [--update]
+//                  [--threshold PCT] [--noisy-threshold PCT] [--runs N]
+//                  [--only name,...] [--no-syscalls]
+//
+// Binaries are taken from <root>/<lab>/code/<build>. The root defaults to
+// the repository this lab_bench was built in (it lives in
+// <root>/lab5/code/<build>), the build directory name to "build".
+// Benchmarks whose binary is missing are skipped. A metric regresses
+// if it grows by more than --threshold percent (default 10) and by more than
+// a small absolute amount. Times and metrics that depend on scheduling
+// (context switches, futex, sleep and poll calls) use --noisy-threshold
+// (default 30) instead. Exit status: 0 ok, 1 regression or failed run, 2 usage.
+// --update writes the measured values into the baseline instead.
+
+using Metrics = std::map<std::string, double>;
+
+struct Benchmark {
+    std::string name;
+    std::string dir;                // relative to the root
+    std::vector<std::string> argv;  // argv[0] relative to the build directory
+    std::string input;              // file name in the input directory, fed to stdin
+    void (*client)(pid_t server);   // drives the process while it runs, or null
+};
+
+struct Options {
+    std::string root;
+    std::string build = "build";
+    std::string baseline = "lab_bench.baseline";
+    bool update = false;
+    double threshold = 10.0;
+    double noisy_threshold = 30.0;
+    int runs = 5;
+    bool syscalls = true;
+    std::vector<std::string> only;
+};
+
+static std::string g_input_dir;
+static std::vector<std::string> g_inputs;
+
+static std::string InputPath(const std::string &name) {
+    return g_input_dir + "/" + name;
+}
+
+static void WriteInput(const std::string &name, const std::string &data) {
+    std::ofstream out(InputPath(name), std::ios::binary);
+    out << data;
+    g_inputs.push_back(name);
+}
+
+static void RemoveInputs() {
+    for (const std::string &name : g_inputs) {
+        unlink(InputPath(name).c_str());
+    }
+    rmdir(g_input_dir.c_str());
+}
+
+// All inputs come from a fixed seed, so every run sees the same data.
+static void GenerateInputs() {
+    std::mt19937 rng(207);
+    auto composite = [&rng]() {
+        std::uniform_int_distribution<int> factor(2, 3000);
+        return factor(rng) * factor(rng);
+    };
+
+    std::string lab1;
+    for (int i = 0; i < 50000; ++i) {
+        lab1 += std::to_string(composite()) + "\n";
+    }
+    lab1 += "-1\n";
+    WriteInput("lab1.txt", lab1);
+    WriteInput("lab1.stdin", InputPath("lab1.txt") + "\n");
+
+    std::string lab3;
+    for (int i = 0; i < 200000; ++i) {
+        lab3 += std::to_string(composite()) + (i % 16 == 15 ? "\n" : " ");
+    }
+    lab3 += "-1\n";
+    WriteInput("lab3.txt", lab3);
+    WriteInput("lab3.stdin", InputPath("lab3.txt") + "\n");
+
+    // The slot transport sleeps 1 ms per handoff, so keep it short.
+    std::string lab3_slot;
+    for (int i = 0; i < 300; ++i) {
+        lab3_slot += std::to_string(composite()) + " ";
+    }
+    lab3_slot += "-1\n";
+    WriteInput("lab3_slot.txt", lab3_slot);
+    WriteInput("lab3_slot.stdin", InputPath("lab3_slot.txt") + "\n");
+
+    std::uniform_int_distribution<int> cell(-9, 9);
+    std::string matrix;
+    const int n = 9;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            matrix += std::to_string(cell(rng)) + (j + 1 < n ? " " : "\n");
+        }
+    }
+    WriteInput("lab2_serial.stdin", std::to_string(n) + "\n" + matrix);
+    WriteInput("lab2_parallel.stdin", std::to_string(n) + " 4\n" + matrix);
+
+    std::uniform_int_distribution<int> e_arg(1, 100000);
+    std::uniform_real_distribution<double> side(-1000.0, 1000.0);
+    std::string lab4;
+    std::string lab4_switching;
+    for (int i = 0; i < 200000; ++i) {
+        std::string line;
+        if (i % 2 == 0) {
+            line = "1 " + std::to_string(e_arg(rng)) + "\n";
+        } else {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "2 %.6f %.6f\n", side(rng), side(rng));
+            line = buf;
+        }
+        lab4 += line;
+        lab4_switching += line;
+        if (i % 1000 == 999) {
+            lab4_switching += "0\n";
+        }
+    }
+    WriteInput("lab4.txt", lab4);
+    WriteInput("lab4_switching.txt", lab4_switching);
+    WriteInput("empty.txt", "");
+}
+
+static bool WriteAll(int fd, const std::string &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static int OpenWhenReady(const std::string &path, int flags, int timeout_ms) {
+    for (int waited = 0; waited < timeout_ms; waited += 5) {
+        int fd = open(path.c_str(), flags);
+        if (fd >= 0) {
+            return fd;
+        }
+        usleep(5000);
+    }
+    return -1;
+}
+
+// Four users exchanging private messages and posting to a common group, as
+// im_client would. Replies are drained so the server never finds a client
+// FIFO full. Stops the server with SIGINT when done.
+static void ImClient(pid_t server) {
+    const int kUsers = 4;
+    const int kMessages = 4000;
+    const char *cmd_fifo = "/tmp/im_server_cmd.fifo";
+
+    // Opening a FIFO for writing fails with ENXIO until the server reads it.
+    int cmd = OpenWhenReady(cmd_fifo, O_WRONLY | O_NONBLOCK, 5000);
+    if (cmd < 0) {
+        kill(server, SIGINT);
+        return;
+    }
+    fcntl(cmd, F_SETFL, fcntl(cmd, F_GETFL) & ~O_NONBLOCK);
+    std::string setup;
+    for (int u = 0; u < kUsers; ++u) {
+        setup += "CONNECT bench" + std::to_string(u) + "\n";
+    }
+    setup += "CREATEGROUP bench0 bench\n";
+    for (int u = 1; u < kUsers; ++u) {
+        setup += "JOINGROUP bench" + std::to_string(u) + " bench\n";
+    }
+    WriteAll(cmd, setup);
+
+    std::vector<int> inboxes;
+    for (int u = 0; u < kUsers; ++u) {
+        std::string path = "/tmp/im_client_bench" + std::to_string(u) + ".fifo";
+        int fd = OpenWhenReady(path, O_RDONLY | O_NONBLOCK, 2000);
+        if (fd >= 0) {
+            inboxes.push_back(fd);
+        }
+    }
+    int group = OpenWhenReady("/tmp/im_group_bench.fifo", O_WRONLY | O_NONBLOCK, 2000);
+
+    auto drain = [&inboxes](int timeout_ms) {
+        std::vector<pollfd> fds;
+        for (int fd : inboxes) {
+            fds.push_back(pollfd{fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), timeout_ms) <= 0) {
+            return false;
+        }
+        // POLLHUP stays set once the server closes its end, so only data
+        // counts as activity.
+        char buf[4096];
+        bool got = false;
+        for (const pollfd &p : fds) {
+            if (p.revents & POLLIN) {
+                while (read(p.fd, buf, sizeof(buf)) > 0) {
+                    got = true;
+                }
+            }
+        }
+        return got;
+    };
+
+    for (int i = 0; i < kMessages; ++i) {
+        int from = i % kUsers;
+        int to = (i + 1) % kUsers;
+        std::string line = "SEND bench" + std::to_string(from) + " bench" + std::to_string(to) + " message " +
+                           std::to_string(i) + "\n";
+        WriteAll(cmd, line);
+        if (group >= 0 && i % 10 == 0) {
+            WriteAll(group, "MSG bench" + std::to_string(from) + " group message " + std::to_string(i) + "\n");
+        }
+        if (i % 64 == 63) {
+            drain(0);
+        }
+    }
+    // Wait for the server to go quiet, then leave.
+    while (drain(200)) {
+    }
+    std::string teardown = "DELETEGROUP bench0 bench\n";
+    for (int u = 0; u < kUsers; ++u) {
+        teardown += "DISCONNECT bench" + std::to_string(u) + "\n";
+    }
+    WriteAll(cmd, teardown);
+    usleep(100000);
+    kill(server, SIGINT);
+
+    if (group >= 0) {
+        close(group);
+    }
+    for (int u = 0; u < kUsers; ++u) {
+        unlink(("/tmp/im_client_bench" + std::to_string(u) + ".fifo").c_str());
+    }
+    for (int fd : inboxes) {
+        close(fd);
+    }
+    close(cmd);
+}
+
+static std::vector<Benchmark> Benchmarks() {
+    return {
+        {"lab1", "lab1/code", {"./parent"}, "lab1.stdin", nullptr},
+        {"lab2_serial", "lab2/code", {"./serial"}, "lab2_serial.stdin", nullptr},
+        {"lab2_parallel", "lab2/code", {"./parallel"}, "lab2_parallel.stdin", nullptr},
+        {"lab3_queue", "lab3/code", {"./parent", "-j", "4"}, "lab3.stdin", nullptr},
+        {"lab3_slot", "lab3/code", {"./parent", "-j", "0"}, "lab3_slot.stdin", nullptr},
+        {"lab4_program1", "lab4/code", {"./program1"}, "lab4.txt", nullptr},
+        {"lab4_program1_j4", "lab4/code", {"./program1", "-j", "4"}, "lab4.txt", nullptr},
+        {"lab4_program2", "lab4/code", {"./program2", "."}, "lab4_switching.txt", nullptr},
+        {"im_server", "course_project/code", {"./im_server"}, "empty.txt", ImClient},
+    };
+}
+
+// Starts the benchmark with stdin from its input and output discarded. The
+// child either stops itself for a tracer or waits until go_fd is written.
+static pid_t Spawn(const Benchmark &b, const std::string &workdir, bool traced, int &go_fd) {
+    int go[2];
+    if (pipe(go) < 0) {
+        std::perror("pipe");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        close(go[0]);
+        close(go[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(go[1]);
+        int in = open(InputPath(b.input).c_str(), O_RDONLY);
+        int null = open("/dev/null", O_WRONLY);
+        if (in < 0 || null < 0 || chdir(workdir.c_str()) < 0) {
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(in);
+        close(null);
+        if (traced) {
+            ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+            raise(SIGSTOP);
+        } else {
+            char c;
+            if (read(go[0], &c, 1) != 1) {
+                _exit(127);
+            }
+        }
+        close(go[0]);
+        std::vector<char *> argv;
+        for (const std::string &arg : b.argv) {
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(go[0]);
+    go_fd = go[1];
+    return pid;
+}
+
+static std::string ExitDescription(int status) {
+    if (WIFSIGNALED(status)) {
+        return std::string("killed by ") + strsignal(WTERMSIG(status));
+    }
+    return "exit " + std::to_string(WEXITSTATUS(status));
+}
+
+static bool Succeeded(int status) {
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool MeasureOnce(const Benchmark &b, const std::string &workdir, Metrics &metrics, std::string &error) {
+    int go_fd;
+    pid_t pid = Spawn(b, workdir, false, go_fd);
+    if (pid < 0) {
+        error = "spawn failed";
+        return false;
+    }
+    PerfCounters counters;
+    counters.Attach(pid);
+
+    auto start = std::chrono::steady_clock::now();
+    if (write(go_fd, "g", 1) != 1) {
+        std::perror("write");
+    }
+    close(go_fd);
+    std::thread client;
+    if (b.client) {
+        client = std::thread(b.client, pid);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (client.joinable()) {
+        client.join();
+    }
+    if (!Succeeded(status)) {
+        error = ExitDescription(status);
+        return false;
+    }
+
+    metrics["wall_ns"] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    for (const PerfCounters::Value &v : counters.Read()) {
+        metrics[v.name] = v.value;
+    }
+    return true;
+}
+
+static bool MeasureSyscalls(const Benchmark &b, const std::string &workdir, Metrics &metrics, std::string &error) {
+    int go_fd;
+    pid_t pid = Spawn(b, workdir, true, go_fd);
+    if (pid < 0) {
+        error = "spawn failed";
+        return false;
+    }
+    close(go_fd);
+    std::thread client;
+    if (b.client) {
+        client = std::thread(b.client, pid);
+    }
+    std::map<std::string, uint64_t> counts;
+    int status = 0;
+    bool traced = CountSyscalls(pid, counts, status);
+    if (client.joinable()) {
+        client.join();
+    }
+    if (!traced) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        error = "ptrace failed";
+        return false;
+    }
+    if (!Succeeded(status)) {
+        error = ExitDescription(status);
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (const auto &[name, count] : counts) {
+        metrics["sys." + name] = static_cast<double>(count);
+        total += count;
+    }
+    metrics["syscalls"] = static_cast<double>(total);
+    return true;
+}
+
+static double Median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t mid = v.size() / 2;
+    return v.size() % 2 ? v[mid] : (v[mid - 1] + v[mid]) / 2.0;
+}
+
+// Differences below this are noise whatever the percentage.
+static double MinDelta(const std::string &metric) {
+    if (metric.size() > 3 && metric.compare(metric.size() - 3, 3, "_ns") == 0) {
+        return 1e6;
+    }
+    return 16.0;
+}
+
+static bool IsNoisy(const std::string &metric) {
+    static const char *noisy[] = {
+        "context_switches", "sys.futex", "sys.sched_yield", "sys.nanosleep", "sys.clock_nanosleep",
+        "sys.restart_syscall", "sys.poll", "sys.ppoll", "sys.epoll_wait", "sys.epoll_pwait",
+    };
+    if (metric.size() > 3 && metric.compare(metric.size() - 3, 3, "_ns") == 0) {
+        return true;
+    }
+    return std::find(std::begin(noisy), std::end(noisy), metric) != std::end(noisy);
+}
+
+static std::map<std::string, Metrics> LoadBaseline(const std::string &path) {
+    std::map<std::string, Metrics> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string bench;
+        std::string metric;
+        double value;
+        if (fields >> bench >> metric >> value) {
+            baseline[bench][metric] = value;
+        }
+    }
+    return baseline;
+}
+
+static bool SaveBaseline(const std::string &path, const std::map<std::string, Metrics> &baseline) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "# lab_bench baseline: benchmark metric value\n";
+    char buf[64];
+    for (const auto &[bench, metrics] : baseline) {
+        for (const auto &[metric, value] : metrics) {
+            std::snprintf(buf, sizeof(buf), "%.0f", value);
+            out << bench << ' ' << metric << ' ' << buf << '\n';
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+// Prints the comparison and returns the number of regressed metrics.
+static int Compare(const Metrics &current, const Metrics *baseline, const Options &opt) {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "  %-26s %16s %16s %9s\n", "metric", "baseline", "current", "change");
+    std::cout << buf;
+    int regressions = 0;
+    for (const auto &[metric, value] : current) {
+        auto it = baseline ? baseline->find(metric) : Metrics::const_iterator();
+        if (!baseline || it == baseline->end()) {
+            std::snprintf(buf, sizeof(buf), "  %-26s %16s %16.0f %9s\n", metric.c_str(), "-", value, "new");
+            std::cout << buf;
+            continue;
+        }
+        double base = it->second;
+        double change = base != 0.0 ? (value - base) / base * 100.0 : (value != 0.0 ? INFINITY : 0.0);
+        double threshold = IsNoisy(metric) ? opt.noisy_threshold : opt.threshold;
+        bool regressed = change > threshold && value - base > MinDelta(metric);
+        regressions += regressed;
+        std::snprintf(buf, sizeof(buf), "  %-26s %16.0f %16.0f %+8.1f%%%s\n", metric.c_str(), base, value, change,
+                      regressed ? "  REGRESSION" : "");
+        std::cout << buf;
+    }
+    if (baseline) {
+        for (const auto &[metric, value] : *baseline) {
+            if (current.count(metric) == 0) {
+                std::snprintf(buf, sizeof(buf), "  %-26s %16.0f %16s %9s\n", metric.c_str(), value, "-", "gone");
+                std::cout << buf;
+            }
+        }
+    }
+    return regressions;
+}
+
+static std::string DefaultRoot() {
+    char path[4096];
+    ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n <= 0) {
+        return "../../..";
+    }
+    std::string root(path, static_cast<size_t>(n));
+    for (int i = 0; i < 4; ++i) {
+        root.erase(root.find_last_of('/'));
+    }
+    return root;
+}
+
+static void Usage(const char *program) {
+    std::cerr << "usage: " << program
+              << " [--root DIR] [--build NAME] [--baseline FILE] [--update] [--threshold PCT]"
+                 " [--noisy-threshold PCT] [--runs N] [--only name,...] [--no-syscalls]"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--root" && has_value) {
+            opt.root = argv[++i];
+        } else if (arg == "--build" && has_value) {
+            opt.build = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            opt.baseline = argv[++i];
+        } else if (arg == "--update") {
+            opt.update = true;
+        } else if (arg == "--threshold" && has_value) {
+            opt.threshold = std::atof(argv[++i]);
+        } else if (arg == "--noisy-threshold" && has_value) {
+            opt.noisy_threshold = std::atof(argv[++i]);
+        } else if (arg == "--runs" && has_value) {
+            opt.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--only" && has_value) {
+            std::istringstream names(argv[++i]);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                opt.only.push_back(name);
+            }
+        } else if (arg == "--no-syscalls") {
+            opt.syscalls = false;
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (opt.root.empty()) {
+        opt.root = DefaultRoot();
+    }
+
+    char dir_template[] = "/tmp/lab_bench.XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        std::perror("mkdtemp");
+        return 2;
+    }
+    g_input_dir = dir_template;
+    GenerateInputs();
+
+    // The scripted client signals the server; a dead FIFO reader must not kill us.
+    signal(SIGPIPE, SIG_IGN);
+
+    std::map<std::string, Metrics> baseline = LoadBaseline(opt.baseline);
+    int regressions = 0;
+    int failures = 0;
+    for (const Benchmark &b : Benchmarks()) {
+        if (!opt.only.empty() && std::find(opt.only.begin(), opt.only.end(), b.name) == opt.only.end()) {
+            continue;
+        }
+        std::string workdir = opt.root + "/" + b.dir + "/" + opt.build;
+        std::string binary = workdir + "/" + b.argv[0].substr(b.argv[0].rfind('/') + 1);
+        if (access(binary.c_str(), X_OK) != 0) {
+            std::cout << b.name << ": skipped, " << binary << " not built\n\n";
+            continue;
+        }
+
+        std::map<std::string, std::vector<double>> samples;
+        std::string error;
+        bool ok = true;
+        for (int r = 0; r < opt.runs && ok; ++r) {
+            Metrics m;
+            ok = MeasureOnce(b, workdir, m, error);
+            for (const auto &[metric, value] : m) {
+                samples[metric].push_back(value);
+            }
+        }
+        Metrics current;
+        for (const auto &[metric, values] : samples) {
+            current[metric] = Median(values);
+        }
+        if (ok && opt.syscalls) {
+            ok = MeasureSyscalls(b, workdir, current, error);
+        }
+        if (!ok) {
+            std::cout << b.name << ": FAILED, " << error << "\n\n";
+            ++failures;
+            continue;
+        }
+
+        std::cout << b.name << " (median of " << opt.runs << " runs" << (opt.syscalls ? ", syscalls traced" : "")
+                  << ")\n";
+        auto it = baseline.find(b.name);
+        int r = Compare(current, it == baseline.end() ? nullptr : &it->second, opt);
+        std::cout << "\n";
+        if (opt.update) {
+            baseline[b.name] = current;
+        } else {
+            regressions += r;
+        }
+    }
+
+    RemoveInputs();
+
+    if (opt.update) {
+        if (!SaveBaseline(opt.baseline, baseline)) {
+            std::perror(opt.baseline.c_str());
+            return 2;
+        }
+        std::cout << "baseline written to " << opt.baseline << "\n";
+        return failures ? 1 : 0;
+    }
+    if (regressions || failures) {
+        std::cout << regressions << " regressed metric(s), " << failures << " failed benchmark(s)\n";
+        return 1;
+    }
+    return 0;
+}
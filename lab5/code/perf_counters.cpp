@@ -0,0 +1,69 @@
+#include "perf_counters.hpp"
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct CounterSpec {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const CounterSpec kCounters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+static int OpenCounter(const CounterSpec &spec, pid_t pid) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    // User space only, which is all perf_event_paranoid=2 allows.
+    attr.exclude_kernel = spec.type == PERF_TYPE_HARDWARE;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+PerfCounters::~PerfCounters() {
+    for (const Counter &c : counters_) {
+        close(c.fd);
+    }
+}
+
+bool PerfCounters::Attach(pid_t pid) {
+    for (const CounterSpec &spec : kCounters) {
+        int fd = OpenCounter(spec, pid);
+        if (fd >= 0) {
+            counters_.push_back(Counter{spec.name, fd});
+        }
+    }
+    return !counters_.empty();
+}
+
+std::vector<PerfCounters::Value> PerfCounters::Read() const {
+    std::vector<Value> values;
+    for (const Counter &c : counters_) {
+        uint64_t data[3];  // value, time enabled, time running
+        if (read(c.fd, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+            continue;
+        }
+        double value = static_cast<double>(data[0]);
+        if (data[2] > 0 && data[2] < data[1]) {
+            value *= static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        }
+        values.push_back(Value{c.name, value});
+    }
+    return values;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// perf_event_open counters for one process tree. Counters the machine does
+// not provide (hardware events in most VMs, or with a strict
+// perf_event_paranoid) are left out.
+class PerfCounters {
+public:
+    struct Value {
+        std::string name;
+        double value;
+    };
+
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Counts pid and the children it creates from its next execve on. Returns
+    // false if no counter could be opened.
+    bool Attach(pid_t pid);
+    // Scaled for multiplexing. Children are included once they have exited.
+    std::vector<Value> Read() const;
+
+private:
+    struct Counter {
+        const char *name;
+        int fd;
+    };
+
+    std::vector<Counter> counters_;
+};
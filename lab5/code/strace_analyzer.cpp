@@ -0,0 +1,152 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "strace_parser.hpp"
+#include "strace_profile.hpp"
+
+// Syscall cost profile of an `strace -f [-tt|-ttt] [-T]` log.
+// Usage: strace_analyzer [--json] [--top N] [--loop-min N] file... ('-' = stdin)
+
+static constexpr size_t kBlockSize = 4 << 20;
+
+static void ParseLines(const char *p, const char *end, SyscallProfile &profile) {
+    StraceLine line;
+    while (p < end) {
+        const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        const char *line_end = nl ? nl : end;
+        bool parsed = ParseStraceLine(std::string_view(p, line_end - p), line);
+        profile.CountLine(parsed);
+        if (parsed) {
+            profile.Add(line);
+        }
+        p = line_end + 1;
+    }
+}
+
+// Syscall names are copied on interning, so the block can be reused.
+static bool ParseStream(int fd, SyscallProfile &profile) {
+    std::unique_ptr<char[]> block(new char[kBlockSize]);
+    size_t carry = 0;
+    while (true) {
+        if (carry == kBlockSize) {
+            // A single line longer than the block: parse what we have.
+            ParseLines(block.get(), block.get() + carry, profile);
+            carry = 0;
+        }
+        ssize_t n = read(fd, block.get() + carry, kBlockSize - carry);
+        if (n < 0) {
+            std::perror("read");
+            return false;
+        }
+        if (n == 0) {
+            ParseLines(block.get(), block.get() + carry, profile);
+            return true;
+        }
+        size_t filled = carry + static_cast<size_t>(n);
+        const char *last_nl = static_cast<const char *>(memrchr(block.get(), '\n', filled));
+        if (last_nl == nullptr) {
+            carry = filled;
+            continue;
+        }
+        size_t complete = last_nl - block.get();
+        ParseLines(block.get(), last_nl, profile);
+        carry = filled - complete - 1;
+        std::memmove(block.get(), last_nl + 1, carry);
+    }
+}
+
+static bool ParseFile(const std::string &path, SyscallProfile &profile) {
+    if (path == "-") {
+        return ParseStream(STDIN_FILENO, profile);
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        bool ok = ParseStream(fd, profile);
+        close(fd);
+        return ok;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::perror("mmap");
+        return false;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    const char *begin = static_cast<const char *>(data);
+    ParseLines(begin, begin + size, profile);
+    munmap(data, size);
+    return true;
+}
+
+static void Usage(const char *program) {
+    std::cerr << "usage: " << program << " [--json] [--top N] [--loop-min N] file... ('-' = stdin)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    size_t top = 20;
+    uint64_t loop_min = 8;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "--top" && i + 1 < argc) {
+            top = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--loop-min" && i + 1 < argc) {
+            loop_min = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg.size() > 2 && arg[0] == '-' && arg[1] == '-') {
+            Usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (loop_min < 2) {
+        loop_min = 2;
+    }
+
+    std::ios::sync_with_stdio(false);
+    bool ok = true;
+    if (json && files.size() > 1) {
+        std::cout << "[";
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+        SyscallProfile profile(files[i], loop_min);
+        if (!ParseFile(files[i], profile)) {
+            ok = false;
+            continue;
+        }
+        profile.Finish();
+        if (json) {
+            if (files.size() > 1 && i > 0) {
+                std::cout << ",\n";
+            }
+            profile.PrintJson(std::cout, top);
+        } else {
+            profile.PrintTable(std::cout, top);
+        }
+    }
+    if (json) {
+        std::cout << (files.size() > 1 ? "]\n" : "\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
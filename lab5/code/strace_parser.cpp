@@ -0,0 +1,193 @@
+#include "strace_parser.hpp"
+#include <charconv>
+#include <cstdint>
+
+static bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool IsNameChar(char c) {
+    return (c >= 'a' && c <= 'z') || IsDigit(c) || c == '_';
+}
+
+static bool StartsWith(std::string_view s, std::string_view prefix) {
+    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static bool EndsWith(std::string_view s, std::string_view suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static size_t SkipSpaces(std::string_view s, size_t i) {
+    while (i < s.size() && s[i] == ' ') {
+        ++i;
+    }
+    return i;
+}
+
+static std::string_view TrimRight(std::string_view s) {
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\r')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// strace prints times as plain "digits[.digits]"; std::from_chars for
+// double goes through strtod in libstdc++ and dominates the parse.
+static double ParseSeconds(std::string_view s) {
+    size_t i = 0;
+    uint64_t whole = 0;
+    for (; i < s.size() && IsDigit(s[i]); ++i) {
+        whole = whole * 10 + (s[i] - '0');
+    }
+    double value = static_cast<double>(whole);
+    if (i < s.size() && s[i] == '.') {
+        uint64_t frac = 0;
+        double scale = 1.0;
+        for (++i; i < s.size() && IsDigit(s[i]) && scale < 1e18; ++i) {
+            frac = frac * 10 + (s[i] - '0');
+            scale *= 10.0;
+        }
+        value += frac / scale;
+    }
+    return value;
+}
+
+// "HH:MM:SS[.frac]" (-t, -tt) or "seconds.frac" (-ttt)
+static double ParseTimestamp(std::string_view s) {
+    double total = 0.0;
+    size_t colon;
+    while ((colon = s.find(':')) != std::string_view::npos) {
+        int part = 0;
+        std::from_chars(s.data(), s.data() + colon, part);
+        total = total * 60.0 + part;
+        s.remove_prefix(colon + 1);
+    }
+    return total * 60.0 + ParseSeconds(s);
+}
+
+// rest is what follows "name(" or "resumed>": "args) = result".
+static void ParseResult(std::string_view rest, StraceLine &out) {
+    size_t eq = rest.rfind(" = ");
+    if (eq == std::string_view::npos) {
+        out.args = rest;
+        return;
+    }
+    out.args = rest.substr(0, eq);
+    if (!out.args.empty() && out.args.back() == ')') {
+        out.args.remove_suffix(1);
+    }
+    out.result = rest.substr(eq + 3);
+
+    const char *p = out.result.data();
+    const char *end = p + out.result.size();
+    if (out.result.size() > 2 && p[0] == '0' && p[1] == 'x') {
+        unsigned long long value = 0;
+        out.has_ret = std::from_chars(p + 2, end, value, 16).ec == std::errc();
+        out.ret = static_cast<long long>(value);
+    } else if (p < end && (IsDigit(*p) || *p == '-')) {
+        out.has_ret = std::from_chars(p, end, out.ret).ec == std::errc();
+    }
+    out.failed = out.has_ret && out.ret == -1 && StartsWith(out.result, "-1 E");
+}
+
+bool ParseStraceLine(std::string_view line, StraceLine &out) {
+    out = StraceLine();
+    line = TrimRight(line);
+    size_t i = 0;
+
+    if (StartsWith(line, "[pid")) {
+        i = SkipSpaces(line, 4);
+        size_t start = i;
+        while (i < line.size() && IsDigit(line[i])) {
+            ++i;
+        }
+        if (i == start || i >= line.size() || line[i] != ']') {
+            return false;
+        }
+        std::from_chars(line.data() + start, line.data() + i, out.pid);
+        ++i;
+    } else if (!line.empty() && IsDigit(line[0])) {
+        size_t j = 0;
+        while (j < line.size() && IsDigit(line[j])) {
+            ++j;
+        }
+        if (j < line.size() && line[j] == ' ') {
+            std::from_chars(line.data(), line.data() + j, out.pid);
+            i = j;
+        }
+    }
+    i = SkipSpaces(line, i);
+
+    if (i < line.size() && IsDigit(line[i])) {
+        size_t j = i;
+        while (j < line.size() && (IsDigit(line[j]) || line[j] == ':' || line[j] == '.')) {
+            ++j;
+        }
+        if (j < line.size() && line[j] == ' ') {
+            out.timestamp = ParseTimestamp(line.substr(i, j - i));
+            i = SkipSpaces(line, j);
+        }
+    }
+
+    std::string_view body = line.substr(i);
+    if (!body.empty() && body.back() == '>') {
+        size_t lt = body.rfind('<');
+        if (lt != std::string_view::npos && lt + 1 < body.size() && IsDigit(body[lt + 1])) {
+            out.duration = ParseSeconds(body.substr(lt + 1, body.size() - lt - 2));
+            body = TrimRight(body.substr(0, lt));
+        }
+    }
+    if (body.empty()) {
+        return true;
+    }
+
+    if (StartsWith(body, "+++ ")) {
+        out.kind = LineKind::Exit;
+        body.remove_prefix(4);
+        if (EndsWith(body, " +++")) {
+            body.remove_suffix(4);
+        }
+        if (StartsWith(body, "exited with ")) {
+            body.remove_prefix(12);
+        } else if (StartsWith(body, "killed by ")) {
+            body.remove_prefix(10);
+        }
+        out.name = body;
+        return true;
+    }
+    if (StartsWith(body, "--- ")) {
+        out.kind = LineKind::Signal;
+        body.remove_prefix(4);
+        out.name = body.substr(0, body.find(' '));
+        return true;
+    }
+    if (StartsWith(body, "<... ")) {
+        size_t end = body.find(" resumed>");
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        out.kind = LineKind::Resumed;
+        out.name = body.substr(5, end - 5);
+        ParseResult(body.substr(end + 9), out);
+        return true;
+    }
+
+    size_t paren = 0;
+    while (paren < body.size() && IsNameChar(body[paren])) {
+        ++paren;
+    }
+    if (paren == 0 || paren >= body.size() || body[paren] != '(') {
+        return StartsWith(body, "strace: ");
+    }
+    out.name = body.substr(0, paren);
+    std::string_view rest = body.substr(paren + 1);
+    if (EndsWith(rest, "<unfinished ...>")) {
+        out.kind = LineKind::Unfinished;
+        out.args = TrimRight(rest.substr(0, rest.size() - 16));
+        return true;
+    }
+    out.kind = LineKind::Call;
+    ParseResult(rest, out);
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <string_view>
+
+enum class LineKind {
+    Call,        // name(args) = result
+    Unfinished,  // name(args <unfinished ...>
+    Resumed,     // <... name resumed>args) = result
+    Signal,      // --- SIGCHLD {...} ---
+    Exit,        // +++ exited with 0 +++ / +++ killed by SIGKILL +++
+    Other,       // strace's own "strace: ..." messages, blank lines
+};
+
+// One line of `strace [-f] [-t|-tt|-ttt] [-T]` output. The string views point
+// into the parsed line.
+struct StraceLine {
+    LineKind kind = LineKind::Other;
+    int pid = 0;              // 0 if the log has no pid column
+    double timestamp = -1.0;  // seconds (of the day for -t/-tt), < 0 if absent
+    double duration = -1.0;   // -T, seconds, < 0 if absent
+    std::string_view name;    // syscall; signal name for Signal; status for Exit
+    std::string_view args;    // everything between the name and the result
+    std::string_view result;  // text after " = " up to the -T field
+    long long ret = 0;        // numeric result, valid if has_ret
+    bool has_ret = false;
+    bool failed = false;      // "= -1 ERRNO ..."
+};
+
+// Accepts both "1234  call(...)" (-o file) and "[pid  1234] call(...)" forms.
+// Returns false for lines that do not look like strace output at all.
+bool ParseStraceLine(std::string_view line, StraceLine &out);
@@ -0,0 +1,470 @@
+#include "strace_profile.hpp"
+#include <algorithm>
+#include <cstdio>
+
+static constexpr int kHistory = 2 * SyscallProfile::kMaxPeriod;
+static constexpr double kSmallIoBytes = 64.0;
+
+static bool IsIoSyscall(std::string_view name) {
+    static const std::string_view io[] = {
+        "read", "write", "pread64", "pwrite64", "readv", "writev",
+        "recvfrom", "sendto", "recvmsg", "sendmsg", "preadv", "pwritev",
+    };
+    return std::find(std::begin(io), std::end(io), name) != std::end(io);
+}
+
+static bool IsForkSyscall(std::string_view name) {
+    return name == "clone" || name == "clone3" || name == "fork" || name == "vfork";
+}
+
+// First quoted argument, e.g. the path of execve("./child", ...).
+static std::string FirstQuoted(std::string_view args) {
+    size_t open = args.find('"');
+    if (open == std::string_view::npos) {
+        return "";
+    }
+    size_t close = args.find('"', open + 1);
+    if (close == std::string_view::npos) {
+        return "";
+    }
+    return std::string(args.substr(open + 1, close - open - 1));
+}
+
+static void Accumulate(SyscallStats &to, const SyscallStats &from) {
+    to.calls += from.calls;
+    to.errors += from.errors;
+    to.timed += from.timed;
+    to.time += from.time;
+    to.max_time = std::max(to.max_time, from.max_time);
+    to.bytes += from.bytes;
+}
+
+static std::string JsonString(std::string_view s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+SyscallProfile::SyscallProfile(std::string source, uint64_t loop_min_iterations)
+    : source_(std::move(source)), loop_min_iterations_(loop_min_iterations) {}
+
+void SyscallProfile::CountLine(bool parsed) {
+    ++lines_;
+    if (!parsed) {
+        ++unparsed_;
+    }
+}
+
+int SyscallProfile::Intern(std::string_view name) {
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+    name_storage_.emplace_back(name);
+    std::string_view stored = name_storage_.back();
+    int id = static_cast<int>(names_.size());
+    names_.push_back(stored);
+    uint8_t traits = 0;
+    if (IsIoSyscall(stored)) {
+        traits |= kIo;
+    }
+    if (stored == "execve") {
+        traits |= kExec;
+    }
+    if (IsForkSyscall(stored)) {
+        traits |= kFork;
+    }
+    traits_.push_back(traits);
+    ids_.emplace(stored, id);
+    return id;
+}
+
+SyscallProfile::Process &SyscallProfile::ProcessOf(int pid) {
+    // Consecutive lines usually come from the same process.
+    if (pid == last_pid_) {
+        return processes_[last_index_];
+    }
+    auto it = process_index_.find(pid);
+    if (it == process_index_.end()) {
+        it = process_index_.emplace(pid, processes_.size()).first;
+        processes_.emplace_back();
+        processes_.back().pid = pid;
+    }
+    last_pid_ = pid;
+    last_index_ = it->second;
+    return processes_[last_index_];
+}
+
+void SyscallProfile::Add(const StraceLine &line) {
+    if (line.kind == LineKind::Other) {
+        return;
+    }
+    has_timestamps_ |= line.timestamp >= 0.0;
+    has_durations_ |= line.duration >= 0.0;
+
+    Process &p = ProcessOf(line.pid);
+    if (line.timestamp >= 0.0) {
+        if (p.first_timestamp < 0.0) {
+            p.first_timestamp = line.timestamp;
+        }
+        p.last_timestamp = line.timestamp;
+    }
+
+    switch (line.kind) {
+    case LineKind::Call: {
+        int id = Intern(line.name);
+        Start(p, id, line.timestamp);
+        if (traits_[id] & kExec) {
+            p.pending_exe = FirstQuoted(line.args);
+        }
+        Complete(p, id, line, line.timestamp);
+        break;
+    }
+    case LineKind::Unfinished: {
+        int id = Intern(line.name);
+        Start(p, id, line.timestamp);
+        if (traits_[id] & kExec) {
+            p.pending_exe = FirstQuoted(line.args);
+        }
+        p.pending = Pending{id, line.timestamp};
+        break;
+    }
+    case LineKind::Resumed: {
+        int id = Intern(line.name);
+        double start = -1.0;
+        if (p.pending.id == id) {
+            start = p.pending.timestamp;
+        } else {
+            // The log starts in the middle of this call.
+            Start(p, id, line.timestamp);
+        }
+        p.pending = Pending();
+        Complete(p, id, line, start);
+        break;
+    }
+    case LineKind::Signal:
+        ++p.signals;
+        break;
+    case LineKind::Exit:
+        p.exit = std::string(line.name);
+        break;
+    case LineKind::Other:
+        break;
+    }
+}
+
+// Loop detection: for every period, count how many calls in a row equal the
+// call that many places back. When such a streak ends and covers enough
+// iterations, the repeated sequence is recorded, unless it is itself a
+// repetition of a shorter one (which its own period reports).
+void SyscallProfile::Start(Process &p, int id, double timestamp) {
+    uint64_t n = p.started;
+    for (int period = 1; period <= kMaxPeriod; ++period) {
+        LoopRun &run = p.runs[period];
+        bool match = n >= static_cast<uint64_t>(period) && p.history[(n - period) % kHistory] == id;
+        if (match) {
+            if (run.length == 0) {
+                run.start_time = p.history_time[(n - period) % kHistory];
+                run.start_timestamp = p.history_timestamp[(n - period) % kHistory];
+            }
+            ++run.length;
+        } else if (run.length > 0) {
+            EndRun(p, period);
+        }
+    }
+    p.history[n % kHistory] = id;
+    p.history_time[n % kHistory] = p.total.time;
+    p.history_timestamp[n % kHistory] = timestamp;
+    ++p.started;
+}
+
+void SyscallProfile::EndRun(Process &p, int period) {
+    LoopRun &run = p.runs[period];
+    uint64_t length = run.length;
+    run.length = 0;
+    uint64_t iterations = (length + period) / period;
+    if (iterations < loop_min_iterations_) {
+        return;
+    }
+
+    // The streak covers calls [n - length - period, n); rotate the last
+    // period calls so that the pattern starts where the streak started.
+    uint64_t n = p.started;
+    uint64_t offset = (period - length % period) % period;
+    std::vector<int> pattern(period);
+    for (int k = 0; k < period; ++k) {
+        pattern[k] = p.history[(n - period + (offset + k) % period) % kHistory];
+    }
+    for (int d = 1; d < period; ++d) {
+        if (period % d != 0) {
+            continue;
+        }
+        bool repeats = true;
+        for (int k = d; k < period && repeats; ++k) {
+            repeats = pattern[k] == pattern[k % d];
+        }
+        if (repeats) {
+            return;
+        }
+    }
+
+    LoopStats &stats = loops_[{p.pid, pattern}];
+    ++stats.runs;
+    stats.iterations += iterations;
+    stats.max_iterations = std::max(stats.max_iterations, iterations);
+    stats.time += p.total.time - run.start_time;
+    double last = p.history_timestamp[(n - 1) % kHistory];
+    if (run.start_timestamp >= 0.0 && last >= run.start_timestamp) {
+        stats.wall += last - run.start_timestamp;
+    }
+}
+
+void SyscallProfile::Complete(Process &p, int id, const StraceLine &line, double start_timestamp) {
+    double duration = line.duration;
+    if (duration < 0.0 && line.kind == LineKind::Resumed && start_timestamp >= 0.0 &&
+        line.timestamp >= start_timestamp) {
+        duration = line.timestamp - start_timestamp;
+    }
+
+    if (p.syscalls.size() < names_.size()) {
+        p.syscalls.resize(names_.size());
+    }
+    SyscallStats one;
+    one.calls = 1;
+    one.errors = line.failed ? 1 : 0;
+    if (duration >= 0.0) {
+        one.timed = 1;
+        one.time = duration;
+        one.max_time = duration;
+    }
+    if ((traits_[id] & kIo) && line.has_ret && line.ret > 0) {
+        one.bytes = static_cast<uint64_t>(line.ret);
+    }
+    Accumulate(p.syscalls[id], one);
+    Accumulate(p.total, one);
+
+    if ((traits_[id] & kExec) && line.has_ret && line.ret == 0) {
+        p.exe = p.pending_exe;
+    }
+    if ((traits_[id] & kFork) && line.has_ret && line.ret > 0) {
+        int parent = p.pid;
+        // May reallocate processes_, so p is not used after this.
+        ProcessOf(static_cast<int>(line.ret)).parent = parent;
+    }
+}
+
+void SyscallProfile::Finish() {
+    for (auto &p : processes_) {
+        for (int period = 1; period <= kMaxPeriod; ++period) {
+            if (p.runs[period].length > 0) {
+                EndRun(p, period);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<int, SyscallStats>> SyscallProfile::SyscallTotals() const {
+    std::vector<std::pair<int, SyscallStats>> rows(names_.size());
+    for (size_t id = 0; id < names_.size(); ++id) {
+        rows[id].first = static_cast<int>(id);
+    }
+    for (const auto &p : processes_) {
+        for (size_t id = 0; id < p.syscalls.size(); ++id) {
+            Accumulate(rows[id].second, p.syscalls[id]);
+        }
+    }
+    bool by_time = has_durations_ || has_timestamps_;
+    std::sort(rows.begin(), rows.end(), [by_time](const auto &a, const auto &b) {
+        if (by_time && a.second.time != b.second.time) {
+            return a.second.time > b.second.time;
+        }
+        return a.second.calls > b.second.calls;
+    });
+    return rows;
+}
+
+std::vector<std::pair<const std::pair<int, std::vector<int>>*, const SyscallProfile::LoopStats*>>
+SyscallProfile::SortedLoops() const {
+    std::vector<std::pair<const std::pair<int, std::vector<int>>*, const LoopStats*>> rows;
+    for (const auto &[key, stats] : loops_) {
+        rows.emplace_back(&key, &stats);
+    }
+    std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+        return a.second->iterations * a.first->second.size() > b.second->iterations * b.first->second.size();
+    });
+    return rows;
+}
+
+std::vector<SyscallProfile::SmallIo> SyscallProfile::SmallIoCalls() const {
+    std::vector<SmallIo> rows;
+    for (const auto &p : processes_) {
+        for (size_t id = 0; id < p.syscalls.size(); ++id) {
+            const SyscallStats &s = p.syscalls[id];
+            if ((traits_[id] & kIo) && s.calls >= 2 && s.bytes > 0 &&
+                static_cast<double>(s.bytes) / s.calls < kSmallIoBytes) {
+                rows.push_back(SmallIo{p.pid, static_cast<int>(id), &s});
+            }
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const SmallIo &a, const SmallIo &b) {
+        return a.stats->calls > b.stats->calls;
+    });
+    return rows;
+}
+
+std::string SyscallProfile::PatternName(const std::vector<int> &pattern) const {
+    std::string name;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (i > 0) {
+            name += '+';
+        }
+        name += names_[pattern[i]];
+    }
+    return name;
+}
+
+void SyscallProfile::PrintTable(std::ostream &out, size_t top) const {
+    char buf[512];
+    bool timed = has_durations_ || has_timestamps_;
+    std::snprintf(buf, sizeof(buf), "== %s: %llu lines (%llu unparsed), %zu processes, timing: %s\n",
+                  source_.c_str(), static_cast<unsigned long long>(lines_),
+                  static_cast<unsigned long long>(unparsed_), processes_.size(),
+                  has_durations_ ? "-T" : (has_timestamps_ ? "timestamps" : "none"));
+    out << buf;
+
+    out << "\nProcesses\n";
+    std::snprintf(buf, sizeof(buf), "%8s %8s %10s %8s %12s %12s %8s  %-12s %s\n", "pid", "parent", "calls",
+                  "errors", "sys time s", "wall s", "signals", "exit", "exe");
+    out << buf;
+    for (const auto &p : processes_) {
+        double wall = p.first_timestamp >= 0.0 ? p.last_timestamp - p.first_timestamp : 0.0;
+        std::snprintf(buf, sizeof(buf), "%8d %8d %10llu %8llu %12.6f %12.6f %8llu  %-12s %s\n", p.pid, p.parent,
+                      static_cast<unsigned long long>(p.total.calls),
+                      static_cast<unsigned long long>(p.total.errors), p.total.time, wall,
+                      static_cast<unsigned long long>(p.signals), p.exit.empty() ? "-" : p.exit.c_str(),
+                      p.exe.c_str());
+        out << buf;
+    }
+
+    out << "\nSyscalls" << (timed ? " (by time)" : " (by calls)") << "\n";
+    std::snprintf(buf, sizeof(buf), "%-20s %10s %8s %12s %10s %10s %14s\n", "syscall", "calls", "errors",
+                  "time s", "avg us", "max us", "bytes");
+    out << buf;
+    auto rows = SyscallTotals();
+    for (size_t i = 0; i < rows.size() && (top == 0 || i < top); ++i) {
+        const SyscallStats &s = rows[i].second;
+        if (s.calls == 0) {
+            break;
+        }
+        double avg = s.timed ? s.time / s.timed * 1e6 : 0.0;
+        std::snprintf(buf, sizeof(buf), "%-20.*s %10llu %8llu %12.6f %10.1f %10.1f %14llu\n",
+                      static_cast<int>(names_[rows[i].first].size()), names_[rows[i].first].data(),
+                      static_cast<unsigned long long>(s.calls), static_cast<unsigned long long>(s.errors),
+                      s.time, avg, s.max_time * 1e6, static_cast<unsigned long long>(s.bytes));
+        out << buf;
+    }
+
+    out << "\nHot loops (>= " << loop_min_iterations_ << " back-to-back iterations)\n";
+    auto loops = SortedLoops();
+    if (loops.empty()) {
+        out << "  none\n";
+    } else {
+        std::snprintf(buf, sizeof(buf), "%8s  %-32s %6s %10s %8s %12s %12s\n", "pid", "pattern", "runs",
+                      "iterations", "max", "sys time s", "wall s");
+        out << buf;
+    }
+    for (size_t i = 0; i < loops.size() && (top == 0 || i < top); ++i) {
+        const LoopStats &s = *loops[i].second;
+        std::snprintf(buf, sizeof(buf), "%8d  %-32s %6llu %10llu %8llu %12.6f %12.6f\n", loops[i].first->first,
+                      PatternName(loops[i].first->second).c_str(), static_cast<unsigned long long>(s.runs),
+                      static_cast<unsigned long long>(s.iterations),
+                      static_cast<unsigned long long>(s.max_iterations), s.time, s.wall);
+        out << buf;
+    }
+
+    out << "\nSmall I/O (< " << kSmallIoBytes << " bytes per call)\n";
+    auto small = SmallIoCalls();
+    if (small.empty()) {
+        out << "  none\n";
+    }
+    for (size_t i = 0; i < small.size() && (top == 0 || i < top); ++i) {
+        const SyscallStats &s = *small[i].stats;
+        std::snprintf(buf, sizeof(buf), "%8d  %-20.*s %10llu calls, %.1f bytes per call\n", small[i].pid,
+                      static_cast<int>(names_[small[i].id].size()), names_[small[i].id].data(),
+                      static_cast<unsigned long long>(s.calls), static_cast<double>(s.bytes) / s.calls);
+        out << buf;
+    }
+    out << "\n";
+}
+
+void SyscallProfile::PrintJson(std::ostream &out, size_t top) const {
+    char buf[256];
+    out << "{\"source\": " << JsonString(source_) << ", \"lines\": " << lines_ << ", \"unparsed\": " << unparsed_
+        << ", \"timestamps\": " << (has_timestamps_ ? "true" : "false")
+        << ", \"durations\": " << (has_durations_ ? "true" : "false") << ",\n \"processes\": [";
+    for (size_t i = 0; i < processes_.size(); ++i) {
+        const Process &p = processes_[i];
+        double wall = p.first_timestamp >= 0.0 ? p.last_timestamp - p.first_timestamp : 0.0;
+        std::snprintf(buf, sizeof(buf), "\"calls\": %llu, \"errors\": %llu, \"time\": %.9g, \"wall\": %.9g",
+                      static_cast<unsigned long long>(p.total.calls),
+                      static_cast<unsigned long long>(p.total.errors), p.total.time, wall);
+        out << (i ? ",\n  " : "\n  ") << "{\"pid\": " << p.pid << ", \"parent\": " << p.parent << ", " << buf
+            << ", \"signals\": " << p.signals << ", \"exit\": " << JsonString(p.exit)
+            << ", \"exe\": " << JsonString(p.exe) << "}";
+    }
+
+    out << "],\n \"syscalls\": [";
+    auto rows = SyscallTotals();
+    for (size_t i = 0; i < rows.size() && (top == 0 || i < top); ++i) {
+        const SyscallStats &s = rows[i].second;
+        if (s.calls == 0) {
+            break;
+        }
+        std::snprintf(buf, sizeof(buf),
+                      "\"calls\": %llu, \"errors\": %llu, \"timed\": %llu, \"time\": %.9g, \"max_time\": %.9g, "
+                      "\"bytes\": %llu",
+                      static_cast<unsigned long long>(s.calls), static_cast<unsigned long long>(s.errors),
+                      static_cast<unsigned long long>(s.timed), s.time, s.max_time,
+                      static_cast<unsigned long long>(s.bytes));
+        out << (i ? ",\n  " : "\n  ") << "{\"name\": " << JsonString(names_[rows[i].first]) << ", " << buf << "}";
+    }
+
+    out << "],\n \"loops\": [";
+    auto loops = SortedLoops();
+    for (size_t i = 0; i < loops.size() && (top == 0 || i < top); ++i) {
+        const LoopStats &s = *loops[i].second;
+        out << (i ? ",\n  " : "\n  ") << "{\"pid\": " << loops[i].first->first << ", \"pattern\": [";
+        const auto &pattern = loops[i].first->second;
+        for (size_t k = 0; k < pattern.size(); ++k) {
+            out << (k ? ", " : "") << JsonString(names_[pattern[k]]);
+        }
+        std::snprintf(buf, sizeof(buf),
+                      "\"runs\": %llu, \"iterations\": %llu, \"max_iterations\": %llu, \"time\": %.9g, "
+                      "\"wall\": %.9g",
+                      static_cast<unsigned long long>(s.runs), static_cast<unsigned long long>(s.iterations),
+                      static_cast<unsigned long long>(s.max_iterations), s.time, s.wall);
+        out << "], " << buf << "}";
+    }
+
+    out << "],\n \"small_io\": [";
+    auto small = SmallIoCalls();
+    for (size_t i = 0; i < small.size() && (top == 0 || i < top); ++i) {
+        const SyscallStats &s = *small[i].stats;
+        out << (i ? ",\n  " : "\n  ") << "{\"pid\": " << small[i].pid
+            << ", \"syscall\": " << JsonString(names_[small[i].id]) << ", \"calls\": " << s.calls
+            << ", \"bytes\": " << s.bytes << "}";
+    }
+    out << "]}";
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "strace_parser.hpp"
+
+struct SyscallStats {
+    uint64_t calls = 0;
+    uint64_t errors = 0;
+    uint64_t timed = 0;      // calls with a known duration
+    double time = 0.0;       // seconds, over the timed calls
+    double max_time = 0.0;
+    uint64_t bytes = 0;      // successful read/write family results
+};
+
+// Aggregates one strace log: counts and times per process and per syscall,
+// plus hot loops, i.e. a short sequence of syscalls (up to kMaxPeriod long)
+// that one process repeats back to back, such as a sleep-poll loop or one
+// write per output line.
+class SyscallProfile {
+public:
+    static constexpr int kMaxPeriod = 4;
+
+    explicit SyscallProfile(std::string source, uint64_t loop_min_iterations = 8);
+
+    void Add(const StraceLine &line);
+    // Closes loops that run to the end of the log. Call once after the last Add.
+    void Finish();
+
+    void CountLine(bool parsed);
+
+    void PrintTable(std::ostream &out, size_t top) const;
+    void PrintJson(std::ostream &out, size_t top) const;
+
+private:
+    enum Trait : uint8_t {
+        kIo = 1,    // result is a byte count
+        kExec = 2,
+        kFork = 4,  // result is the child pid
+    };
+
+    struct Pending {
+        int id = -1;
+        double timestamp = -1.0;
+    };
+
+    struct LoopRun {
+        uint64_t length = 0;     // calls equal to the call `period` places back
+        double start_time = 0.0;
+        double start_timestamp = -1.0;
+    };
+
+    struct Process {
+        int pid = 0;
+        int parent = 0;
+        std::string exe;
+        std::string exit;
+        uint64_t signals = 0;
+        SyscallStats total;
+        std::vector<SyscallStats> syscalls;  // by syscall id
+        double first_timestamp = -1.0;
+        double last_timestamp = -1.0;
+        Pending pending;
+        std::string pending_exe;
+
+        // Loop detection over the sequence of calls as they are started.
+        int history[2 * kMaxPeriod] = {};
+        double history_time[2 * kMaxPeriod] = {};
+        double history_timestamp[2 * kMaxPeriod] = {};
+        uint64_t started = 0;
+        LoopRun runs[kMaxPeriod + 1];
+    };
+
+    struct LoopStats {
+        uint64_t runs = 0;
+        uint64_t iterations = 0;
+        uint64_t max_iterations = 0;
+        double time = 0.0;   // inside the looping syscalls, if timed
+        double wall = 0.0;   // first to last call, if timestamped
+    };
+
+    int Intern(std::string_view name);
+    Process &ProcessOf(int pid);
+    void Start(Process &p, int id, double timestamp);
+    void Complete(Process &p, int id, const StraceLine &line, double start_timestamp);
+    void EndRun(Process &p, int period);
+
+    struct SmallIo {
+        int pid;
+        int id;
+        const SyscallStats *stats;
+    };
+
+    // Sorted by time if the log has -T or timestamps, else by calls.
+    std::vector<std::pair<int, SyscallStats>> SyscallTotals() const;
+    std::vector<std::pair<const std::pair<int, std::vector<int>>*, const LoopStats*>> SortedLoops() const;
+    std::vector<SmallIo> SmallIoCalls() const;
+    std::string PatternName(const std::vector<int> &pattern) const;
+
+    std::string source_;
+    uint64_t loop_min_iterations_;
+    uint64_t lines_ = 0;
+    uint64_t unparsed_ = 0;
+    bool has_timestamps_ = false;
+    bool has_durations_ = false;
+
+    std::deque<std::string> name_storage_;
+    std::unordered_map<std::string_view, int> ids_;
+    std::vector<std::string_view> names_;
+    std::vector<uint8_t> traits_;  // by syscall id, kIo | kExec | kFork
+
+    int last_pid_ = -1;
+    size_t last_index_ = 0;
+
+    std::unordered_map<int, size_t> process_index_;
+    std::vector<Process> processes_;
+    std::map<std::pair<int, std::vector<int>>, LoopStats> loops_;
+};
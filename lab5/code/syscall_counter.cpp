@@ -0,0 +1,148 @@
+#include "syscall_counter.hpp"
+#include <cerrno>
+#include <csignal>
+#include <set>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+static const std::map<long, const char *> &SyscallNames() {
+    static const std::map<long, const char *> names = {
+        {SYS_read, "read"}, {SYS_write, "write"}, {SYS_readv, "readv"}, {SYS_writev, "writev"},
+        {SYS_pread64, "pread64"}, {SYS_pwrite64, "pwrite64"}, {SYS_lseek, "lseek"},
+        {SYS_openat, "openat"}, {SYS_close, "close"}, {SYS_fstat, "fstat"}, {SYS_newfstatat, "newfstatat"},
+        {SYS_ioctl, "ioctl"}, {SYS_fcntl, "fcntl"}, {SYS_pipe2, "pipe2"}, {SYS_dup3, "dup3"},
+        {SYS_mknodat, "mknodat"}, {SYS_unlinkat, "unlinkat"}, {SYS_ftruncate, "ftruncate"},
+        {SYS_faccessat, "faccessat"}, {SYS_readlinkat, "readlinkat"}, {SYS_getdents64, "getdents64"},
+        {SYS_mmap, "mmap"}, {SYS_munmap, "munmap"}, {SYS_mprotect, "mprotect"}, {SYS_brk, "brk"},
+        {SYS_madvise, "madvise"}, {SYS_mremap, "mremap"},
+        {SYS_clone, "clone"}, {SYS_clone3, "clone3"}, {SYS_execve, "execve"}, {SYS_wait4, "wait4"},
+        {SYS_exit, "exit"}, {SYS_exit_group, "exit_group"}, {SYS_kill, "kill"}, {SYS_tgkill, "tgkill"},
+        {SYS_getpid, "getpid"}, {SYS_gettid, "gettid"}, {SYS_set_tid_address, "set_tid_address"},
+        {SYS_set_robust_list, "set_robust_list"}, {SYS_rseq, "rseq"}, {SYS_prlimit64, "prlimit64"},
+        {SYS_getrandom, "getrandom"}, {SYS_rt_sigaction, "rt_sigaction"},
+        {SYS_rt_sigprocmask, "rt_sigprocmask"}, {SYS_rt_sigreturn, "rt_sigreturn"},
+        {SYS_futex, "futex"}, {SYS_sched_yield, "sched_yield"}, {SYS_nanosleep, "nanosleep"},
+        {SYS_clock_nanosleep, "clock_nanosleep"}, {SYS_clock_gettime, "clock_gettime"},
+        {SYS_ppoll, "ppoll"}, {SYS_pselect6, "pselect6"}, {SYS_epoll_create1, "epoll_create1"},
+        {SYS_epoll_ctl, "epoll_ctl"}, {SYS_epoll_pwait, "epoll_pwait"}, {SYS_eventfd2, "eventfd2"},
+        {SYS_inotify_init1, "inotify_init1"}, {SYS_inotify_add_watch, "inotify_add_watch"},
+        {SYS_perf_event_open, "perf_event_open"}, {SYS_flock, "flock"}, {SYS_sendfile, "sendfile"},
+        {SYS_copy_file_range, "copy_file_range"}, {SYS_restart_syscall, "restart_syscall"},
+#ifdef SYS_open
+        {SYS_open, "open"},
+#endif
+#ifdef SYS_stat
+        {SYS_stat, "stat"},
+#endif
+#ifdef SYS_access
+        {SYS_access, "access"},
+#endif
+#ifdef SYS_pipe
+        {SYS_pipe, "pipe"},
+#endif
+#ifdef SYS_dup2
+        {SYS_dup2, "dup2"},
+#endif
+#ifdef SYS_poll
+        {SYS_poll, "poll"},
+#endif
+#ifdef SYS_select
+        {SYS_select, "select"},
+#endif
+#ifdef SYS_epoll_wait
+        {SYS_epoll_wait, "epoll_wait"},
+#endif
+#ifdef SYS_fork
+        {SYS_fork, "fork"},
+#endif
+#ifdef SYS_vfork
+        {SYS_vfork, "vfork"},
+#endif
+#ifdef SYS_unlink
+        {SYS_unlink, "unlink"},
+#endif
+#ifdef SYS_mknod
+        {SYS_mknod, "mknod"},
+#endif
+#ifdef SYS_arch_prctl
+        {SYS_arch_prctl, "arch_prctl"},
+#endif
+    };
+    return names;
+}
+
+static std::string SyscallName(long nr) {
+    auto it = SyscallNames().find(nr);
+    if (it != SyscallNames().end()) {
+        return it->second;
+    }
+    return "syscall_" + std::to_string(nr);
+}
+
+bool CountSyscalls(pid_t pid, std::map<std::string, uint64_t> &counts, int &status) {
+    status = 0;
+    int st;
+    if (waitpid(pid, &st, 0) != pid || !WIFSTOPPED(st)) {
+        return false;
+    }
+    long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE |
+                   PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, options) < 0 || ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr) < 0) {
+        return false;
+    }
+
+    std::map<long, uint64_t> by_number;
+    std::set<pid_t> traced = {pid};
+    std::set<pid_t> stopped_once = {pid};
+    while (!traced.empty()) {
+        pid_t w = waitpid(-1, &st, __WALL);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (WIFEXITED(st) || WIFSIGNALED(st)) {
+            traced.erase(w);
+            if (w == pid) {
+                status = st;
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(st)) {
+            continue;
+        }
+
+        int sig = WSTOPSIG(st);
+        int event = st >> 16;
+        int inject = 0;
+        traced.insert(w);
+        bool first_stop = stopped_once.insert(w).second;
+        if (sig == (SIGTRAP | 0x80)) {
+            __ptrace_syscall_info info;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, w, sizeof(info), &info) > 0 &&
+                info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                ++by_number[static_cast<long>(info.entry.nr)];
+            }
+        } else if (event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK || event == PTRACE_EVENT_CLONE) {
+            unsigned long child;
+            if (ptrace(PTRACE_GETEVENTMSG, w, nullptr, &child) == 0) {
+                traced.insert(static_cast<pid_t>(child));
+            }
+        } else if (event != 0) {
+            // exec and the like: nothing to pass on.
+        } else if (sig == SIGSTOP && first_stop) {
+            // A new child starts with SIGSTOP, which may be reported before
+            // or after its parent's fork event.
+        } else {
+            inject = sig;
+        }
+        ptrace(PTRACE_SYSCALL, w, nullptr, inject);
+    }
+
+    for (const auto &[nr, count] : by_number) {
+        counts[SyscallName(nr)] += count;
+    }
+    return true;
+}
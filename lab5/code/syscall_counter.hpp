@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+// Counts the syscalls of a process tree by tracing it with ptrace, like
+// `strace -f -c`. Tracing slows every syscall down, so counters and timings
+// have to come from a separate, untraced run.
+//
+// pid must be a child that called ptrace(PTRACE_TRACEME) and stopped itself
+// with SIGSTOP before its execve. Returns false if tracing failed; status is
+// pid's wait status.
+bool CountSyscalls(pid_t pid, std::map<std::string, uint64_t> &counts, int &status);